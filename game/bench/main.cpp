@@ -0,0 +1,220 @@
+// Macro-benchmark: runs a fixed set of scenes headlessly and reports
+// ms/frame per simulation phase, comparable across commits and machines.
+// The renderer draws every frame against a RecordingRenderBackend, so its
+// CPU side and what it sends to the GPU are measured without one
+// Usage: tptbox-bench [--frames N] [--warmup N] [--threads N] [--seed N] [--isa NAME] [--scene NAME]... [--compact] [--raycast-skip] [--no-raycast-packets] [--no-ballistic-energy] [--csv]
+
+#include "scenes.h"
+#include "src/simulation/Simulation.h"
+#include "src/render/Renderer.h"
+#include "src/render/camera/camera.h"
+#include "src/render/types/recording_render_backend.h"
+
+#include <omp.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+struct BenchArgs {
+    unsigned int frames = 300;
+    unsigned int warmup = 10;
+    unsigned int threads = 0; // 0 = let OpenMP decide
+    unsigned int seed = 614;
+    ParticleKernels::ISA isa = ParticleKernels::detect_isa(); // Best the CPU supports
+    bool csv = false;
+    bool compact = false; // Renumber parts in Morton order before timing, see Simulation::compact_parts
+    bool raycast_skip = false; // See Simulation::raycast_skip_empty
+    bool raycast_packets = true; // See Simulation::raycast_packets
+    bool ballistic_energy = true; // See Simulation::ballistic_energy
+    std::vector<const BenchScene *> scenes;
+};
+
+struct BenchResult {
+    unsigned int threads;
+    unsigned int parts;
+    double parts_mb; // Particle storage, see ParticleStore::memory_bytes
+    double frame_ms;
+    double phase_ms[SimPhase::COUNT];
+    double render_ms; // Renderer::draw, including the upload, not part of frame_ms
+    double upload_kb; // Sent to the GPU per frame, see RecordingRenderBackend
+    double gl_calls; // Backend calls per frame
+};
+
+static void print_usage(const char * program) {
+    printf("Usage: %s [--frames N] [--warmup N] [--threads N] [--seed N] [--isa NAME] [--scene NAME]... [--compact] [--raycast-skip] [--no-raycast-packets] [--no-ballistic-energy] [--csv]\n", program);
+    printf("ISAs (for particle kernels): scalar, avx2, avx512\n");
+    printf("Scenes:\n");
+    for (const auto &scene : BENCH_SCENES)
+        printf("  %-16s %s\n", scene.name, scene.description);
+}
+
+static bool parse_args(int argc, char ** argv, BenchArgs &args) {
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--frames") && has_value)
+            args.frames = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--warmup") && has_value)
+            args.warmup = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--threads") && has_value)
+            args.threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--seed") && has_value)
+            args.seed = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--isa") && has_value) {
+            bool found = false;
+            for (const auto isa : { ParticleKernels::ISA::SCALAR, ParticleKernels::ISA::AVX2, ParticleKernels::ISA::AVX512 }) {
+                if (!strcmp(argv[i + 1], ParticleKernels::isa_name(isa))) {
+                    args.isa = isa;
+                    found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "Unknown ISA '%s'\n", argv[i + 1]);
+                return false;
+            }
+            i++;
+        }
+        else if (!strcmp(argv[i], "--csv"))
+            args.csv = true;
+        else if (!strcmp(argv[i], "--compact"))
+            args.compact = true;
+        else if (!strcmp(argv[i], "--raycast-skip"))
+            args.raycast_skip = true;
+        else if (!strcmp(argv[i], "--no-raycast-packets"))
+            args.raycast_packets = false;
+        else if (!strcmp(argv[i], "--no-ballistic-energy"))
+            args.ballistic_energy = false;
+        else if (!strcmp(argv[i], "--scene") && has_value) {
+            const BenchScene * scene = find_bench_scene(argv[++i]);
+            if (!scene) {
+                fprintf(stderr, "Unknown scene '%s'\n", argv[i]);
+                return false;
+            }
+            args.scenes.push_back(scene);
+        }
+        else
+            return false;
+    }
+
+    if (args.scenes.empty())
+        for (const auto &scene : BENCH_SCENES)
+            args.scenes.push_back(&scene);
+    return args.frames > 0;
+}
+
+static BenchResult run_scene(const BenchScene &scene, const BenchArgs &args) {
+    // Simulation is several hundred MB, keep it off the stack
+    auto sim = std::make_unique<Simulation>();
+    sim->rng.seed(args.seed);
+    sim->raycast_skip_empty = args.raycast_skip;
+    sim->raycast_packets = args.raycast_packets;
+    sim->ballistic_energy = args.ballistic_energy;
+    scene.build(*sim);
+
+    // Air::update is not part of Simulation::update yet, so it is stepped
+    // here to keep its cost in the numbers
+    for (unsigned int frame = 0; frame < args.warmup; frame++) {
+        sim->update();
+        sim->air.update();
+    }
+    if (args.compact)
+        sim->compact_parts();
+
+    // Same view as ScreenGameplay::init. The first draw uploads everything,
+    // so it isn't measured either
+    RecordingRenderBackend backend;
+    RenderCamera camera;
+    camera.camera.position = Vector3{XRES * 1.5f, YRES / 2, ZRES * 1.5f};
+    camera.camera.target = Vector3{XRES / 2, YRES / 2, ZRES / 2};
+    camera.camera.up = Vector3{0.0f, 1.0f, 0.0f};
+    camera.camera.fovy = 45.0f;
+    auto renderer = std::make_unique<Renderer>(sim.get(), &camera, &backend);
+    renderer->init();
+    renderer->draw();
+
+    sim->stats.reset();
+    sim->stats.enabled = true;
+
+    std::chrono::steady_clock::duration elapsed{}, render_elapsed{};
+    std::size_t upload_bytes = 0, calls = 0;
+
+    for (unsigned int frame = 0; frame < args.frames; frame++) {
+        const auto start = std::chrono::steady_clock::now();
+        sim->update();
+        sim->air.update();
+        const auto render_start = std::chrono::steady_clock::now();
+        renderer->draw();
+        const auto end = std::chrono::steady_clock::now();
+        elapsed += render_start - start;
+        render_elapsed += end - render_start;
+
+        // draw ended the frame, so it is the one before the current
+        const auto &record = backend.record(backend.frame() - 1);
+        upload_bytes += record.upload_bytes;
+        calls += record.call_count;
+    }
+
+    BenchResult result;
+    result.threads = sim->actual_thread_count;
+    result.parts = sim->parts_count;
+    result.parts_mb = sim->parts.memory_bytes() / (1024.0 * 1024.0);
+    result.frame_ms = std::chrono::duration<double, std::milli>(elapsed).count() / args.frames;
+    result.render_ms = std::chrono::duration<double, std::milli>(render_elapsed).count() / args.frames;
+    result.upload_kb = upload_bytes / 1024.0 / args.frames;
+    result.gl_calls = static_cast<double>(calls) / args.frames;
+    for (unsigned int phase = 0; phase < SimPhase::COUNT; phase++)
+        result.phase_ms[phase] = sim->stats.total_ms(phase) / args.frames;
+    return result;
+}
+
+int main(int argc, char ** argv) {
+    BenchArgs args;
+    if (!parse_args(argc, argv, args)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    omp_set_dynamic(false); // Don't allow dynamic scaling of num of threads
+    if (args.threads)
+        omp_set_num_threads(args.threads);
+    if (!ParticleKernels::set_isa(args.isa)) {
+        fprintf(stderr, "ISA %s is not supported by this CPU\n", ParticleKernels::isa_name(args.isa));
+        return 1;
+    }
+    const char * isa_name = ParticleKernels::isa_name(args.isa);
+
+    // All phase columns are ms/frame. update_tile, update_overflow and _raycast_movement are
+    // summed over all threads, so they can exceed frame_ms
+    if (args.csv) {
+        printf("scene,frames,threads,isa,parts,parts_mb,frame_ms");
+        for (const auto name : SimPhase::NAMES)
+            printf(",%s", name);
+        printf(",render_ms,upload_kb,gl_calls\n");
+    } else {
+        printf("%-16s %7s %7s %7s %9s %9s %9s", "scene", "frames", "threads", "isa", "parts", "parts_mb", "frame_ms");
+        for (const auto name : SimPhase::NAMES)
+            printf(" %22s", name);
+        printf(" %9s %9s %9s\n", "render_ms", "upload_kb", "gl_calls");
+    }
+
+    for (const auto scene : args.scenes) {
+        const BenchResult result = run_scene(*scene, args);
+
+        if (args.csv) {
+            printf("%s,%u,%u,%s,%u,%.2f,%.4f", scene->name, args.frames, result.threads, isa_name, result.parts, result.parts_mb, result.frame_ms);
+            for (const auto ms : result.phase_ms)
+                printf(",%.4f", ms);
+            printf(",%.4f,%.2f,%.1f", result.render_ms, result.upload_kb, result.gl_calls);
+        } else {
+            printf("%-16s %7u %7u %7s %9u %9.1f %9.3f", scene->name, args.frames, result.threads, isa_name, result.parts, result.parts_mb, result.frame_ms);
+            for (const auto ms : result.phase_ms)
+                printf(" %22.3f", ms);
+            printf(" %9.3f %9.1f %9.1f", result.render_ms, result.upload_kb, result.gl_calls);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "scenes.h"
+
+#include "src/simulation/Simulation.h"
+#include "src/simulation/ElementClasses.h"
+
+#include <cstring>
+
+// Scenes must not depend on sim.rng's state, so anything random here
+// uses its own fixed seed
+constexpr unsigned int SCENE_SEED = 1234;
+
+static void build_water_floor(Simulation &sim) {
+    // Same as ScreenGameplay::init
+    for (unsigned int x = 1; x < XRES - 1; x++)
+    for (unsigned int z = 1; z < ZRES - 1; z++)
+        sim.create_part(x, 1, z, PT_WATR);
+}
+
+static void build_dust_column(Simulation &sim) {
+    for (unsigned int x = 0; x < 50; x++)
+    for (unsigned int z = 0; z < 50; z++)
+    for (unsigned int y = 1; y < 91; y++)
+        sim.create_part(x + 10, y, z + 10, PT_DUST);
+}
+
+static void build_gol_slab(Simulation &sim) {
+    for (unsigned int x = 1; x < XRES - 1; x++)
+    for (unsigned int z = 1; z < ZRES - 1; z++)
+    for (unsigned int y = 50; y < 54; y++)
+        sim.create_part(x, y, z, PT_GOL);
+}
+
+static void build_phot_swarm(Simulation &sim) {
+    RNG rng;
+    rng.seed(SCENE_SEED);
+
+    constexpr unsigned int SIZE = 30;
+    constexpr unsigned int START = XRES / 2 - SIZE / 2;
+    for (unsigned int x = START; x < START + SIZE; x++)
+    for (unsigned int z = START; z < START + SIZE; z++)
+    for (unsigned int y = START; y < START + SIZE; y++) {
+        const part_id i = sim.create_part(x, y, z, PT_PHOT);
+        if (i < 0) continue;
+
+        const Vector3 dir = rng.rand_norm_vector();
+        const float speed = rng.uniform(1.0f, MAX_VELOCITY);
+        sim.parts[i].vx = dir.x * speed;
+        sim.parts[i].vy = dir.y * speed;
+        sim.parts[i].vz = dir.z * speed;
+    }
+}
+
+static void build_phot_cloud(Simulation &sim) {
+    RNG rng;
+    rng.seed(SCENE_SEED);
+
+    // About 1M PHOT spread over the whole sim, one in 7 voxels
+    for (unsigned int x = 1; x < XRES - 1; x++)
+    for (unsigned int z = 1; z < ZRES - 1; z++)
+    for (unsigned int y = 1; y < YRES - 1; y++) {
+        if ((x + 2 * y + 3 * z) % 7)
+            continue;
+        const part_id i = sim.create_part(x, y, z, PT_PHOT);
+        if (i < 0) continue;
+
+        const Vector3 dir = rng.rand_norm_vector();
+        const float speed = rng.uniform(1.0f, MAX_VELOCITY);
+        sim.parts[i].vx = dir.x * speed;
+        sim.parts[i].vy = dir.y * speed;
+        sim.parts[i].vz = dir.z * speed;
+    }
+}
+
+static void build_gas_water_box(Simulation &sim) {
+    for (unsigned int x = 40; x < XRES - 40; x++)
+    for (unsigned int z = 40; z < ZRES - 40; z++)
+    for (unsigned int y = 1; y < 81; y++)
+        sim.create_part(x, y, z, (x + y + z) % 2 ? PT_GAS : PT_WATR);
+}
+
+const std::array<BenchScene, 6> BENCH_SCENES{{
+    { "water_floor",   "Full floor of WATR at y = 1",      &build_water_floor },
+    { "dust_column",   "50x90x50 column of DUST",          &build_dust_column },
+    { "gol_slab",      "Full width 4 voxel thick GOL slab", &build_gol_slab },
+    { "phot_swarm",    "30^3 PHOT with random velocities", &build_phot_swarm },
+    { "gas_water_box", "120x80x120 checkerboard of GAS and WATR", &build_gas_water_box },
+    { "phot_cloud",    "~1M PHOT with random velocities filling the sim", &build_phot_cloud }
+}};
+
+const BenchScene * find_bench_scene(const char * name) {
+    for (const auto &scene : BENCH_SCENES)
+        if (!strcmp(scene.name, name))
+            return &scene;
+    return nullptr;
+}
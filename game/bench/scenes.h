@@ -0,0 +1,24 @@
+#ifndef BENCH_SCENES_H
+#define BENCH_SCENES_H
+
+#include <array>
+
+class Simulation;
+
+// A fixed, deterministic starting state for benchmarks
+struct BenchScene {
+    const char * name;
+    const char * description;
+    void (*build)(Simulation &sim);
+};
+
+extern const std::array<BenchScene, 6> BENCH_SCENES;
+
+/**
+ * @brief Find a scene by name
+ * @param name Name of the scene, ie "water_floor"
+ * @return const BenchScene* nullptr if not found
+ */
+const BenchScene * find_bench_scene(const char * name);
+
+#endif
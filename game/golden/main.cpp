@@ -0,0 +1,289 @@
+// Golden frame regression check: replays the bench scenes and compares the
+// world checksum of every frame (see Simulation::checksum) against stored
+// golden files, so a change to scheduling, layout or SIMD code can show it
+// didn't change what the simulation computes. --check-uploads also sends
+// every frame through VoxelUploader into a MemoryUploadBackend and checks
+// the result equals the simulation's color, flag, octree, AO and shadow data
+// Before the scenes, CounterRNG's batch draw is checked against its streams
+// Usage: tptbox-golden [--record] [--dir PATH] [--frames N] [--threads N] [--isa NAME] [--scene NAME]... [--raycast-skip] [--no-raycast-packets] [--no-ballistic-energy] [--check-uploads]
+
+#include "bench/scenes.h"
+#include "src/simulation/Simulation.h"
+#include "src/render/types/voxel_uploader.h"
+#include "src/render/types/memory_upload_backend.h"
+
+#include <omp.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct GoldenArgs {
+    bool record = false; // Write the golden files instead of checking against them
+    std::string dir = "game/golden/data";
+    unsigned int frames = 60; // Only for --record, a check runs as many frames as the file has
+    unsigned int threads = 0; // 0 = let OpenMP decide
+    unsigned int seed = 614;
+    ParticleKernels::ISA isa = ParticleKernels::detect_isa();
+    bool raycast_skip = false;
+    bool raycast_packets = true;
+    bool ballistic_energy = true;
+    bool check_uploads = false;
+    std::vector<const BenchScene *> scenes;
+};
+
+static void print_usage(const char * program) {
+    printf("Usage: %s [--record] [--dir PATH] [--frames N] [--threads N] [--isa NAME] [--scene NAME]... [--raycast-skip] [--no-raycast-packets] [--no-ballistic-energy] [--check-uploads]\n", program);
+    printf("Checks every frame of each scene against PATH/<scene>.txt (default game/golden/data), --record writes them\n");
+    printf("Scenes:\n");
+    for (const auto &scene : BENCH_SCENES)
+        printf("  %-16s %s\n", scene.name, scene.description);
+}
+
+static bool parse_args(int argc, char ** argv, GoldenArgs &args) {
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--record"))
+            args.record = true;
+        else if (!strcmp(argv[i], "--dir") && has_value)
+            args.dir = argv[++i];
+        else if (!strcmp(argv[i], "--frames") && has_value)
+            args.frames = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--threads") && has_value)
+            args.threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--isa") && has_value) {
+            bool found = false;
+            for (const auto isa : { ParticleKernels::ISA::SCALAR, ParticleKernels::ISA::AVX2, ParticleKernels::ISA::AVX512 }) {
+                if (!strcmp(argv[i + 1], ParticleKernels::isa_name(isa))) {
+                    args.isa = isa;
+                    found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "Unknown ISA '%s'\n", argv[i + 1]);
+                return false;
+            }
+            i++;
+        }
+        else if (!strcmp(argv[i], "--raycast-skip"))
+            args.raycast_skip = true;
+        else if (!strcmp(argv[i], "--no-raycast-packets"))
+            args.raycast_packets = false;
+        else if (!strcmp(argv[i], "--no-ballistic-energy"))
+            args.ballistic_energy = false;
+        else if (!strcmp(argv[i], "--check-uploads"))
+            args.check_uploads = true;
+        else if (!strcmp(argv[i], "--scene") && has_value) {
+            const BenchScene * scene = find_bench_scene(argv[++i]);
+            if (!scene) {
+                fprintf(stderr, "Unknown scene '%s'\n", argv[i]);
+                return false;
+            }
+            args.scenes.push_back(scene);
+        }
+        else
+            return false;
+    }
+
+    if (args.scenes.empty())
+        for (const auto &scene : BENCH_SCENES)
+            args.scenes.push_back(&scene);
+    return args.frames > 0;
+}
+
+/**
+ * @brief Read a golden file: a "seed N" line, then one line of checksums per frame
+ * @return bool false if missing or malformed
+ */
+static bool read_golden(const std::string &path, unsigned int &seed, std::vector<WorldChecksum> &frames) {
+    FILE * file = fopen(path.c_str(), "r");
+    if (!file)
+        return false;
+
+    bool ok = fscanf(file, " seed %u", &seed) == 1;
+    unsigned int frame;
+    WorldChecksum sum;
+    while (ok && fscanf(file, " %u %" SCNx64 " %" SCNx64 " %" SCNx64 " %" SCNx64,
+            &frame, &sum.parts, &sum.pmap, &sum.photons, &sum.air) == 5) {
+        ok = frame == frames.size();
+        frames.push_back(sum);
+    }
+    ok = ok && feof(file) && !frames.empty();
+    fclose(file);
+    return ok;
+}
+
+static bool write_golden(const std::string &path, const unsigned int seed, const std::vector<WorldChecksum> &frames) {
+    FILE * file = fopen(path.c_str(), "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "seed %u\n", seed);
+    for (std::size_t frame = 0; frame < frames.size(); frame++) {
+        const auto &sum = frames[frame];
+        fprintf(file, "%zu %016" PRIx64 " %016" PRIx64 " %016" PRIx64 " %016" PRIx64 "\n",
+            frame, sum.parts, sum.pmap, sum.photons, sum.air);
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * @brief Run a scene, checksum after each frame. Stops at the first frame that
+ *        differs from expected (if given), as everything after it differs too
+ * @param bad_uploads With --check-uploads, set to the bits of the targets that
+ *        differed in the first frame that had any (see MemoryUploadBackend),
+ *        which also stops the run
+ */
+static std::vector<WorldChecksum> run_scene(const BenchScene &scene, const GoldenArgs &args, const unsigned int seed,
+        const unsigned int frames, const std::vector<WorldChecksum> * expected, unsigned int &bad_uploads) {
+    // Simulation is several hundred MB, keep it off the stack
+    auto sim = std::make_unique<Simulation>();
+    sim->rng.seed(seed);
+    sim->raycast_skip_empty = args.raycast_skip;
+    sim->raycast_packets = args.raycast_packets;
+    sim->ballistic_energy = args.ballistic_energy;
+    scene.build(*sim);
+
+    // Targets are several hundred MB together as well
+    VoxelUploader uploader;
+    std::unique_ptr<MemoryUploadBackend> upload_backend;
+    if (args.check_uploads)
+        upload_backend = std::make_unique<MemoryUploadBackend>();
+    bad_uploads = 0;
+
+    // Air is stepped like in the bench, see there
+    std::vector<WorldChecksum> out;
+    for (unsigned int frame = 0; frame < frames; frame++) {
+        sim->update();
+        sim->air.update();
+        out.push_back(sim->checksum());
+        if (expected && out.back() != (*expected)[frame])
+            break;
+
+        if (upload_backend) {
+            // Every third frame the staging buffer fails to map, to check the fallback too
+            upload_backend->fail_map = frame % 3 == 2;
+            uploader.upload(sim->graphics, *upload_backend);
+            bad_uploads = upload_backend->mismatched_targets(sim->graphics);
+            if (upload_backend->bad_calls())
+                bad_uploads |= 1 << UPLOAD_TARGET_COUNT;
+            if (bad_uploads)
+                break;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Whether CounterRNG::uniform01_batch gives exactly what the per
+ *        particle streams do. It is compiled vectorized, so this is where
+ *        the compiler flags could make them differ
+ */
+static bool check_counter_rng(const unsigned int seed) {
+    constexpr unsigned int COUNT = 4096;
+    std::vector<int32_t> ids(COUNT);
+    for (unsigned int k = 0; k < COUNT; k++)
+        ids[k] = static_cast<int32_t>(k * 7919 + 1); // Not consecutive, so lanes don't share structure
+
+    CounterRNG rng;
+    rng.seed(seed);
+    std::vector<float> uniforms(COUNT);
+    for (const uint32_t frame : { 0u, 1u, 600u, 0xFFFFFFFFu }) {
+        for (const uint32_t purpose : { 0u, 3u }) {
+            rng.uniform01_batch(frame, ids.data(), COUNT, uniforms.data(), purpose);
+            for (unsigned int k = 0; k < COUNT; k++)
+                if (uniforms[k] != rng.stream(frame, ids[k], purpose).uniform01())
+                    return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    GoldenArgs args;
+    if (!parse_args(argc, argv, args)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    omp_set_dynamic(false); // Don't allow dynamic scaling of num of threads
+    if (args.threads)
+        omp_set_num_threads(args.threads);
+    if (!ParticleKernels::set_isa(args.isa)) {
+        fprintf(stderr, "ISA %s is not supported by this CPU\n", ParticleKernels::isa_name(args.isa));
+        return 1;
+    }
+
+#ifdef __FAST_MATH__
+    // Reordered or approximated float math rounds differently at every
+    // optimization level, so neither checking nor recording would mean anything
+    fprintf(stderr, "Built with -ffast-math, the golden files need -fno-unsafe-math-optimizations\n");
+    return 1;
+#endif
+
+    unsigned int failed = 0;
+    if (check_counter_rng(args.seed))
+        printf("%-16s ok\n", "counter_rng");
+    else {
+        printf("%-16s FAIL uniform01_batch differs from the streams\n", "counter_rng");
+        failed++;
+    }
+
+    for (const auto scene : args.scenes) {
+        const std::string path = args.dir + "/" + scene->name + ".txt";
+
+        if (args.record) {
+            unsigned int bad_uploads;
+            const auto frames = run_scene(*scene, args, args.seed, args.frames, nullptr, bad_uploads);
+            if (!write_golden(path, args.seed, frames)) {
+                fprintf(stderr, "Failed to write %s\n", path.c_str());
+                return 1;
+            }
+            printf("%-16s recorded %zu frames to %s\n", scene->name, frames.size(), path.c_str());
+            fflush(stdout);
+            continue;
+        }
+
+        unsigned int seed;
+        std::vector<WorldChecksum> expected;
+        if (!read_golden(path, seed, expected)) {
+            printf("%-16s FAIL can't read %s\n", scene->name, path.c_str());
+            failed++;
+            continue;
+        }
+
+        unsigned int bad_uploads;
+        const auto frames = run_scene(*scene, args, seed, expected.size(), &expected, bad_uploads);
+        if (bad_uploads) {
+            const auto bad = [&](const UploadTarget target) { return (bad_uploads >> static_cast<int>(target)) & 1; };
+            printf("%-16s FAIL uploads at frame %zu:%s%s%s%s%s%s\n", scene->name, frames.size() - 1,
+                bad(UploadTarget::COLORS) ? " colors" : "",
+                bad(UploadTarget::FLAGS) ? " flags" : "",
+                bad(UploadTarget::LOD) ? " lod" : "",
+                bad(UploadTarget::AO) ? " ao" : "",
+                bad(UploadTarget::SHADOW) ? " shadow" : "",
+                (bad_uploads >> UPLOAD_TARGET_COUNT) & 1 ? " bad_calls" : "");
+            failed++;
+        }
+        else if (frames.size() == expected.size() && frames.back() == expected.back())
+            printf("%-16s ok (%zu frames)\n", scene->name, frames.size());
+        else {
+            // Name the parts of the state that diverged first
+            const auto &got = frames.back(), &want = expected[frames.size() - 1];
+            printf("%-16s FAIL at frame %zu:%s%s%s%s\n", scene->name, frames.size() - 1,
+                got.parts != want.parts ? " parts" : "",
+                got.pmap != want.pmap ? " pmap" : "",
+                got.photons != want.photons ? " photons" : "",
+                got.air != want.air ? " air" : "");
+            failed++;
+        }
+        fflush(stdout);
+    }
+
+    if (failed)
+        printf("%u of %zu scenes differ from the golden files\n", failed, args.scenes.size());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+// Headless simulation runner: steps the simulation with no window or GL context
+// Usage: tptbox-headless [--frames N] [--threads N] [--seed N] [--trace PATH]
+
+#include "src/simulation/Simulation.h"
+#include "src/simulation/ElementClasses.h"
+#include "src/util/profiler.h"
+
+#include <omp.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+struct HeadlessArgs {
+    unsigned int frames = 1000;
+    unsigned int threads = 0; // 0 = let OpenMP decide
+    unsigned int seed = 614;
+    const char * trace_path = "trace.json"; // Only written when built with --profile
+};
+
+static void print_usage(const char * program) {
+    printf("Usage: %s [--frames N] [--threads N] [--seed N] [--trace PATH]\n", program);
+}
+
+static bool parse_args(int argc, char ** argv, HeadlessArgs &args) {
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--frames") && has_value)
+            args.frames = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--threads") && has_value)
+            args.threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--seed") && has_value)
+            args.seed = std::strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--trace") && has_value)
+            args.trace_path = argv[++i];
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    HeadlessArgs args;
+    if (!parse_args(argc, argv, args)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    omp_set_dynamic(false); // Don't allow dynamic scaling of num of threads
+    if (args.threads)
+        omp_set_num_threads(args.threads);
+
+    // Simulation is several hundred MB, keep it off the stack
+    auto sim = std::make_unique<Simulation>();
+    sim->rng.seed(args.seed);
+
+    // Same full-floor water layer as ScreenGameplay::init
+    for (int x = 1; x < XRES - 1; x++)
+    for (int z = 1; z < ZRES - 1; z++)
+        sim->create_part(x, 1, z, PT_WATR);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int frame = 0; frame < args.frames; frame++)
+        sim->update();
+    const auto end = std::chrono::steady_clock::now();
+
+    const double total_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    const double ms_per_frame = args.frames ? total_ms / args.frames : 0.0;
+
+    printf("frames:    %u\n", args.frames);
+    printf("threads:   %u\n", sim->actual_thread_count);
+    printf("parts:     %u\n", sim->parts_count);
+    printf("total:     %.3f ms\n", total_ms);
+    printf("per frame: %.3f ms (%.1f FPS)\n", ms_per_frame, ms_per_frame > 0.0 ? 1000.0 / ms_per_frame : 0.0);
+
+    if (util::profiler::enabled()) {
+        if (util::profiler::dump_chrome_trace(args.trace_path))
+            printf("trace:     %s\n", args.trace_path);
+        else
+            fprintf(stderr, "Failed to write trace to %s\n", args.trace_path);
+    }
+    return 0;
+}
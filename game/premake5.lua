@@ -1,6 +1,47 @@
-
 baseName = path.getbasename(os.getcwd());
 
+-- Simulation core as a static library. Only uses raylib headers for the
+-- vector / matrix types, so it never needs a window or a GL context
+project "simulation"
+	kind "StaticLib"
+    location "../_build"
+    targetdir "../_bin/%{cfg.buildcfg}"
+
+	buildoptions {
+		"-fopenmp",
+		"-flto", -- Link time optimization
+		"-ffat-lto-objects" -- Archive is still linkable if ar has no LTO plugin
+	}
+
+	vpaths 
+	{
+	  ["Header Files/*"] = { "src/**.h",  "src/**.hpp" },
+	  ["Source Files/*"] = { "src/**.c", "src/**.cpp" },
+	}
+
+	include "src/simulation"
+
+	files {
+		"src/util/**.h",
+		"src/util/types/rand.cpp",
+		"src/util/profiler.cpp",
+		"src/render/types/octree.h",
+		"src/render/types/octree.cpp",
+		"src/render/types/upload_spans.h",
+		"src/render/types/upload_spans.cpp",
+		"src/render/types/upload_backend.h",
+		"src/render/types/voxel_uploader.h",
+		"src/render/types/voxel_uploader.cpp",
+		"src/render/types/memory_upload_backend.h",
+		"src/render/types/memory_upload_backend.cpp"
+	}
+
+    includedirs { "./" }
+    includedirs { "src" }
+
+	include_raylib()
+
+
 project (workspaceName)
   	kind "ConsoleApp"
     location "../_build"
@@ -30,14 +71,116 @@ project (workspaceName)
 	  ["Source Files/*"] = {"src/**.c", "src/**.cpp","**.c", "**.cpp"},
 	}
 
-	include "src/simulation"
-
 	files {"**.c", "**.cpp", "**.h", "**.hpp"}
 
+	-- Compiled into the simulation library instead
+	removefiles {
+		"headless/**",
+		"bench/**",
+		"golden/**",
+		"src/simulation/**.cpp",
+		"src/util/types/rand.cpp",
+		"src/util/profiler.cpp",
+		"src/render/types/octree.cpp",
+		"src/render/types/upload_spans.cpp",
+		"src/render/types/voxel_uploader.cpp",
+		"src/render/types/memory_upload_backend.cpp"
+	}
+
     includedirs { "./" }
     includedirs { "src" }
     includedirs { "include" }
 
+	simulation_defines()
+	links { "simulation" }
 	link_raylib()
 	
-	-- To link to a lib use link_to("LIB_FOLDER_NAME")
\ No newline at end of file
+	-- To link to a lib use link_to("LIB_FOLDER_NAME")
+
+
+-- Runs the simulation without a window, for build servers without a GPU
+project "tptbox-headless"
+	kind "ConsoleApp"
+    location "../_build"
+    targetdir "../_bin/%{cfg.buildcfg}"
+
+	linkoptions { "-fopenmp" }
+	buildoptions {
+		"-fopenmp",
+		"-flto", -- Link time optimization
+	}
+
+	files { "headless/**.cpp", "headless/**.h" }
+
+    includedirs { "./" }
+    includedirs { "src" }
+
+	simulation_defines()
+	links { "simulation" }
+	include_raylib()
+
+	filter "system:linux"
+		links { "pthread", "m" }
+	filter {}
+
+
+-- Deterministic scene benchmarks with per-phase timings, also windowless
+project "tptbox-bench"
+	kind "ConsoleApp"
+    location "../_build"
+    targetdir "../_bin/%{cfg.buildcfg}"
+
+	linkoptions { "-fopenmp" }
+	buildoptions {
+		"-fopenmp",
+		"-flto", -- Link time optimization
+	}
+
+	files { "bench/**.cpp", "bench/**.h" }
+
+	-- Renderer, drawn against RecordingRenderBackend so no GL is linked
+	files {
+		"src/render/Renderer.cpp",
+		"src/render/types/multitexture.cpp",
+		"src/render/types/staging_upload_backend.cpp",
+		"src/render/types/recording_render_backend.cpp",
+		"src/util/types/ubo.cpp"
+	}
+
+    includedirs { "./" }
+    includedirs { "src" }
+
+	simulation_defines()
+	links { "simulation" }
+	include_raylib()
+
+	filter "system:linux"
+		links { "pthread", "m" }
+	filter {}
+
+
+-- Replays the bench scenes and compares per frame world checksums against
+-- the golden files in golden/data, to show a change kept the results
+project "tptbox-golden"
+	kind "ConsoleApp"
+    location "../_build"
+    targetdir "../_bin/%{cfg.buildcfg}"
+
+	linkoptions { "-fopenmp" }
+	buildoptions {
+		"-fopenmp",
+		"-flto", -- Link time optimization
+	}
+
+	files { "golden/**.cpp", "golden/**.h", "bench/scenes.cpp", "bench/scenes.h" }
+
+    includedirs { "./" }
+    includedirs { "src" }
+
+	simulation_defines()
+	links { "simulation" }
+	include_raylib()
+
+	filter "system:linux"
+		links { "pthread", "m" }
+	filter {}
@@ -73,7 +73,7 @@ void BrushRenderer::do_controls(Simulation * sim) {
         for (int z = bz - half_size; z <= bz + half_size; z++)
             if (BOUNDS_CHECK(x, y, z)) {
                 if (delete_mode)
-                    sim->kill_part(ID(sim->pmap[z][y][x]));
+                    sim->kill_part(ID(sim->pmap(x, y, z)));
                 else
                     sim->create_part(x, y, z, selected_element);
             }
@@ -114,7 +114,7 @@ void BrushRenderer::do_raycast(Simulation * sim, RenderCamera * camera) {
     auto pmapOccupied = [sim](const Vector3T<signed_coord_t> &loc) -> PartSwapBehavior {
         if (REVERSE_BOUNDS_CHECK(loc.x, loc.y, loc.z))
             return PartSwapBehavior::NOOP;
-        if (sim->pmap[loc.z][loc.y][loc.x] || sim->photons[loc.z][loc.y][loc.x])
+        if (sim->pmap(loc.x, loc.y, loc.z) || sim->photons(loc.x, loc.y, loc.z))
             return PartSwapBehavior::NOOP;
         return PartSwapBehavior::SWAP;
     };
@@ -7,6 +7,7 @@
 #include "../../simulation/ElementClasses.h"
 #include "../../util/str_format.h"
 #include "../../util/math.h"
+#include "../../util/profiler.h"
 #include "../FontCache.h"
 #include "../brush/Brush.h"
 
@@ -81,6 +82,15 @@ void HUD::update_controls(const BrushRenderer &brush_renderer) {
         displayTooltip(TextFormat("Gravity: %s", Simulation::getGravityModeName(sim->gravity_mode)));
         consumeKey = true;
     }
+    if (EventConsumer::ref()->isKeyPressed(KEY_T)) { // Dump profiler zones
+        if (!util::profiler::enabled())
+            displayTooltip("Profiling disabled, build with --profile");
+        else if (util::profiler::dump_chrome_trace("trace.json"))
+            displayTooltip("Wrote trace.json");
+        else
+            displayTooltip("Failed to write trace.json");
+        consumeKey = true;
+    }
     if (EventConsumer::ref()->isKeyPressed(KEY_F)) { // Set rotate point
         cam->setLerpTarget(cam->camera.position, (Vector3)brush_renderer.get_raycast_pos(), cam->camera.up);
         consumeKey = true;
@@ -102,9 +112,9 @@ void HUD::draw(const HUDData &data) {
     const int rz = raycast_pos.z;
     uint32_t idx = 0;
     if (rx >= 0 && ry >= 0 && rz >= 0) {
-        idx = ID(sim->pmap[rz][ry][rx]);
-        if (ID(sim->photons[rz][ry][rx]))
-            idx = ID(sim->photons[rz][ry][rx]);
+        idx = ID(sim->pmap(rx, ry, rz));
+        if (ID(sim->photons(rx, ry, rz)))
+            idx = ID(sim->photons(rx, ry, rz));
     }
 
     if (debug) {
@@ -145,22 +155,25 @@ void HUD::draw(const HUDData &data) {
 
     // Additional lines if currently hovering an element
     if (idx) {
-        const char * dcolor = sim->parts[idx].dcolor.as_RGBA() ?
-            TextFormat("#%08X", sim->parts[idx].dcolor.as_RGBA()) : "0";
+        // Read fields into values first, with compact particles they're proxies
+        const auto part = sim->parts[idx];
+        const RGBA dcolor_value = part.dcolor;
+        const char * dcolor = dcolor_value.as_RGBA() ?
+            TextFormat("#%08X", dcolor_value.as_RGBA()) : "0";
         drawTextRAlign(TextFormat("Temp: %.2f C  Life: %d, tmp1: %d, tmp2: %d, dcolor: %s",
-                sim->parts[idx].temp,
-                sim->parts[idx].life,
-                sim->parts[idx].tmp1,
-                sim->parts[idx].tmp2,
+                static_cast<float>(part.temp),
+                static_cast<int>(part.life),
+                static_cast<int>(part.tmp1),
+                static_cast<int>(part.tmp2),
                 dcolor),
             GetScreenWidth() - RHUD_X_OFFSET, 20 + OFFSET, WHITE);
 
         if (debug) {
             drawTextRAlign(TextFormat("VEL: %.2f, %.2f, %.2f, flag: %s",
-                    sim->parts[idx].vx,
-                    sim->parts[idx].vy,
-                    sim->parts[idx].vz,
-                    sim->parts[idx].flag.to_string().c_str()
+                    static_cast<float>(part.vx),
+                    static_cast<float>(part.vy),
+                    static_cast<float>(part.vz),
+                    part.flag.to_string().c_str()
                 ),
                 GetScreenWidth() - RHUD_X_OFFSET, 20 + 2 * OFFSET, WHITE);
         }
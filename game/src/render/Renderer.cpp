@@ -5,31 +5,31 @@
 #include "constants.h"
 
 #include "../util/math.h"
-#include "../util/graphics.h"
 #include "../util/morton.h"
 #include "../util/types/ubo.h"
+#include "../util/profiler.h"
 
 #include "rlgl.h"
 #include "stdint.h"
 #include <cstring>
 
 Renderer::~Renderer() {
-    UnloadShader(part_shader);
-    UnloadShader(post_shader);
-    UnloadShader(blur_shader);
-
-    UnloadRenderTexture(blur1_tex);
-    UnloadRenderTexture(blur2_tex);
-    UnloadRenderTexture(blur_tmp_tex);
-    glDeleteBuffers(BUFFER_COUNT, ssbo_colors);
-    glDeleteBuffers(BUFFER_COUNT, ssbo_flags);
-    glDeleteBuffers(BUFFER_COUNT, ssbo_lod);
-
-    glDeleteBuffers(1, &ubo_constants);
-    glDeleteBuffers(1, &ubo_settings);
-    glDeleteTextures(BUFFER_COUNT, ao_tex);
-    glDeleteTextures(BUFFER_COUNT, shadow_tex);
-    delete[] ao_data;
+    backend->unload_shader(part_shader);
+    backend->unload_shader(post_shader);
+    backend->unload_shader(blur_shader);
+
+    backend->unload_render_texture(blur1_tex);
+    backend->unload_render_texture(blur2_tex);
+    backend->unload_render_texture(blur_tmp_tex);
+    upload_backend.reset();
+    backend->delete_buffer(ssbo_colors);
+    backend->delete_buffer(ssbo_flags);
+    backend->delete_buffer(ssbo_lod);
+
+    backend->delete_buffer(ubo_constants);
+    backend->delete_buffer(ubo_settings);
+    backend->delete_texture(ao_tex);
+    backend->delete_texture(shadow_tex);
 }
 
 void Renderer::init() {
@@ -39,75 +39,70 @@ void Renderer::init() {
     #include "../../resources/shaders/generated/post.fs.h"
     #include "../../resources/shaders/generated/blur.fs.h"
 
-    part_shader = LoadShaderFromMemory(fullscreen_vs_source, part_fs_source);
-    post_shader = LoadShaderFromMemory(fullscreen_vs_source, post_fs_source);
-    blur_shader = LoadShaderFromMemory(fullscreen_vs_source, blur_fs_source);
+    part_shader = backend->load_shader_from_memory(fullscreen_vs_source, part_fs_source);
+    post_shader = backend->load_shader_from_memory(fullscreen_vs_source, post_fs_source);
+    blur_shader = backend->load_shader_from_memory(fullscreen_vs_source, blur_fs_source);
 #else
-    part_shader = LoadShader("resources/shaders/fullscreen.vs", "resources/shaders/part.fs");
-    post_shader = LoadShader("resources/shaders/fullscreen.vs", "resources/shaders/post.fs");
-    blur_shader = LoadShader("resources/shaders/fullscreen.vs", "resources/shaders/blur.fs");
+    part_shader = backend->load_shader("resources/shaders/fullscreen.vs", "resources/shaders/part.fs");
+    post_shader = backend->load_shader("resources/shaders/fullscreen.vs", "resources/shaders/post.fs");
+    blur_shader = backend->load_shader("resources/shaders/fullscreen.vs", "resources/shaders/blur.fs");
 #endif
 
-    ao_data = new uint8_t[sim->graphics.ao_blocks.size()];
-    base_tex = MultiTexture(GetScreenWidth() / DOWNSCALE_RATIO, GetScreenHeight() / DOWNSCALE_RATIO);
+    base_tex = MultiTexture(*backend, backend->screen_width() / DOWNSCALE_RATIO, backend->screen_height() / DOWNSCALE_RATIO);
 
-    const unsigned int blur_width = GetScreenWidth() / BLUR_DOWNSCALE_RATIO;
-    const unsigned int blur_height = GetScreenHeight() / BLUR_DOWNSCALE_RATIO;
-    blur1_tex = util::load_render_texture_only_color(blur_width, blur_height, RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
-    blur2_tex = util::load_render_texture_only_color(blur_width, blur_height, RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
-    blur_tmp_tex = util::load_render_texture_only_color(blur_width, blur_height, RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    const unsigned int blur_width = backend->screen_width() / BLUR_DOWNSCALE_RATIO;
+    const unsigned int blur_height = backend->screen_height() / BLUR_DOWNSCALE_RATIO;
+    blur1_tex = _load_render_texture_only_color(blur_width, blur_height, RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    blur2_tex = _load_render_texture_only_color(blur_width, blur_height, RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+    blur_tmp_tex = _load_render_texture_only_color(blur_width, blur_height, RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
 
-    rlTextureParameters(blur_tmp_tex.texture.id, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_MIRROR_REPEAT);
-    rlTextureParameters(blur_tmp_tex.texture.id, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_MIRROR_REPEAT);
+    backend->texture_parameters(blur_tmp_tex.texture.id, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_MIRROR_REPEAT);
+    backend->texture_parameters(blur_tmp_tex.texture.id, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_MIRROR_REPEAT);
 
-    rlEnableShader(part_shader.id);
-        rlSetUniformSampler(rlGetLocationUniform(part_shader.id, "FragColor"), 0);
-        rlSetUniformSampler(rlGetLocationUniform(part_shader.id, "FragGlowOnly"), 1);
-        rlSetUniformSampler(rlGetLocationUniform(part_shader.id, "FragBlurOnly"), 2);
-    rlDisableShader();
+    backend->enable_shader(part_shader.id);
+        backend->set_uniform_sampler(backend->get_location_uniform(part_shader.id, "FragColor"), 0);
+        backend->set_uniform_sampler(backend->get_location_uniform(part_shader.id, "FragGlowOnly"), 1);
+        backend->set_uniform_sampler(backend->get_location_uniform(part_shader.id, "FragBlurOnly"), 2);
+    backend->disable_shader();
 
     // Uniform values that may change per frame
-    part_shader_res_loc = GetShaderLocation(part_shader, "resolution");
-    part_shader_camera_pos_loc = GetShaderLocation(part_shader, "cameraPos");
-    part_shader_camera_dir_loc = GetShaderLocation(part_shader, "cameraDir");
-    part_shader_uv1_loc = GetShaderLocation(part_shader, "uv1");
-    part_shader_uv2_loc = GetShaderLocation(part_shader, "uv2");
-
-    post_shader_base_texture_loc = GetShaderLocation(post_shader, "baseTexture");
-    post_shader_glow_texture_loc = GetShaderLocation(post_shader, "glowTexture");
-    post_shader_blur_texture_loc = GetShaderLocation(post_shader, "blurTexture");
-    post_shader_depth_texture_loc = GetShaderLocation(post_shader, "depthTexture");
-    post_shader_res_loc = GetShaderLocation(post_shader, "resolution");
-
-    blur_shader_base_texture_loc = GetShaderLocation(blur_shader, "baseTexture");
-    blur_shader_res_loc = GetShaderLocation(blur_shader, "resolution");
-    blur_shader_dir_loc = GetShaderLocation(blur_shader, "direction");
-
-    // SSBOs for color & octree LOD data
-    for (auto i = 0; i < BUFFER_COUNT; i++) {
-        ssbo_colors[i] = rlLoadShaderBuffer(XRES * YRES * ZRES * sizeof(uint32_t), NULL, RL_DYNAMIC_COPY);
-        ssbo_flags[i]  = rlLoadShaderBuffer(XRES * YRES * ZRES * sizeof(uint8_t), NULL, RL_DYNAMIC_COPY);
-        ssbo_lod[i]    = rlLoadShaderBuffer(sizeof(uint8_t) *  OctreeBlockMetadata::size * X_BLOCKS * Y_BLOCKS * Z_BLOCKS,
-            NULL, RL_DYNAMIC_COPY);
-    }
+    part_shader_res_loc = backend->get_shader_location(part_shader, "resolution");
+    part_shader_camera_pos_loc = backend->get_shader_location(part_shader, "cameraPos");
+    part_shader_camera_dir_loc = backend->get_shader_location(part_shader, "cameraDir");
+    part_shader_uv1_loc = backend->get_shader_location(part_shader, "uv1");
+    part_shader_uv2_loc = backend->get_shader_location(part_shader, "uv2");
+
+    post_shader_base_texture_loc = backend->get_shader_location(post_shader, "baseTexture");
+    post_shader_glow_texture_loc = backend->get_shader_location(post_shader, "glowTexture");
+    post_shader_blur_texture_loc = backend->get_shader_location(post_shader, "blurTexture");
+    post_shader_depth_texture_loc = backend->get_shader_location(post_shader, "depthTexture");
+    post_shader_res_loc = backend->get_shader_location(post_shader, "resolution");
+
+    blur_shader_base_texture_loc = backend->get_shader_location(blur_shader, "baseTexture");
+    blur_shader_res_loc = backend->get_shader_location(blur_shader, "resolution");
+    blur_shader_dir_loc = backend->get_shader_location(blur_shader, "direction");
+
+    // SSBOs for color & octree LOD data (zero filled)
+    ssbo_colors = backend->load_shader_buffer(XRES * YRES * ZRES * sizeof(uint32_t), NULL, RL_DYNAMIC_COPY);
+    ssbo_flags  = backend->load_shader_buffer(XRES * YRES * ZRES * sizeof(uint8_t), NULL, RL_DYNAMIC_COPY);
+    ssbo_lod    = backend->load_shader_buffer(sizeof(uint8_t) *  OctreeBlockMetadata::size * X_BLOCKS * Y_BLOCKS * Z_BLOCKS,
+        NULL, RL_DYNAMIC_COPY);
 
     // Ambient occlusion texture, uses texture for free linear filtering
-    glGenTextures(BUFFER_COUNT, ao_tex);
-    for (auto i = 0; i < BUFFER_COUNT; i++) {
-        glBindTexture(GL_TEXTURE_3D, ao_tex[i]);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_RED, AO_X_BLOCKS, AO_Y_BLOCKS, AO_Z_BLOCKS, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-    }
+    ao_tex = backend->gen_texture();
+    backend->bind_texture(GL_TEXTURE_3D, ao_tex);
+    backend->tex_parameter(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    backend->tex_parameter(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    backend->tex_image_3d(GL_TEXTURE_3D, GL_RED, AO_X_BLOCKS, AO_Y_BLOCKS, AO_Z_BLOCKS, NULL);
 
     // Shadow texture
-    glGenTextures(BUFFER_COUNT, shadow_tex);
-    for (auto i = 0; i < BUFFER_COUNT; i++) {
-        glBindTexture(GL_TEXTURE_2D, shadow_tex[i]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SHADOW_MAP_X, SHADOW_MAP_Y, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-    }
+    shadow_tex = backend->gen_texture();
+    backend->bind_texture(GL_TEXTURE_2D, shadow_tex);
+    backend->tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    backend->tex_parameter(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    backend->tex_image_2d(GL_TEXTURE_2D, GL_RED, SHADOW_MAP_X, SHADOW_MAP_Y, NULL);
+
+    upload_backend = std::make_unique<StagingUploadBackend>(*backend, ssbo_colors, ssbo_flags, ssbo_lod, ao_tex, shadow_tex);
 
     // Uniform constants
     {
@@ -115,10 +110,10 @@ void Renderer::init() {
         if (cam->camera.fovy == 0.0)
             throw std::invalid_argument("Render camera fov should not be 0 (renderer should be initialized AFTER the camera)");
     #endif
-        glGenBuffers(1, &ubo_constants);
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo_constants);
-        UBOWriter constants_writer(part_shader.id, ubo_constants, "Constants");
-        glBufferData(GL_UNIFORM_BUFFER, constants_writer.size(), NULL, GL_STATIC_DRAW);
+        ubo_constants = backend->gen_buffer();
+        backend->bind_buffer(GL_UNIFORM_BUFFER, ubo_constants);
+        UBOWriter constants_writer(*backend, part_shader.id, ubo_constants, "Constants");
+        backend->buffer_data(GL_UNIFORM_BUFFER, constants_writer.size(), NULL, GL_STATIC_DRAW);
 
         float SIMRES[] = { (float)XRES, (float)YRES, (float)ZRES };
         int32_t OCTTREE_BLOCK_DIMS[3] = { X_BLOCKS, Y_BLOCKS, Z_BLOCKS };
@@ -141,10 +136,10 @@ void Renderer::init() {
 
     // UBO: settings
     {
-        glGenBuffers(1, &ubo_settings);
-        glBindBuffer(GL_UNIFORM_BUFFER, ubo_settings);
-        UBOWriter settings_writer(part_shader.id, ubo_settings, "Settings");
-        glBufferData(GL_UNIFORM_BUFFER, settings_writer.size(), NULL, GL_STATIC_DRAW);
+        ubo_settings = backend->gen_buffer();
+        backend->bind_buffer(GL_UNIFORM_BUFFER, ubo_settings);
+        UBOWriter settings_writer(*backend, part_shader.id, ubo_settings, "Settings");
+        backend->buffer_data(GL_UNIFORM_BUFFER, settings_writer.size(), NULL, GL_STATIC_DRAW);
 
         float BG_COLOR[] = { BACKGROUND_COLOR.r / 255.0f, BACKGROUND_COLOR.g / 255.0f, BACKGROUND_COLOR.b / 255.0f };
         float SH_COLOR[] = { SHADOW_COLOR.r / 255.0f, SHADOW_COLOR.g / 255.0f, SHADOW_COLOR.b / 255.0f };
@@ -167,51 +162,10 @@ void Renderer::init() {
 }
 
 void Renderer::update_colors_and_lod() {
-    const unsigned int ssbo_idx = (frame_count + 1) % BUFFER_COUNT;
-    const unsigned int ssbo_bit = 1 << ssbo_idx;
-
-    for (std::size_t i = 0; i < COLOR_DATA_CHUNK_COUNT; i++) {
-        if (sim->graphics.color_data_modified[i] & ssbo_bit) {
-            // Since the chunks might overestimate actual color count
-            // on last one take # of colors - last chunk boundary
-            const auto chunk_len = (i == COLOR_DATA_CHUNK_COUNT - 1) ?
-                sim->graphics.color_data.size() - i * COLOR_DATA_CHUNK_SIZE :
-                COLOR_DATA_CHUNK_SIZE;
-
-            rlUpdateShaderBuffer(ssbo_colors[ssbo_idx],
-                &sim->graphics.color_data[i * COLOR_DATA_CHUNK_SIZE],
-                chunk_len * sizeof(uint32_t),
-                i * COLOR_DATA_CHUNK_SIZE * sizeof(uint32_t));
-            rlUpdateShaderBuffer(ssbo_flags[ssbo_idx],
-                &sim->graphics.color_flags[i * COLOR_DATA_CHUNK_SIZE],
-                chunk_len * sizeof(uint8_t),
-                i * COLOR_DATA_CHUNK_SIZE * sizeof(uint8_t));
-
-            sim->graphics.color_data_modified[i] &= ~ssbo_bit;
-        }
-    }
-
-    for (std::size_t i = 0; i < sim->graphics.octree_blocks.size(); i++) {
-        if (sim->graphics.octree_blocks[i].modified & ssbo_bit) {
-            // We do not upload the whole octree here, we upload all layers except
-            // the last layer, since the last layer only stores info about the 1x1x1 voxel
-            // data which we already have in the form of color_data
-            rlUpdateShaderBuffer(ssbo_lod[ssbo_idx], sim->graphics.octree_blocks[i].data,
-                sizeof(uint8_t) * OctreeBlockMetadata::layer_offsets[OCTREE_BLOCK_DEPTH - 1],
-                i * sizeof(uint8_t) * OctreeBlockMetadata::layer_offsets[OCTREE_BLOCK_DEPTH - 1]);
-            sim->graphics.octree_blocks[i].modified &= ~ssbo_bit;
-        }
-    }
-
-    glBindTexture(GL_TEXTURE_3D, ao_tex[ssbo_idx]);
-    constexpr unsigned int AO_VOLUME = AO_BLOCK_SIZE * AO_BLOCK_SIZE * AO_BLOCK_SIZE;
-    #pragma omp simd
-    for (int i = 0; i < sim->graphics.ao_blocks.size(); i++)
-        ao_data[i] = 255 * sim->graphics.ao_blocks[i] / AO_VOLUME;
-    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, AO_X_BLOCKS, AO_Y_BLOCKS, AO_Z_BLOCKS, GL_RED, GL_UNSIGNED_BYTE, ao_data);
-
-    glBindTexture(GL_TEXTURE_2D, shadow_tex[ssbo_idx]);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SHADOW_MAP_X, SHADOW_MAP_Y, GL_RED, GL_UNSIGNED_BYTE, sim->graphics.shadow_map);
+    PROFILE_ZONE("Renderer::update_colors_and_lod");
+    // Only what changed since last frame. The copies run on the GPU after the
+    // last frame's draws, so they can't change what those see
+    uploader.upload(sim->graphics, *upload_backend);
 }
 
 void Renderer::draw_octree_debug() {
@@ -233,7 +187,7 @@ void Renderer::draw_octree_debug() {
                 float trueZ = static_cast<float>((dz << layer) + blockZ * OCTREE_BLOCK_DIM);
                 int size = 1 << layer;
 
-                DrawCubeWires(
+                backend->draw_cube_wires(
                     Vector3{ trueX + size / 2, trueY + size / 2, trueZ + size / 2 },
                     size, size, size, Color{255, 255, 255, 50}
                 );
@@ -243,13 +197,14 @@ void Renderer::draw_octree_debug() {
 }
 
 void Renderer::draw() {
+    PROFILE_ZONE("Renderer::draw");
     update_colors_and_lod();
     // draw_octree_debug();
 
 #pragma region uniforms
-    const Vector2 resolution{ (float)GetScreenWidth(), (float)GetScreenHeight() };
-    const Vector2 virtual_resolution{ (float)GetScreenWidth() / DOWNSCALE_RATIO, (float)GetScreenHeight() / DOWNSCALE_RATIO };
-    const Vector2 blur_resolution{ (float)GetScreenWidth() / BLUR_DOWNSCALE_RATIO, (float)GetScreenHeight() / BLUR_DOWNSCALE_RATIO };
+    const Vector2 resolution{ (float)backend->screen_width(), (float)backend->screen_height() };
+    const Vector2 virtual_resolution{ resolution.x / DOWNSCALE_RATIO, resolution.y / DOWNSCALE_RATIO };
+    const Vector2 blur_resolution{ resolution.x / BLUR_DOWNSCALE_RATIO, resolution.y / BLUR_DOWNSCALE_RATIO };
 
     // Inverse camera rotation matrix
     auto transform_mat = MatrixLookAt(cam->camera.position, cam->camera.target, cam->camera.up);
@@ -267,58 +222,56 @@ void Renderer::draw() {
 
     // First actual pass
     // --------------------------------------
-    const unsigned int ssbo_idx = frame_count % BUFFER_COUNT;
-    rlBindShaderBuffer(ssbo_colors[ssbo_idx], 0);
-    rlBindShaderBuffer(ssbo_flags[ssbo_idx], 1);
-    rlBindShaderBuffer(ssbo_lod[ssbo_idx], 2);
+    backend->bind_shader_buffer(ssbo_colors, 0);
+    backend->bind_shader_buffer(ssbo_flags, 1);
+    backend->bind_shader_buffer(ssbo_lod, 2);
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_3D, ao_tex[ssbo_idx]);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, shadow_tex[ssbo_idx]);
+    backend->active_texture(GL_TEXTURE3);
+    backend->bind_texture(GL_TEXTURE_3D, ao_tex);
+    backend->active_texture(GL_TEXTURE4);
+    backend->bind_texture(GL_TEXTURE_2D, shadow_tex);
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, 5, ubo_constants);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 6, ubo_settings);
+    backend->bind_buffer_base(GL_UNIFORM_BUFFER, 5, ubo_constants);
+    backend->bind_buffer_base(GL_UNIFORM_BUFFER, 6, ubo_settings);
 
     // First render everything to FBO
     // which contains multiple textures for glow, blur, base, depth, etc...
-    rlEnableFramebuffer(base_tex.frameBuffer);
-    rlClearScreenBuffers();
-    BeginMode3D(cam->camera);
-    BeginShaderMode(part_shader);
-
-        util::set_shader_value(part_shader, part_shader_res_loc, virtual_resolution);
-        util::set_shader_value(part_shader, part_shader_camera_pos_loc, cam->camera.position);
-        util::set_shader_value(part_shader, part_shader_camera_dir_loc, look_ray);
-        util::set_shader_value(part_shader, part_shader_uv1_loc, uv1);
-        util::set_shader_value(part_shader, part_shader_uv2_loc, uv2);
-        util::draw_dummy_triangle();
-
-    EndShaderMode();
-    EndMode3D();
-    rlDisableFramebuffer();
+    backend->enable_framebuffer(base_tex.frameBuffer);
+    backend->clear_screen_buffers();
+    backend->begin_mode_3d(cam->camera);
+    backend->begin_shader_mode(part_shader);
+
+        backend->set_shader_value(part_shader, part_shader_res_loc, virtual_resolution);
+        backend->set_shader_value(part_shader, part_shader_camera_pos_loc, cam->camera.position);
+        backend->set_shader_value(part_shader, part_shader_camera_dir_loc, look_ray);
+        backend->set_shader_value(part_shader, part_shader_uv1_loc, uv1);
+        backend->set_shader_value(part_shader, part_shader_uv2_loc, uv2);
+        backend->draw_dummy_triangle();
+
+    backend->end_shader_mode();
+    backend->end_mode_3d();
+    backend->disable_framebuffer();
 
     _blur_render_texture(base_tex.glowOnlyTexture, blur_resolution, blur1_tex);
     _blur_render_texture(base_tex.blurOnlyTexture, blur_resolution, blur2_tex);
 
     // Render the above textures with a post-processing shader for compositing
-    BeginMode3D(cam->camera);
-    BeginShaderMode(post_shader);
-
-        rlEnableShader(post_shader.id);
-        rlSetUniformSampler(post_shader_base_texture_loc, base_tex.colorTexture);
-        rlSetUniformSampler(post_shader_glow_texture_loc, blur1_tex.texture.id);
-        rlSetUniformSampler(post_shader_blur_texture_loc, blur2_tex.texture.id);
-        rlSetUniformSampler(post_shader_depth_texture_loc, base_tex.depthTexture);
-        util::set_shader_value(post_shader, post_shader_res_loc, resolution);
-
-        util::draw_dummy_triangle();
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-    EndShaderMode();
-    EndMode3D();
-
-    frame_count++;
+    backend->begin_mode_3d(cam->camera);
+    backend->begin_shader_mode(post_shader);
+
+        backend->enable_shader(post_shader.id);
+        backend->set_uniform_sampler(post_shader_base_texture_loc, base_tex.colorTexture);
+        backend->set_uniform_sampler(post_shader_glow_texture_loc, blur1_tex.texture.id);
+        backend->set_uniform_sampler(post_shader_blur_texture_loc, blur2_tex.texture.id);
+        backend->set_uniform_sampler(post_shader_depth_texture_loc, base_tex.depthTexture);
+        backend->set_shader_value(post_shader, post_shader_res_loc, resolution);
+
+        backend->draw_dummy_triangle();
+        backend->bind_texture(GL_TEXTURE_2D, 0);
+
+    backend->end_shader_mode();
+    backend->end_mode_3d();
+    backend->end_frame();
 }
 
 
@@ -330,17 +283,43 @@ void Renderer::draw() {
  * @param blur_tex Output texture blurred image is written to
  */
 void Renderer::_blur_render_texture(unsigned int textureInId, const Vector2 resolution, RenderTexture2D &blur_tex) {
-    BeginShaderMode(blur_shader);
-    util::set_shader_value(blur_shader, blur_shader_res_loc, resolution);
+    backend->begin_shader_mode(blur_shader);
+    backend->set_shader_value(blur_shader, blur_shader_res_loc, resolution);
 
     // Split into 2 passes: horizontal and vertical
     for (int i = 0; i < 2; i++) {
-        BeginTextureMode(i == 0 ? blur_tmp_tex : blur_tex);
-            ClearBackground(Color{0, 0, 0, 0});
-            util::set_shader_value(blur_shader, blur_shader_dir_loc, Vector2{ float(i), float(1 - i) });
-            rlSetUniformSampler(blur_shader_base_texture_loc, i == 0 ? textureInId : blur_tmp_tex.texture.id);
-            util::draw_dummy_triangle();
-        EndTextureMode();
+        backend->begin_texture_mode(i == 0 ? blur_tmp_tex : blur_tex);
+            backend->clear_background(Color{0, 0, 0, 0});
+            backend->set_shader_value(blur_shader, blur_shader_dir_loc, Vector2{ float(i), float(1 - i) });
+            backend->set_uniform_sampler(blur_shader_base_texture_loc, i == 0 ? textureInId : blur_tmp_tex.texture.id);
+            backend->draw_dummy_triangle();
+        backend->end_texture_mode();
+    }
+    backend->end_shader_mode();
+}
+
+/**
+ * @brief Like raylib's LoadRenderTexture, but without a depth attachment
+ */
+RenderTexture2D Renderer::_load_render_texture_only_color(int width, int height, int format) {
+    RenderTexture2D target = { 0 };
+    target.id = backend->load_framebuffer();
+
+    if (target.id > 0) {
+        backend->enable_framebuffer(target.id);
+
+        target.texture.id = backend->load_texture(NULL, width, height, format, 1);
+        target.texture.width = width;
+        target.texture.height = height;
+        target.texture.format = format;
+        target.texture.mipmaps = 1;
+
+        backend->framebuffer_attach(target.id, target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+        if (!backend->framebuffer_complete(target.id))
+            TRACELOG(LOG_WARNING, "FBO: [ID %i] Framebuffer object is not complete", target.id);
+
+        backend->disable_framebuffer();
     }
-    EndShaderMode();
+    else TRACELOG(LOG_WARNING, "FBO: Framebuffer object can not be created");
+    return target;
 }
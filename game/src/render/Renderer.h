@@ -7,12 +7,16 @@
 
 #include "types/multitexture.h"
 #include "types/octree.h"
+#include "types/voxel_uploader.h"
+#include "types/staging_upload_backend.h"
+#include "types/render_backend.h"
+
+#include <memory>
 
 #define EMBED_SHADERS
 
 constexpr float DOWNSCALE_RATIO = 1.5f;
 constexpr float BLUR_DOWNSCALE_RATIO = 1.5f;
-constexpr unsigned int BUFFER_COUNT = 8; // Must be < 8 because modified bitset is 1 byte
 constexpr Color BACKGROUND_COLOR{ 0, 0, 0, 255 };
 constexpr Color SHADOW_COLOR{ 32, 18, 39, 255 };
 
@@ -20,16 +24,21 @@ class Simulation;
 class RenderCamera;
 class Renderer {
 public:
-    Renderer(Simulation * sim, RenderCamera * cam): sim(sim), cam(cam), ao_data(nullptr) {}
+    // backend makes all GL calls, GLRenderBackend or one without a GPU (see RecordingRenderBackend)
+    Renderer(Simulation * sim, RenderCamera * cam, RenderBackend * backend): sim(sim), cam(cam), backend(backend) {}
     ~Renderer();
 
     void init(); // Call after openGL context has been initialized
     void update_colors_and_lod();
     void draw();
     void draw_octree_debug();
+
+    // What the last update_colors_and_lod sent to the GPU
+    const UploadStats &upload_stats() const { return uploader.stats(); }
 private:
     Simulation * sim;
     RenderCamera * cam;
+    RenderBackend * backend;
 
     Shader part_shader, post_shader, blur_shader;
     int part_shader_res_loc,
@@ -46,14 +55,15 @@ private:
         blur_shader_res_loc,
         blur_shader_dir_loc;
 
-    GLuint ao_tex[BUFFER_COUNT], shadow_tex[BUFFER_COUNT];
-    unsigned int ssbo_colors[BUFFER_COUNT], ssbo_flags[BUFFER_COUNT], ssbo_lod[BUFFER_COUNT];
+    // Single copy of each, updated in place by uploader, see VoxelUploader
+    unsigned int ao_tex, shadow_tex;
+    unsigned int ssbo_colors, ssbo_flags, ssbo_lod;
     unsigned int ubo_constants, ubo_settings;
-    uint8_t * ao_data;
+    VoxelUploader uploader;
+    std::unique_ptr<StagingUploadBackend> upload_backend;
 
     RenderTexture2D blur1_tex, blur2_tex, blur_tmp_tex;
     MultiTexture base_tex;
-    unsigned int frame_count = 0;
 
     enum class FragDebugMode: uint32_t {
         NODEBUG = 0,
@@ -63,6 +73,7 @@ private:
     };
 
     void _blur_render_texture(unsigned int textureInId, const Vector2 resolution, RenderTexture2D &blur_tex);
+    RenderTexture2D _load_render_texture_only_color(int width, int height, int format);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "gl_render_backend.h"
+#include "../../util/graphics.h"
+
+#include "rlgl.h"
+#include <glad.h>
+
+int GLRenderBackend::screen_width() { return GetScreenWidth(); }
+int GLRenderBackend::screen_height() { return GetScreenHeight(); }
+Shader GLRenderBackend::load_shader(const char * vs_path, const char * fs_path) { return LoadShader(vs_path, fs_path); }
+Shader GLRenderBackend::load_shader_from_memory(const char * vs_code, const char * fs_code) { return LoadShaderFromMemory(vs_code, fs_code); }
+void GLRenderBackend::unload_shader(Shader shader) { UnloadShader(shader); }
+int GLRenderBackend::get_shader_location(Shader shader, const char * name) { return GetShaderLocation(shader, name); }
+void GLRenderBackend::set_shader_value(Shader shader, int loc, const void * value, int uniform_type) {
+    SetShaderValue(shader, loc, value, uniform_type);
+}
+void GLRenderBackend::begin_mode_3d(Camera3D camera) { BeginMode3D(camera); }
+void GLRenderBackend::end_mode_3d() { EndMode3D(); }
+void GLRenderBackend::begin_shader_mode(Shader shader) { BeginShaderMode(shader); }
+void GLRenderBackend::end_shader_mode() { EndShaderMode(); }
+void GLRenderBackend::begin_texture_mode(RenderTexture2D target) { BeginTextureMode(target); }
+void GLRenderBackend::end_texture_mode() { EndTextureMode(); }
+void GLRenderBackend::clear_background(Color color) { ClearBackground(color); }
+void GLRenderBackend::unload_render_texture(RenderTexture2D target) { UnloadRenderTexture(target); }
+void GLRenderBackend::draw_cube_wires(Vector3 position, float width, float height, float length, Color color) {
+    DrawCubeWires(position, width, height, length, color);
+}
+
+unsigned int GLRenderBackend::load_framebuffer() { return rlLoadFramebuffer(); }
+void GLRenderBackend::enable_framebuffer(unsigned int id) { rlEnableFramebuffer(id); }
+void GLRenderBackend::disable_framebuffer() { rlDisableFramebuffer(); }
+bool GLRenderBackend::framebuffer_complete(unsigned int id) { return rlFramebufferComplete(id); }
+void GLRenderBackend::framebuffer_attach(unsigned int framebuffer, unsigned int texture, int attach_type, int texture_type, int mip_level) {
+    rlFramebufferAttach(framebuffer, texture, attach_type, texture_type, mip_level);
+}
+void GLRenderBackend::unload_framebuffer(unsigned int id) { rlUnloadFramebuffer(id); }
+void GLRenderBackend::active_draw_buffers(int count) { rlActiveDrawBuffers(count); }
+unsigned int GLRenderBackend::load_texture(const void * data, int width, int height, int format, int mipmaps) {
+    return rlLoadTexture(data, width, height, format, mipmaps);
+}
+unsigned int GLRenderBackend::load_texture_depth(int width, int height, bool use_render_buffer) {
+    return rlLoadTextureDepth(width, height, use_render_buffer);
+}
+void GLRenderBackend::unload_texture(unsigned int id) { rlUnloadTexture(id); }
+void GLRenderBackend::texture_parameters(unsigned int id, int param, int value) { rlTextureParameters(id, param, value); }
+void GLRenderBackend::clear_screen_buffers() { rlClearScreenBuffers(); }
+void GLRenderBackend::enable_shader(unsigned int id) { rlEnableShader(id); }
+void GLRenderBackend::disable_shader() { rlDisableShader(); }
+int GLRenderBackend::get_location_uniform(unsigned int shader, const char * name) { return rlGetLocationUniform(shader, name); }
+void GLRenderBackend::set_uniform_sampler(int loc, unsigned int texture) { rlSetUniformSampler(loc, texture); }
+unsigned int GLRenderBackend::load_shader_buffer(unsigned int size, const void * data, int usage) {
+    return rlLoadShaderBuffer(size, data, usage);
+}
+void GLRenderBackend::bind_shader_buffer(unsigned int id, unsigned int index) { rlBindShaderBuffer(id, index); }
+void GLRenderBackend::draw_dummy_triangle() { util::draw_dummy_triangle(); }
+
+unsigned int GLRenderBackend::gen_buffer() {
+    GLuint id = 0;
+    glGenBuffers(1, &id);
+    return id;
+}
+void GLRenderBackend::delete_buffer(unsigned int id) { glDeleteBuffers(1, &id); }
+void GLRenderBackend::bind_buffer(unsigned int target, unsigned int id) { glBindBuffer(target, id); }
+void GLRenderBackend::bind_buffer_base(unsigned int target, unsigned int index, unsigned int id) { glBindBufferBase(target, index, id); }
+void GLRenderBackend::buffer_data(unsigned int target, std::size_t size, const void * data, unsigned int usage) {
+    glBufferData(target, size, data, usage);
+}
+void GLRenderBackend::buffer_sub_data(unsigned int target, std::size_t offset, std::size_t size, const void * data) {
+    glBufferSubData(target, offset, size, data);
+}
+void * GLRenderBackend::map_buffer_range(unsigned int target, std::size_t offset, std::size_t size, unsigned int access) {
+    return glMapBufferRange(target, offset, size, access);
+}
+void GLRenderBackend::unmap_buffer(unsigned int target) { glUnmapBuffer(target); }
+void GLRenderBackend::copy_buffer_sub_data(unsigned int read_target, unsigned int write_target,
+        std::size_t read_offset, std::size_t write_offset, std::size_t size) {
+    glCopyBufferSubData(read_target, write_target, read_offset, write_offset, size);
+}
+
+unsigned int GLRenderBackend::gen_texture() {
+    GLuint id = 0;
+    glGenTextures(1, &id);
+    return id;
+}
+void GLRenderBackend::delete_texture(unsigned int id) { glDeleteTextures(1, &id); }
+void GLRenderBackend::active_texture(unsigned int unit) { glActiveTexture(unit); }
+void GLRenderBackend::bind_texture(unsigned int target, unsigned int id) { glBindTexture(target, id); }
+void GLRenderBackend::tex_parameter(unsigned int target, unsigned int param, int value) { glTexParameteri(target, param, value); }
+void GLRenderBackend::tex_image_2d(unsigned int target, int format, int width, int height, const void * data) {
+    glTexImage2D(target, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+}
+void GLRenderBackend::tex_image_3d(unsigned int target, int format, int width, int height, int depth, const void * data) {
+    glTexImage3D(target, 0, format, width, height, depth, 0, format, GL_UNSIGNED_BYTE, data);
+}
+void GLRenderBackend::tex_sub_image_2d(unsigned int target, int format, int width, int height, const void * data) {
+    glTexSubImage2D(target, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+}
+void GLRenderBackend::tex_sub_image_3d(unsigned int target, int format, int width, int height, int depth, const void * data) {
+    glTexSubImage3D(target, 0, 0, 0, 0, width, height, depth, format, GL_UNSIGNED_BYTE, data);
+}
+
+int GLRenderBackend::uniform_block_size(unsigned int program, const char * block) {
+    const GLuint index = glGetUniformBlockIndex(program, block);
+    GLint size = 0;
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+    return size;
+}
+
+unsigned int GLRenderBackend::uniform_offset(unsigned int program, const char * member) {
+    const auto index = glGetProgramResourceIndex(program, GL_UNIFORM, member);
+    const GLenum prop = GL_OFFSET;
+    GLint offset = 0;
+    glGetProgramResourceiv(program, GL_UNIFORM, index, 1, &prop, 1, NULL, &offset);
+    return offset;
+}
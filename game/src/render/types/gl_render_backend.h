@@ -0,0 +1,76 @@
+#ifndef RENDER_GL_RENDER_BACKEND_H
+#define RENDER_GL_RENDER_BACKEND_H
+
+#include "render_backend.h"
+
+/**
+ * @brief RenderBackend that makes the actual raylib / rlgl / GL calls.
+ *        Needs a GL 4.3 context
+ */
+class GLRenderBackend: public RenderBackend {
+public:
+    using RenderBackend::set_shader_value;
+
+    int screen_width() override;
+    int screen_height() override;
+    Shader load_shader(const char * vs_path, const char * fs_path) override;
+    Shader load_shader_from_memory(const char * vs_code, const char * fs_code) override;
+    void unload_shader(Shader shader) override;
+    int get_shader_location(Shader shader, const char * name) override;
+    void set_shader_value(Shader shader, int loc, const void * value, int uniform_type) override;
+    void begin_mode_3d(Camera3D camera) override;
+    void end_mode_3d() override;
+    void begin_shader_mode(Shader shader) override;
+    void end_shader_mode() override;
+    void begin_texture_mode(RenderTexture2D target) override;
+    void end_texture_mode() override;
+    void clear_background(Color color) override;
+    void unload_render_texture(RenderTexture2D target) override;
+    void draw_cube_wires(Vector3 position, float width, float height, float length, Color color) override;
+
+    unsigned int load_framebuffer() override;
+    void enable_framebuffer(unsigned int id) override;
+    void disable_framebuffer() override;
+    bool framebuffer_complete(unsigned int id) override;
+    void framebuffer_attach(unsigned int framebuffer, unsigned int texture, int attach_type, int texture_type, int mip_level) override;
+    void unload_framebuffer(unsigned int id) override;
+    void active_draw_buffers(int count) override;
+    unsigned int load_texture(const void * data, int width, int height, int format, int mipmaps) override;
+    unsigned int load_texture_depth(int width, int height, bool use_render_buffer) override;
+    void unload_texture(unsigned int id) override;
+    void texture_parameters(unsigned int id, int param, int value) override;
+    void clear_screen_buffers() override;
+    void enable_shader(unsigned int id) override;
+    void disable_shader() override;
+    int get_location_uniform(unsigned int shader, const char * name) override;
+    void set_uniform_sampler(int loc, unsigned int texture) override;
+    unsigned int load_shader_buffer(unsigned int size, const void * data, int usage) override;
+    void bind_shader_buffer(unsigned int id, unsigned int index) override;
+    void draw_dummy_triangle() override;
+
+    unsigned int gen_buffer() override;
+    void delete_buffer(unsigned int id) override;
+    void bind_buffer(unsigned int target, unsigned int id) override;
+    void bind_buffer_base(unsigned int target, unsigned int index, unsigned int id) override;
+    void buffer_data(unsigned int target, std::size_t size, const void * data, unsigned int usage) override;
+    void buffer_sub_data(unsigned int target, std::size_t offset, std::size_t size, const void * data) override;
+    void * map_buffer_range(unsigned int target, std::size_t offset, std::size_t size, unsigned int access) override;
+    void unmap_buffer(unsigned int target) override;
+    void copy_buffer_sub_data(unsigned int read_target, unsigned int write_target,
+        std::size_t read_offset, std::size_t write_offset, std::size_t size) override;
+
+    unsigned int gen_texture() override;
+    void delete_texture(unsigned int id) override;
+    void active_texture(unsigned int unit) override;
+    void bind_texture(unsigned int target, unsigned int id) override;
+    void tex_parameter(unsigned int target, unsigned int param, int value) override;
+    void tex_image_2d(unsigned int target, int format, int width, int height, const void * data) override;
+    void tex_image_3d(unsigned int target, int format, int width, int height, int depth, const void * data) override;
+    void tex_sub_image_2d(unsigned int target, int format, int width, int height, const void * data) override;
+    void tex_sub_image_3d(unsigned int target, int format, int width, int height, int depth, const void * data) override;
+
+    int uniform_block_size(unsigned int program, const char * block) override;
+    unsigned int uniform_offset(unsigned int program, const char * member) override;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "memory_upload_backend.h"
+#include "voxel_uploader.h"
+
+#include <cstring>
+
+MemoryUploadBackend::MemoryUploadBackend() {
+    targets[static_cast<int>(UploadTarget::COLORS)].resize(XRES * YRES * ZRES * sizeof(uint32_t));
+    targets[static_cast<int>(UploadTarget::FLAGS)].resize(XRES * YRES * ZRES * sizeof(uint8_t));
+    targets[static_cast<int>(UploadTarget::LOD)].resize(OctreeBlockMetadata::lod_size * X_BLOCKS * Y_BLOCKS * Z_BLOCKS);
+    targets[static_cast<int>(UploadTarget::AO)].resize(AO_X_BLOCKS * AO_Y_BLOCKS * AO_Z_BLOCKS);
+    targets[static_cast<int>(UploadTarget::SHADOW)].resize(SHADOW_MAP_X * SHADOW_MAP_Y);
+}
+
+void * MemoryUploadBackend::map_staging(std::size_t size) {
+    if (fail_map)
+        return nullptr;
+    staging.assign(size, 0xCD); // Garbage, like fresh GL storage
+    mapped = true;
+    return staging.data();
+}
+
+void MemoryUploadBackend::upload_buffer(UploadTarget target, std::size_t offset, const void * data, std::size_t size) {
+    if (target == UploadTarget::AO || target == UploadTarget::SHADOW)
+        bad_call_count++;
+    else
+        _write(target, offset, data, size);
+}
+
+void MemoryUploadBackend::copy_staged(UploadTarget target, std::size_t staging_offset, std::size_t offset, std::size_t size) {
+    if (mapped || staging_offset + size > staging.size() || target == UploadTarget::AO || target == UploadTarget::SHADOW)
+        bad_call_count++;
+    else
+        _write(target, offset, staging.data() + staging_offset, size);
+}
+
+void MemoryUploadBackend::upload_texture(UploadTarget target, const void * data, std::size_t size) {
+    if ((target != UploadTarget::AO && target != UploadTarget::SHADOW) || size != targets[static_cast<int>(target)].size())
+        bad_call_count++;
+    else
+        _write(target, 0, data, size);
+}
+
+unsigned int MemoryUploadBackend::mismatched_targets(const SimulationGraphics &graphics) const {
+    const auto differs = [&](const UploadTarget target, const std::size_t offset, const void * data, const std::size_t size) {
+        return std::memcmp(targets[static_cast<int>(target)].data() + offset, data, size) != 0;
+    };
+    const std::size_t voxels = XRES * YRES * ZRES;
+
+    unsigned int out = 0;
+    if (differs(UploadTarget::COLORS, 0, &graphics.color_data[0], voxels * sizeof(uint32_t)))
+        out |= 1 << static_cast<int>(UploadTarget::COLORS);
+    if (differs(UploadTarget::FLAGS, 0, &graphics.color_flags[0], voxels * sizeof(uint8_t)))
+        out |= 1 << static_cast<int>(UploadTarget::FLAGS);
+    for (std::size_t i = 0; i < graphics.octree_blocks.size(); i++) {
+        if (differs(UploadTarget::LOD, i * OctreeBlockMetadata::lod_size, graphics.octree_blocks[i].data, OctreeBlockMetadata::lod_size)) {
+            out |= 1 << static_cast<int>(UploadTarget::LOD);
+            break;
+        }
+    }
+
+    const auto &ao = targets[static_cast<int>(UploadTarget::AO)];
+    for (std::size_t i = 0; i < ao.size(); i++) {
+        if (ao[i] != ao_texel(graphics.ao_blocks[i])) {
+            out |= 1 << static_cast<int>(UploadTarget::AO);
+            break;
+        }
+    }
+    if (differs(UploadTarget::SHADOW, 0, graphics.shadow_map, sizeof(graphics.shadow_map)))
+        out |= 1 << static_cast<int>(UploadTarget::SHADOW);
+    return out;
+}
+
+void MemoryUploadBackend::_write(UploadTarget target, std::size_t offset, const void * data, std::size_t size) {
+    auto &dest = targets[static_cast<int>(target)];
+    if (offset + size > dest.size()) {
+        bad_call_count++;
+        return;
+    }
+    std::memcpy(dest.data() + offset, data, size);
+}
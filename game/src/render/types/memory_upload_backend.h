@@ -0,0 +1,45 @@
+#ifndef RENDER_MEMORY_UPLOAD_BACKEND_H
+#define RENDER_MEMORY_UPLOAD_BACKEND_H
+
+#include "upload_backend.h"
+
+#include "stdint.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief UploadBackend on plain memory: applies the copies to CPU arrays
+ *        laid out like the GPU targets, so the result of VoxelUploader can
+ *        be compared against the simulation's own data (see tptbox-golden
+ *        --check-uploads). Bad calls (out of bounds, copying while the
+ *        staging buffer is mapped) are counted instead of applied
+ */
+class MemoryUploadBackend: public UploadBackend {
+public:
+    MemoryUploadBackend();
+
+    bool fail_map = false; // map_staging returns null, to check the upload_buffer fallback
+
+    void * map_staging(std::size_t size) override;
+    void unmap_staging() override { mapped = false; }
+    void upload_buffer(UploadTarget target, std::size_t offset, const void * data, std::size_t size) override;
+    void copy_staged(UploadTarget target, std::size_t staging_offset, std::size_t offset, std::size_t size) override;
+    void upload_texture(UploadTarget target, const void * data, std::size_t size) override;
+
+    /**
+     * @brief Compare every target against what graphics holds now
+     * @return Bit (1 << target) set for each target that differs
+     */
+    unsigned int mismatched_targets(const SimulationGraphics &graphics) const;
+    unsigned int bad_calls() const { return bad_call_count; }
+
+private:
+    std::vector<uint8_t> staging;
+    std::vector<uint8_t> targets[UPLOAD_TARGET_COUNT];
+    bool mapped = false;
+    unsigned int bad_call_count = 0;
+
+    void _write(UploadTarget target, std::size_t offset, const void * data, std::size_t size);
+};
+
+#endif
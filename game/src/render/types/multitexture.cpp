@@ -3,59 +3,59 @@
 #include <stdexcept>
 #include <iostream>
 
-MultiTexture::MultiTexture(const unsigned int screenWidth, const unsigned int screenHeight):
-        width(screenWidth), height(screenHeight), frameBuffer(0), colorTexture(0),
+MultiTexture::MultiTexture(RenderBackend &backend, const unsigned int screenWidth, const unsigned int screenHeight):
+        backend(&backend), width(screenWidth), height(screenHeight), frameBuffer(0), colorTexture(0),
         glowOnlyTexture(0), blurOnlyTexture(0), depthTexture(0) {
-    frameBuffer = rlLoadFramebuffer();
+    frameBuffer = backend.load_framebuffer();
 
 #ifdef DEBUG
     if (!frameBuffer)
         throw std::runtime_error("Failed to create framebuffer");
 #endif
 
-    rlEnableFramebuffer(frameBuffer);
+    backend.enable_framebuffer(frameBuffer);
 
     // Color renders, RGBA
     const auto format = RL_PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
-    colorTexture    = rlLoadTexture(NULL, screenWidth, screenHeight, format, 1);
-    glowOnlyTexture = rlLoadTexture(NULL, screenWidth, screenHeight, format, 1);
-    blurOnlyTexture = rlLoadTexture(NULL, screenWidth, screenHeight, format, 1);
+    colorTexture    = backend.load_texture(NULL, screenWidth, screenHeight, format, 1);
+    glowOnlyTexture = backend.load_texture(NULL, screenWidth, screenHeight, format, 1);
+    blurOnlyTexture = backend.load_texture(NULL, screenWidth, screenHeight, format, 1);
 
-    rlTextureParameters(colorTexture, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_MIRROR_REPEAT);
-    rlTextureParameters(colorTexture, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_MIRROR_REPEAT);
-    rlTextureParameters(glowOnlyTexture, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_MIRROR_REPEAT);
-    rlTextureParameters(glowOnlyTexture, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_MIRROR_REPEAT);
-    rlTextureParameters(blurOnlyTexture, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_MIRROR_REPEAT);
-    rlTextureParameters(blurOnlyTexture, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_MIRROR_REPEAT);
+    backend.texture_parameters(colorTexture, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_MIRROR_REPEAT);
+    backend.texture_parameters(colorTexture, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_MIRROR_REPEAT);
+    backend.texture_parameters(glowOnlyTexture, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_MIRROR_REPEAT);
+    backend.texture_parameters(glowOnlyTexture, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_MIRROR_REPEAT);
+    backend.texture_parameters(blurOnlyTexture, RL_TEXTURE_WRAP_S, RL_TEXTURE_WRAP_MIRROR_REPEAT);
+    backend.texture_parameters(blurOnlyTexture, RL_TEXTURE_WRAP_T, RL_TEXTURE_WRAP_MIRROR_REPEAT);
 
-    rlActiveDrawBuffers(3);
-    rlFramebufferAttach(frameBuffer, colorTexture, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
-    rlFramebufferAttach(frameBuffer, glowOnlyTexture, RL_ATTACHMENT_COLOR_CHANNEL1, RL_ATTACHMENT_TEXTURE2D, 0);
-    rlFramebufferAttach(frameBuffer, blurOnlyTexture, RL_ATTACHMENT_COLOR_CHANNEL2, RL_ATTACHMENT_TEXTURE2D, 0);
+    backend.active_draw_buffers(3);
+    backend.framebuffer_attach(frameBuffer, colorTexture, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
+    backend.framebuffer_attach(frameBuffer, glowOnlyTexture, RL_ATTACHMENT_COLOR_CHANNEL1, RL_ATTACHMENT_TEXTURE2D, 0);
+    backend.framebuffer_attach(frameBuffer, blurOnlyTexture, RL_ATTACHMENT_COLOR_CHANNEL2, RL_ATTACHMENT_TEXTURE2D, 0);
 
-    depthTexture = rlLoadTextureDepth(screenWidth, screenHeight, false);
-    rlFramebufferAttach(frameBuffer, depthTexture, RL_ATTACHMENT_DEPTH, RL_ATTACHMENT_TEXTURE2D, 0);
+    depthTexture = backend.load_texture_depth(screenWidth, screenHeight, false);
+    backend.framebuffer_attach(frameBuffer, depthTexture, RL_ATTACHMENT_DEPTH, RL_ATTACHMENT_TEXTURE2D, 0);
 
     // Make sure our framebuffer is complete.
     // NOTE: rlFramebufferComplete() automatically unbinds the framebuffer, so we don't have
     // to rlDisableFramebuffer() here.
 #ifdef DEBUG
-    if (!rlFramebufferComplete(frameBuffer))
+    if (!backend.framebuffer_complete(frameBuffer))
         throw std::runtime_error("Framebuffer is not complete");
 #endif
 }
 
 MultiTexture::~MultiTexture() {
     if (frameBuffer) {
-        rlUnloadFramebuffer(frameBuffer);
-        rlUnloadTexture(colorTexture);
-        rlUnloadTexture(glowOnlyTexture);
-        rlUnloadTexture(blurOnlyTexture);
-        rlUnloadTexture(depthTexture);
+        backend->unload_framebuffer(frameBuffer);
+        backend->unload_texture(colorTexture);
+        backend->unload_texture(glowOnlyTexture);
+        backend->unload_texture(blurOnlyTexture);
+        backend->unload_texture(depthTexture);
     }
 }
 
-MultiTexture::MultiTexture(MultiTexture &&other) {
+MultiTexture::MultiTexture(MultiTexture &&other): MultiTexture() {
     this->swap(other);
 }
 
@@ -66,6 +66,7 @@ MultiTexture& MultiTexture::operator=(MultiTexture &&other) {
 }
 
 void MultiTexture::swap(MultiTexture &other) {
+    std::swap(other.backend, backend);
     std::swap(other.frameBuffer, frameBuffer);
     std::swap(other.colorTexture, colorTexture);
     std::swap(other.glowOnlyTexture, glowOnlyTexture);
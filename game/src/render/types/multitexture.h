@@ -5,12 +5,14 @@
 #include "rlgl.h"
 #include <glad.h>
 
+#include "render_backend.h"
+
 class MultiTexture {
 public:
     MultiTexture():
-        frameBuffer(0), width(0), height(0), colorTexture(0),
+        backend(nullptr), frameBuffer(0), width(0), height(0), colorTexture(0),
         glowOnlyTexture(0), blurOnlyTexture(0), depthTexture(0) {}
-    MultiTexture(const unsigned int screenWidth, const unsigned int screenHeight);
+    MultiTexture(RenderBackend &backend, const unsigned int screenWidth, const unsigned int screenHeight);
     ~MultiTexture();
 
     MultiTexture(const MultiTexture &other) = delete;
@@ -20,6 +22,7 @@ public:
 
     void swap(MultiTexture &other);
 
+    RenderBackend * backend;
     unsigned int width, height;
     unsigned int frameBuffer;
     unsigned int colorTexture;
@@ -1,5 +1,9 @@
 #include "octree.h"
-#include "../../util/morton.h"
+
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 BitOctreeBlock::BitOctreeBlock() {
     data = new uint8_t[OctreeBlockMetadata::size]();
@@ -23,6 +27,8 @@ void BitOctreeBlock::insert(uint8_t x, uint8_t y, uint8_t z) {
         bool early_exit = data[idx] != 0x0; // If the current layer is filled already no need to update parent
 
         data[idx] |= 1 << bit_idx;
+        if (layer < OCTREE_BLOCK_DEPTH - 1)
+            lod_dirty.mark(idx / OctreeBlockMetadata::lod_page_size);
         bit_idx = morton & 0b111; // % 8
         morton >>= 3;
 
@@ -39,6 +45,8 @@ void BitOctreeBlock::remove(uint8_t x, uint8_t y, uint8_t z) {
     for (int layer = OCTREE_BLOCK_DEPTH - 1; layer >= 0; layer--) {
         unsigned int idx = morton + OctreeBlockMetadata::layer_offsets[layer];
         data[idx] &= ~(1 << bit_idx);
+        if (layer < OCTREE_BLOCK_DEPTH - 1)
+            lod_dirty.mark(idx / OctreeBlockMetadata::lod_page_size);
         if (data[idx] != 0x0)
             break;
 
@@ -46,3 +54,34 @@ void BitOctreeBlock::remove(uint8_t x, uint8_t y, uint8_t z) {
         morton >>= 3;
     }
 }
+
+void BitOctreeBlock::rebuild() {
+    // Byte i of a layer has bit k set if byte 8i + k of the layer below is non-zero
+    for (int layer = OCTREE_BLOCK_DEPTH - 2; layer >= 0; layer--) {
+        const uint8_t * children = data + OctreeBlockMetadata::layer_offsets[layer + 1];
+        const unsigned int count = 1u << (3 * layer);
+        unsigned int i = 0;
+
+#ifdef __SSE2__
+        // 16 children at a time, the compare mask is 2 parent bytes (inverted)
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 2 <= count; i += 2) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(children + 8 * i));
+            const uint16_t mask = static_cast<uint16_t>(~_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero)));
+            _set_lod_byte(layer, i, static_cast<uint8_t>(mask));
+            _set_lod_byte(layer, i + 1, static_cast<uint8_t>(mask >> 8));
+        }
+#endif
+        // Words are read little endian, so byte k of a word is child k
+        for (; i < count; i++) {
+            uint64_t word;
+            std::memcpy(&word, children + 8 * i, sizeof(word));
+            // Top bit of each byte set if the byte is non-zero, then gather the
+            // 8 top bits into one byte (bit 8k + 7 goes to bit 56 + k)
+            constexpr uint64_t low7 = 0x7F7F7F7F7F7F7F7Full;
+            const uint64_t nonzero = (((word & low7) + low7) | word) & ~low7;
+            _set_lod_byte(layer, i, static_cast<uint8_t>(((nonzero >> 7) * 0x0102040810204080ull) >> 56));
+        }
+    }
+    stale = false;
+}
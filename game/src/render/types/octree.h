@@ -3,6 +3,8 @@
 
 #include "stdint.h"
 #include "../../simulation/SimulationGraphics.h"
+#include "../../util/morton.h"
+#include "../../util/types/dirty_pages.h"
 
 #include <array>
 
@@ -16,6 +18,12 @@ namespace OctreeBlockMetadata {
     }() };
 
     constexpr unsigned int size = layer_offsets[OCTREE_BLOCK_DEPTH - 1] + (1 << (3 * OCTREE_BLOCK_DEPTH - 3));
+
+    // Every layer except the bottom one goes to the GPU (the bottom one is
+    // the same as color_data != 0), tracked for changes in pages of this size
+    constexpr unsigned int lod_size = layer_offsets[OCTREE_BLOCK_DEPTH - 1];
+    constexpr unsigned int lod_page_size = 16;
+    constexpr unsigned int lod_page_count = (lod_size + lod_page_size - 1) / lod_page_size;
 }
 
 
@@ -47,6 +55,35 @@ public:
      */
     void remove(uint8_t x, uint8_t y, uint8_t z);
 
+    /**
+     * @brief Flag the location at x,y,z as occupied in the bottom layer
+     *        only, the layers above are stale until rebuild() is called.
+     *        For many changes at once, ie a frame's worth, where propagating
+     *        every one would walk the same parents over and over
+     */
+    void set_leaf(uint8_t x, uint8_t y, uint8_t z) {
+        const uint32_t morton = util::morton_decode8(x, y, z);
+        data[OctreeBlockMetadata::layer_offsets[OCTREE_BLOCK_DEPTH - 1] + (morton >> 3)] |= 1 << (morton & 0b111);
+        stale = true;
+    }
+
+    /**
+     * @brief Flag the location at x,y,z as unoccupied, see set_leaf
+     */
+    void clear_leaf(uint8_t x, uint8_t y, uint8_t z) {
+        const uint32_t morton = util::morton_decode8(x, y, z);
+        data[OctreeBlockMetadata::layer_offsets[OCTREE_BLOCK_DEPTH - 1] + (morton >> 3)] &= ~(1 << (morton & 0b111));
+        stale = true;
+    }
+
+    /**
+     * @brief Recompute every layer above the bottom one from it, bottom up
+     *        Each byte of a layer is 8 bytes of the one below tested for
+     *        non-zero, done 8 bytes per 64 bit word. Only bytes that change
+     *        are written and marked in lod_dirty
+     */
+    void rebuild();
+
     // Stored as follows: let layer 0 = top most (root) node
     // The data is stored packed as [layer0][layer1][layer2]...[layer depth-1]
     // Each byte is a bitmask of which children are occupied, numbered in xyz norton order
@@ -58,7 +95,17 @@ public:
     // and the corresponding bit for it is the last 3 bits of morton_code(x, y, z) >> (3 * (depth - layer - 1))
     uint8_t * data;
 
-    uint8_t modified = 0x0;
+    // Pages of the non bottom layers changed since the last upload, see take_upload_spans
+    util::DirtyPages<OctreeBlockMetadata::lod_page_count> lod_dirty;
+    bool stale = false; // Layers above the bottom one may be out of date, see set_leaf
+
+private:
+    void _set_lod_byte(const int layer, const unsigned int i, const uint8_t value) {
+        const unsigned int idx = OctreeBlockMetadata::layer_offsets[layer] + i;
+        if (data[idx] == value) return;
+        data[idx] = value;
+        lod_dirty.mark(idx / OctreeBlockMetadata::lod_page_size);
+    }
 };
 
 #endif
\ No newline at end of file
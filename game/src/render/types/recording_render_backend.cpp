@@ -0,0 +1,103 @@
+#include "recording_render_backend.h"
+
+#include "rlgl.h"
+#include <glad.h>
+
+#include <stdexcept>
+#include <string>
+
+// Bytes per pixel of the 8 bit formats the renderer uses
+static std::size_t pixel_bytes(const int format) {
+    return format == GL_RED ? 1 : 4;
+}
+
+const RecordingRenderBackend::FrameRecord &RecordingRenderBackend::record(const unsigned int frame) const {
+#ifdef DEBUG
+    if (frame > current_frame || current_frame - frame >= FRAME_HISTORY)
+        throw std::out_of_range("Frame " + std::to_string(frame) + " is not in the recorded history");
+#endif
+    return records[frame % FRAME_HISTORY];
+}
+
+void RecordingRenderBackend::end_frame() {
+    current_frame++;
+    records[current_frame % FRAME_HISTORY] = FrameRecord();
+}
+
+void RecordingRenderBackend::_record(const unsigned int call, const std::size_t bytes, const bool upload) {
+    auto &record = records[current_frame % FRAME_HISTORY];
+    auto &stats = record.calls[call];
+    stats.count++;
+    stats.bytes += bytes;
+    record.call_count++;
+    if (upload)
+        record.upload_bytes += bytes;
+}
+
+Shader RecordingRenderBackend::load_shader(const char *, const char *) {
+    _record(RenderCall::LOAD_SHADER);
+    Shader shader{};
+    shader.id = next_id++;
+    return shader;
+}
+
+Shader RecordingRenderBackend::load_shader_from_memory(const char *, const char *) {
+    _record(RenderCall::LOAD_SHADER_FROM_MEMORY);
+    Shader shader{};
+    shader.id = next_id++;
+    return shader;
+}
+
+void RecordingRenderBackend::set_shader_value(Shader, int, const void *, int uniform_type) {
+    // Only the types the renderer uses, the rest count as 4 bytes
+    std::size_t bytes = 4;
+    if (uniform_type == SHADER_UNIFORM_VEC2) bytes = 8;
+    else if (uniform_type == SHADER_UNIFORM_VEC3) bytes = 12;
+    _record(RenderCall::SET_SHADER_VALUE, bytes, true);
+}
+
+unsigned int RecordingRenderBackend::load_texture(const void * data, int width, int height, int, int) {
+    _record(RenderCall::LOAD_TEXTURE, data ? static_cast<std::size_t>(width) * height * 4 : 0, true);
+    return next_id++;
+}
+
+unsigned int RecordingRenderBackend::load_shader_buffer(unsigned int size, const void * data, int) {
+    _record(RenderCall::LOAD_SHADER_BUFFER, data ? size : 0, true);
+    return next_id++;
+}
+
+void RecordingRenderBackend::buffer_data(unsigned int, std::size_t size, const void * data, unsigned int) {
+    _record(RenderCall::BUFFER_DATA, data ? size : 0, true);
+}
+
+void RecordingRenderBackend::buffer_sub_data(unsigned int, std::size_t, std::size_t size, const void *) {
+    _record(RenderCall::BUFFER_SUB_DATA, size, true);
+}
+
+void * RecordingRenderBackend::map_buffer_range(unsigned int, std::size_t, std::size_t size, unsigned int access) {
+    // Whatever is written through the mapping goes to the GPU
+    _record(RenderCall::MAP_BUFFER_RANGE, size, (access & GL_MAP_WRITE_BIT) != 0);
+    mapped.resize(size);
+    return mapped.data();
+}
+
+void RecordingRenderBackend::copy_buffer_sub_data(unsigned int, unsigned int,
+        std::size_t, std::size_t, std::size_t size) {
+    _record(RenderCall::COPY_BUFFER_SUB_DATA, size);
+}
+
+void RecordingRenderBackend::tex_image_2d(unsigned int, int format, int width, int height, const void * data) {
+    _record(RenderCall::TEX_IMAGE_2D, data ? pixel_bytes(format) * width * height : 0, true);
+}
+
+void RecordingRenderBackend::tex_image_3d(unsigned int, int format, int width, int height, int depth, const void * data) {
+    _record(RenderCall::TEX_IMAGE_3D, data ? pixel_bytes(format) * width * height * depth : 0, true);
+}
+
+void RecordingRenderBackend::tex_sub_image_2d(unsigned int, int format, int width, int height, const void *) {
+    _record(RenderCall::TEX_SUB_IMAGE_2D, pixel_bytes(format) * width * height, true);
+}
+
+void RecordingRenderBackend::tex_sub_image_3d(unsigned int, int format, int width, int height, int depth, const void *) {
+    _record(RenderCall::TEX_SUB_IMAGE_3D, pixel_bytes(format) * width * height * depth, true);
+}
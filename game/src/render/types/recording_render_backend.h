@@ -0,0 +1,241 @@
+#ifndef RENDER_RECORDING_RENDER_BACKEND_H
+#define RENDER_RECORDING_RENDER_BACKEND_H
+
+#include "render_backend.h"
+
+#include "stdint.h"
+#include <cstddef>
+#include <vector>
+
+// Calls RecordingRenderBackend counts, one per RenderBackend method
+namespace RenderCall {
+    constexpr unsigned int SCREEN_WIDTH = 0;
+    constexpr unsigned int SCREEN_HEIGHT = 1;
+    constexpr unsigned int LOAD_SHADER = 2;
+    constexpr unsigned int LOAD_SHADER_FROM_MEMORY = 3;
+    constexpr unsigned int UNLOAD_SHADER = 4;
+    constexpr unsigned int GET_SHADER_LOCATION = 5;
+    constexpr unsigned int SET_SHADER_VALUE = 6;
+    constexpr unsigned int BEGIN_MODE_3D = 7;
+    constexpr unsigned int END_MODE_3D = 8;
+    constexpr unsigned int BEGIN_SHADER_MODE = 9;
+    constexpr unsigned int END_SHADER_MODE = 10;
+    constexpr unsigned int BEGIN_TEXTURE_MODE = 11;
+    constexpr unsigned int END_TEXTURE_MODE = 12;
+    constexpr unsigned int CLEAR_BACKGROUND = 13;
+    constexpr unsigned int UNLOAD_RENDER_TEXTURE = 14;
+    constexpr unsigned int DRAW_CUBE_WIRES = 15;
+    constexpr unsigned int LOAD_FRAMEBUFFER = 16;
+    constexpr unsigned int ENABLE_FRAMEBUFFER = 17;
+    constexpr unsigned int DISABLE_FRAMEBUFFER = 18;
+    constexpr unsigned int FRAMEBUFFER_COMPLETE = 19;
+    constexpr unsigned int FRAMEBUFFER_ATTACH = 20;
+    constexpr unsigned int UNLOAD_FRAMEBUFFER = 21;
+    constexpr unsigned int ACTIVE_DRAW_BUFFERS = 22;
+    constexpr unsigned int LOAD_TEXTURE = 23;
+    constexpr unsigned int LOAD_TEXTURE_DEPTH = 24;
+    constexpr unsigned int UNLOAD_TEXTURE = 25;
+    constexpr unsigned int TEXTURE_PARAMETERS = 26;
+    constexpr unsigned int CLEAR_SCREEN_BUFFERS = 27;
+    constexpr unsigned int ENABLE_SHADER = 28;
+    constexpr unsigned int DISABLE_SHADER = 29;
+    constexpr unsigned int GET_LOCATION_UNIFORM = 30;
+    constexpr unsigned int SET_UNIFORM_SAMPLER = 31;
+    constexpr unsigned int LOAD_SHADER_BUFFER = 32;
+    constexpr unsigned int BIND_SHADER_BUFFER = 33;
+    constexpr unsigned int DRAW_DUMMY_TRIANGLE = 34;
+    constexpr unsigned int GEN_BUFFER = 35;
+    constexpr unsigned int DELETE_BUFFER = 36;
+    constexpr unsigned int BIND_BUFFER = 37;
+    constexpr unsigned int BIND_BUFFER_BASE = 38;
+    constexpr unsigned int BUFFER_DATA = 39;
+    constexpr unsigned int BUFFER_SUB_DATA = 40;
+    constexpr unsigned int MAP_BUFFER_RANGE = 41;
+    constexpr unsigned int UNMAP_BUFFER = 42;
+    constexpr unsigned int COPY_BUFFER_SUB_DATA = 43;
+    constexpr unsigned int GEN_TEXTURE = 44;
+    constexpr unsigned int DELETE_TEXTURE = 45;
+    constexpr unsigned int ACTIVE_TEXTURE = 46;
+    constexpr unsigned int BIND_TEXTURE = 47;
+    constexpr unsigned int TEX_PARAMETER = 48;
+    constexpr unsigned int TEX_IMAGE_2D = 49;
+    constexpr unsigned int TEX_IMAGE_3D = 50;
+    constexpr unsigned int TEX_SUB_IMAGE_2D = 51;
+    constexpr unsigned int TEX_SUB_IMAGE_3D = 52;
+    constexpr unsigned int UNIFORM_BLOCK_SIZE = 53;
+    constexpr unsigned int UNIFORM_OFFSET = 54;
+    constexpr unsigned int COUNT = 55;
+
+    constexpr const char * NAMES[COUNT] = {
+        "screen_width",
+        "screen_height",
+        "load_shader",
+        "load_shader_from_memory",
+        "unload_shader",
+        "get_shader_location",
+        "set_shader_value",
+        "begin_mode_3d",
+        "end_mode_3d",
+        "begin_shader_mode",
+        "end_shader_mode",
+        "begin_texture_mode",
+        "end_texture_mode",
+        "clear_background",
+        "unload_render_texture",
+        "draw_cube_wires",
+        "load_framebuffer",
+        "enable_framebuffer",
+        "disable_framebuffer",
+        "framebuffer_complete",
+        "framebuffer_attach",
+        "unload_framebuffer",
+        "active_draw_buffers",
+        "load_texture",
+        "load_texture_depth",
+        "unload_texture",
+        "texture_parameters",
+        "clear_screen_buffers",
+        "enable_shader",
+        "disable_shader",
+        "get_location_uniform",
+        "set_uniform_sampler",
+        "load_shader_buffer",
+        "bind_shader_buffer",
+        "draw_dummy_triangle",
+        "gen_buffer",
+        "delete_buffer",
+        "bind_buffer",
+        "bind_buffer_base",
+        "buffer_data",
+        "buffer_sub_data",
+        "map_buffer_range",
+        "unmap_buffer",
+        "copy_buffer_sub_data",
+        "gen_texture",
+        "delete_texture",
+        "active_texture",
+        "bind_texture",
+        "tex_parameter",
+        "tex_image_2d",
+        "tex_image_3d",
+        "tex_sub_image_2d",
+        "tex_sub_image_3d",
+        "uniform_block_size",
+        "uniform_offset"
+    };
+}
+
+/**
+ * @brief RenderBackend without a GPU: calls do nothing but are recorded,
+ *        per frame (frames end at end_frame) and per call, with the bytes
+ *        each sent. Lets the renderer run headless in benchmarks, and
+ *        upload changes be compared by byte counts. Only the last
+ *        FRAME_HISTORY frames are kept
+ *
+ *        Buffers and textures get increasing ids, uniform blocks are
+ *        UNIFORM_BLOCK_SIZE bytes with every member at offset 0, mapped
+ *        buffers are plain memory
+ */
+class RecordingRenderBackend: public RenderBackend {
+public:
+    static constexpr int UNIFORM_BLOCK_SIZE = 1024;
+    static constexpr unsigned int FRAME_HISTORY = 64;
+
+    struct CallStats {
+        unsigned int count = 0;
+        std::size_t bytes = 0; // Data passed, for copies the bytes copied on the GPU
+    };
+
+    struct FrameRecord {
+        CallStats calls[RenderCall::COUNT]; // By RenderCall index
+        unsigned int call_count = 0;
+        std::size_t upload_bytes = 0; // Sent from the CPU (so GPU side copies not included)
+    };
+
+    RecordingRenderBackend(const int width = 1280, const int height = 720):
+        width(width), height(height), records(FRAME_HISTORY) {}
+
+    using RenderBackend::set_shader_value;
+
+    // Frame calls are currently recorded to, ie the number of end_frame calls so far
+    unsigned int frame() const { return current_frame; }
+    // One of the last FRAME_HISTORY frames, including the current one
+    const FrameRecord &record(const unsigned int frame) const;
+
+    int screen_width() override { _record(RenderCall::SCREEN_WIDTH); return width; }
+    int screen_height() override { _record(RenderCall::SCREEN_HEIGHT); return height; }
+    Shader load_shader(const char * vs_path, const char * fs_path) override;
+    Shader load_shader_from_memory(const char * vs_code, const char * fs_code) override;
+    void unload_shader(Shader) override { _record(RenderCall::UNLOAD_SHADER); }
+    int get_shader_location(Shader, const char *) override { _record(RenderCall::GET_SHADER_LOCATION); return 0; }
+    void set_shader_value(Shader shader, int loc, const void * value, int uniform_type) override;
+    void begin_mode_3d(Camera3D) override { _record(RenderCall::BEGIN_MODE_3D); }
+    void end_mode_3d() override { _record(RenderCall::END_MODE_3D); }
+    void begin_shader_mode(Shader) override { _record(RenderCall::BEGIN_SHADER_MODE); }
+    void end_shader_mode() override { _record(RenderCall::END_SHADER_MODE); }
+    void begin_texture_mode(RenderTexture2D) override { _record(RenderCall::BEGIN_TEXTURE_MODE); }
+    void end_texture_mode() override { _record(RenderCall::END_TEXTURE_MODE); }
+    void clear_background(Color) override { _record(RenderCall::CLEAR_BACKGROUND); }
+    void unload_render_texture(RenderTexture2D) override { _record(RenderCall::UNLOAD_RENDER_TEXTURE); }
+    void draw_cube_wires(Vector3, float, float, float, Color) override { _record(RenderCall::DRAW_CUBE_WIRES); }
+
+    unsigned int load_framebuffer() override { _record(RenderCall::LOAD_FRAMEBUFFER); return next_id++; }
+    void enable_framebuffer(unsigned int) override { _record(RenderCall::ENABLE_FRAMEBUFFER); }
+    void disable_framebuffer() override { _record(RenderCall::DISABLE_FRAMEBUFFER); }
+    bool framebuffer_complete(unsigned int) override { _record(RenderCall::FRAMEBUFFER_COMPLETE); return true; }
+    void framebuffer_attach(unsigned int, unsigned int, int, int, int) override {
+        _record(RenderCall::FRAMEBUFFER_ATTACH);
+    }
+    void unload_framebuffer(unsigned int) override { _record(RenderCall::UNLOAD_FRAMEBUFFER); }
+    void active_draw_buffers(int) override { _record(RenderCall::ACTIVE_DRAW_BUFFERS); }
+    unsigned int load_texture(const void * data, int width, int height, int format, int mipmaps) override;
+    unsigned int load_texture_depth(int, int, bool) override { _record(RenderCall::LOAD_TEXTURE_DEPTH); return next_id++; }
+    void unload_texture(unsigned int) override { _record(RenderCall::UNLOAD_TEXTURE); }
+    void texture_parameters(unsigned int, int, int) override { _record(RenderCall::TEXTURE_PARAMETERS); }
+    void clear_screen_buffers() override { _record(RenderCall::CLEAR_SCREEN_BUFFERS); }
+    void enable_shader(unsigned int) override { _record(RenderCall::ENABLE_SHADER); }
+    void disable_shader() override { _record(RenderCall::DISABLE_SHADER); }
+    int get_location_uniform(unsigned int, const char *) override { _record(RenderCall::GET_LOCATION_UNIFORM); return 0; }
+    void set_uniform_sampler(int, unsigned int) override { _record(RenderCall::SET_UNIFORM_SAMPLER); }
+    unsigned int load_shader_buffer(unsigned int size, const void * data, int usage) override;
+    void bind_shader_buffer(unsigned int, unsigned int) override { _record(RenderCall::BIND_SHADER_BUFFER); }
+    void draw_dummy_triangle() override { _record(RenderCall::DRAW_DUMMY_TRIANGLE); }
+
+    unsigned int gen_buffer() override { _record(RenderCall::GEN_BUFFER); return next_id++; }
+    void delete_buffer(unsigned int) override { _record(RenderCall::DELETE_BUFFER); }
+    void bind_buffer(unsigned int, unsigned int) override { _record(RenderCall::BIND_BUFFER); }
+    void bind_buffer_base(unsigned int, unsigned int, unsigned int) override { _record(RenderCall::BIND_BUFFER_BASE); }
+    void buffer_data(unsigned int target, std::size_t size, const void * data, unsigned int usage) override;
+    void buffer_sub_data(unsigned int target, std::size_t offset, std::size_t size, const void * data) override;
+    void * map_buffer_range(unsigned int target, std::size_t offset, std::size_t size, unsigned int access) override;
+    void unmap_buffer(unsigned int) override { _record(RenderCall::UNMAP_BUFFER); }
+    void copy_buffer_sub_data(unsigned int read_target, unsigned int write_target,
+        std::size_t read_offset, std::size_t write_offset, std::size_t size) override;
+
+    unsigned int gen_texture() override { _record(RenderCall::GEN_TEXTURE); return next_id++; }
+    void delete_texture(unsigned int) override { _record(RenderCall::DELETE_TEXTURE); }
+    void active_texture(unsigned int) override { _record(RenderCall::ACTIVE_TEXTURE); }
+    void bind_texture(unsigned int, unsigned int) override { _record(RenderCall::BIND_TEXTURE); }
+    void tex_parameter(unsigned int, unsigned int, int) override { _record(RenderCall::TEX_PARAMETER); }
+    void tex_image_2d(unsigned int target, int format, int width, int height, const void * data) override;
+    void tex_image_3d(unsigned int target, int format, int width, int height, int depth, const void * data) override;
+    void tex_sub_image_2d(unsigned int target, int format, int width, int height, const void * data) override;
+    void tex_sub_image_3d(unsigned int target, int format, int width, int height, int depth, const void * data) override;
+
+    int uniform_block_size(unsigned int, const char *) override { _record(RenderCall::UNIFORM_BLOCK_SIZE); return UNIFORM_BLOCK_SIZE; }
+    unsigned int uniform_offset(unsigned int, const char *) override { _record(RenderCall::UNIFORM_OFFSET); return 0; }
+
+    void end_frame() override;
+
+private:
+    int width, height;
+    unsigned int next_id = 1;
+    unsigned int current_frame = 0;
+    std::vector<FrameRecord> records; // Ring, frame i is at i % FRAME_HISTORY
+    std::vector<uint8_t> mapped; // Backs map_buffer_range
+
+    // upload: bytes are sent from the CPU, as opposed to copied on the GPU
+    void _record(const unsigned int call, const std::size_t bytes = 0, const bool upload = false);
+};
+
+#endif
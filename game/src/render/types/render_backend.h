@@ -0,0 +1,99 @@
+#ifndef RENDER_BACKEND_H
+#define RENDER_BACKEND_H
+
+#include "raylib.h"
+
+#include "stdint.h"
+#include <cstddef>
+
+/**
+ * @brief Every raylib / rlgl / GL call the renderer makes (Renderer,
+ *        MultiTexture, UBOWriter, StagingUploadBackend), one method per call
+ *        with the same arguments. GLRenderBackend makes the real calls,
+ *        RecordingRenderBackend only counts them, so the renderer can run
+ *        without a GPU. Enums are the GL / rlgl constants as unsigned int
+ */
+class RenderBackend {
+public:
+    virtual ~RenderBackend() = default;
+
+    // raylib
+    virtual int screen_width() = 0;
+    virtual int screen_height() = 0;
+    virtual Shader load_shader(const char * vs_path, const char * fs_path) = 0;
+    virtual Shader load_shader_from_memory(const char * vs_code, const char * fs_code) = 0;
+    virtual void unload_shader(Shader shader) = 0;
+    virtual int get_shader_location(Shader shader, const char * name) = 0;
+    virtual void set_shader_value(Shader shader, int loc, const void * value, int uniform_type) = 0;
+    virtual void begin_mode_3d(Camera3D camera) = 0;
+    virtual void end_mode_3d() = 0;
+    virtual void begin_shader_mode(Shader shader) = 0;
+    virtual void end_shader_mode() = 0;
+    virtual void begin_texture_mode(RenderTexture2D target) = 0;
+    virtual void end_texture_mode() = 0;
+    virtual void clear_background(Color color) = 0;
+    virtual void unload_render_texture(RenderTexture2D target) = 0;
+    virtual void draw_cube_wires(Vector3 position, float width, float height, float length, Color color) = 0;
+
+    // rlgl
+    virtual unsigned int load_framebuffer() = 0;
+    virtual void enable_framebuffer(unsigned int id) = 0;
+    virtual void disable_framebuffer() = 0;
+    virtual bool framebuffer_complete(unsigned int id) = 0;
+    virtual void framebuffer_attach(unsigned int framebuffer, unsigned int texture, int attach_type, int texture_type, int mip_level) = 0;
+    virtual void unload_framebuffer(unsigned int id) = 0;
+    virtual void active_draw_buffers(int count) = 0;
+    virtual unsigned int load_texture(const void * data, int width, int height, int format, int mipmaps) = 0;
+    virtual unsigned int load_texture_depth(int width, int height, bool use_render_buffer) = 0;
+    virtual void unload_texture(unsigned int id) = 0;
+    virtual void texture_parameters(unsigned int id, int param, int value) = 0;
+    virtual void clear_screen_buffers() = 0;
+    virtual void enable_shader(unsigned int id) = 0;
+    virtual void disable_shader() = 0;
+    virtual int get_location_uniform(unsigned int shader, const char * name) = 0;
+    virtual void set_uniform_sampler(int loc, unsigned int texture) = 0;
+    virtual unsigned int load_shader_buffer(unsigned int size, const void * data, int usage) = 0;
+    virtual void bind_shader_buffer(unsigned int id, unsigned int index) = 0;
+    virtual void draw_dummy_triangle() = 0; // See util::draw_dummy_triangle
+
+    // GL buffers
+    virtual unsigned int gen_buffer() = 0;
+    virtual void delete_buffer(unsigned int id) = 0;
+    virtual void bind_buffer(unsigned int target, unsigned int id) = 0;
+    virtual void bind_buffer_base(unsigned int target, unsigned int index, unsigned int id) = 0;
+    virtual void buffer_data(unsigned int target, std::size_t size, const void * data, unsigned int usage) = 0;
+    virtual void buffer_sub_data(unsigned int target, std::size_t offset, std::size_t size, const void * data) = 0;
+    virtual void * map_buffer_range(unsigned int target, std::size_t offset, std::size_t size, unsigned int access) = 0;
+    virtual void unmap_buffer(unsigned int target) = 0;
+    virtual void copy_buffer_sub_data(unsigned int read_target, unsigned int write_target,
+        std::size_t read_offset, std::size_t write_offset, std::size_t size) = 0;
+
+    // GL textures
+    virtual unsigned int gen_texture() = 0;
+    virtual void delete_texture(unsigned int id) = 0;
+    virtual void active_texture(unsigned int unit) = 0;
+    virtual void bind_texture(unsigned int target, unsigned int id) = 0;
+    virtual void tex_parameter(unsigned int target, unsigned int param, int value) = 0;
+    // Level 0 only, 8 bits per channel. The sub image versions replace the whole image
+    virtual void tex_image_2d(unsigned int target, int format, int width, int height, const void * data) = 0;
+    virtual void tex_image_3d(unsigned int target, int format, int width, int height, int depth, const void * data) = 0;
+    virtual void tex_sub_image_2d(unsigned int target, int format, int width, int height, const void * data) = 0;
+    virtual void tex_sub_image_3d(unsigned int target, int format, int width, int height, int depth, const void * data) = 0;
+
+    // GL uniform block reflection, see UBOWriter
+    virtual int uniform_block_size(unsigned int program, const char * block) = 0;
+    virtual unsigned int uniform_offset(unsigned int program, const char * member) = 0;
+
+    /**
+     * @brief Called by Renderer::draw once a frame is submitted
+     */
+    virtual void end_frame() {}
+
+    // Typed shorthands for set_shader_value
+    void set_shader_value(const Shader shader, const int loc, const Vector2 value) { set_shader_value(shader, loc, &value, SHADER_UNIFORM_VEC2); }
+    void set_shader_value(const Shader shader, const int loc, const Vector3 value) { set_shader_value(shader, loc, &value, SHADER_UNIFORM_VEC3); }
+    void set_shader_value(const Shader shader, const int loc, const float value) { set_shader_value(shader, loc, &value, SHADER_UNIFORM_FLOAT); }
+    void set_shader_value(const Shader shader, const int loc, const int value) { set_shader_value(shader, loc, &value, SHADER_UNIFORM_INT); }
+};
+
+#endif
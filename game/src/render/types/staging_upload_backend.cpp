@@ -0,0 +1,57 @@
+#include "staging_upload_backend.h"
+#include "../../simulation/SimulationGraphics.h"
+
+#include "rlgl.h"
+#include <glad.h>
+
+#include <stdexcept>
+#include <string>
+
+StagingUploadBackend::StagingUploadBackend(RenderBackend &backend, const unsigned int colors, const unsigned int flags,
+        const unsigned int lod, const unsigned int ao_tex, const unsigned int shadow_tex):
+    backend(backend), targets{ colors, flags, lod, ao_tex, shadow_tex }, staging(backend.gen_buffer()) {}
+
+StagingUploadBackend::~StagingUploadBackend() {
+    backend.delete_buffer(staging);
+}
+
+void * StagingUploadBackend::map_staging(std::size_t size) {
+    backend.bind_buffer(GL_COPY_READ_BUFFER, staging);
+    backend.buffer_data(GL_COPY_READ_BUFFER, size, NULL, GL_STREAM_DRAW); // Orphan the previous storage
+    return backend.map_buffer_range(GL_COPY_READ_BUFFER, 0, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void StagingUploadBackend::unmap_staging() {
+    backend.unmap_buffer(GL_COPY_READ_BUFFER);
+}
+
+void StagingUploadBackend::upload_buffer(UploadTarget target, std::size_t offset, const void * data, std::size_t size) {
+    backend.bind_buffer(GL_COPY_WRITE_BUFFER, targets[static_cast<int>(target)]);
+    backend.buffer_sub_data(GL_COPY_WRITE_BUFFER, offset, size, data);
+}
+
+void StagingUploadBackend::copy_staged(UploadTarget target, std::size_t staging_offset, std::size_t offset, std::size_t size) {
+    backend.bind_buffer(GL_COPY_READ_BUFFER, staging);
+    backend.bind_buffer(GL_COPY_WRITE_BUFFER, targets[static_cast<int>(target)]);
+    backend.copy_buffer_sub_data(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, staging_offset, offset, size);
+}
+
+void StagingUploadBackend::upload_texture(UploadTarget target, const void * data, std::size_t size) {
+    // Whole texture, one byte per texel
+    const std::size_t expected = target == UploadTarget::AO ?
+        AO_X_BLOCKS * AO_Y_BLOCKS * AO_Z_BLOCKS : SHADOW_MAP_X * SHADOW_MAP_Y;
+#ifdef DEBUG
+    if (size != expected)
+        throw std::invalid_argument("Texture upload of " + std::to_string(size) + " bytes, expected " + std::to_string(expected));
+#endif
+    if (size != expected) return;
+
+    if (target == UploadTarget::AO) {
+        backend.bind_texture(GL_TEXTURE_3D, targets[static_cast<int>(target)]);
+        backend.tex_sub_image_3d(GL_TEXTURE_3D, GL_RED, AO_X_BLOCKS, AO_Y_BLOCKS, AO_Z_BLOCKS, data);
+    } else {
+        backend.bind_texture(GL_TEXTURE_2D, targets[static_cast<int>(target)]);
+        backend.tex_sub_image_2d(GL_TEXTURE_2D, GL_RED, SHADOW_MAP_X, SHADOW_MAP_Y, data);
+    }
+}
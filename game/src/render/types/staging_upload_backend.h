@@ -0,0 +1,41 @@
+#ifndef RENDER_STAGING_UPLOAD_BACKEND_H
+#define RENDER_STAGING_UPLOAD_BACKEND_H
+
+#include "upload_backend.h"
+#include "render_backend.h"
+
+/**
+ * @brief UploadBackend on GL 4.3 buffer copies. The staging buffer is
+ *        orphaned each frame (new storage with glBufferData, then mapped
+ *        unsynchronized), so the CPU never waits for the GPU to finish last
+ *        frame's copies, and glCopyBufferSubData applies the deltas in
+ *        submission order
+ */
+class StagingUploadBackend: public UploadBackend {
+public:
+    /**
+     * @brief Call after the targets exist
+     * @param colors, flags, lod SSBOs for UploadTarget COLORS, FLAGS and LOD
+     * @param ao_tex 3D texture for UploadTarget::AO
+     * @param shadow_tex 2D texture for UploadTarget::SHADOW
+     */
+    StagingUploadBackend(RenderBackend &backend, const unsigned int colors, const unsigned int flags,
+        const unsigned int lod, const unsigned int ao_tex, const unsigned int shadow_tex);
+    ~StagingUploadBackend();
+
+    StagingUploadBackend(const StagingUploadBackend &other) = delete;
+    StagingUploadBackend &operator=(const StagingUploadBackend &other) = delete;
+
+    void * map_staging(std::size_t size) override;
+    void unmap_staging() override;
+    void upload_buffer(UploadTarget target, std::size_t offset, const void * data, std::size_t size) override;
+    void copy_staged(UploadTarget target, std::size_t staging_offset, std::size_t offset, std::size_t size) override;
+    void upload_texture(UploadTarget target, const void * data, std::size_t size) override;
+
+private:
+    RenderBackend &backend;
+    unsigned int targets[UPLOAD_TARGET_COUNT];
+    unsigned int staging;
+};
+
+#endif
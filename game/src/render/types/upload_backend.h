@@ -0,0 +1,46 @@
+#ifndef RENDER_UPLOAD_BACKEND_H
+#define RENDER_UPLOAD_BACKEND_H
+
+#include "upload_spans.h"
+
+#include <cstddef>
+
+/**
+ * @brief The GPU side of VoxelUploader: one authoritative copy of each
+ *        target, changed only through a staging buffer that is refilled
+ *        every frame. Implemented on GL buffer copies by StagingUploadBackend,
+ *        and on plain memory by MemoryUploadBackend to check the uploads
+ */
+class UploadBackend {
+public:
+    virtual ~UploadBackend() = default;
+
+    /**
+     * @brief Give the staging buffer new storage of size bytes and return it
+     *        for writing. The old storage is orphaned, not overwritten, so
+     *        copies from it the GPU has yet to run don't have to be waited for
+     */
+    virtual void * map_staging(std::size_t size) = 0;
+    virtual void unmap_staging() = 0;
+
+    /**
+     * @brief Write size bytes of data to offset in a buffer target directly.
+     *        Slower than the staging buffer, used when it fails to map
+     */
+    virtual void upload_buffer(UploadTarget target, std::size_t offset, const void * data, std::size_t size) = 0;
+
+    /**
+     * @brief Copy size bytes at staging_offset of the staging buffer to offset
+     *        in a target buffer. Runs on the GPU in submission order, after
+     *        the draws of earlier frames that read the target
+     */
+    virtual void copy_staged(UploadTarget target, std::size_t staging_offset, std::size_t offset, std::size_t size) = 0;
+
+    /**
+     * @brief Replace the whole of a texture target (AO or SHADOW), size must
+     *        be the size of the texture
+     */
+    virtual void upload_texture(UploadTarget target, const void * data, std::size_t size) = 0;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "upload_spans.h"
+
+#include <algorithm>
+
+void UploadStats::add(const UploadSpan &span) {
+    switch (span.target) {
+        case UploadTarget::COLORS: color_bytes += span.size; break;
+        case UploadTarget::FLAGS: flag_bytes += span.size; break;
+        case UploadTarget::LOD: lod_bytes += span.size; break;
+        case UploadTarget::AO:
+        case UploadTarget::SHADOW: texture_bytes += span.size; break;
+    }
+    calls++;
+}
+
+void take_upload_spans(SimulationGraphics &graphics, std::vector<UploadSpan> &out) {
+    graphics.color_dirty.take_spans(COLOR_UPLOAD_MAX_GAP, [&](const std::size_t page, const std::size_t pages) {
+        // Last page may go past the end of color_data
+        const std::size_t first = page * COLOR_DATA_PAGE_SIZE;
+        const std::size_t count = std::min<std::size_t>(pages * COLOR_DATA_PAGE_SIZE, graphics.color_data.size() - first);
+        out.push_back(UploadSpan{ UploadTarget::COLORS, &graphics.color_data[first], first * sizeof(uint32_t), count * sizeof(uint32_t) });
+        out.push_back(UploadSpan{ UploadTarget::FLAGS, &graphics.color_flags[first], first * sizeof(uint8_t), count * sizeof(uint8_t) });
+    });
+
+    for (std::size_t i = 0; i < graphics.octree_blocks.size(); i++) {
+        auto &tree = graphics.octree_blocks[i];
+        tree.lod_dirty.take_spans(LOD_UPLOAD_MAX_GAP, [&](const std::size_t page, const std::size_t pages) {
+            const std::size_t first = page * OctreeBlockMetadata::lod_page_size;
+            const std::size_t count = std::min<std::size_t>(pages * OctreeBlockMetadata::lod_page_size,
+                OctreeBlockMetadata::lod_size - first);
+            out.push_back(UploadSpan{ UploadTarget::LOD, tree.data + first,
+                i * OctreeBlockMetadata::lod_size + first, count });
+        });
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef RENDER_UPLOAD_SPANS_H
+#define RENDER_UPLOAD_SPANS_H
+
+#include "stdint.h"
+#include "octree.h"
+
+#include <cstddef>
+#include <vector>
+
+// Which GPU buffer or texture a span goes to
+enum class UploadTarget: uint8_t {
+    COLORS = 0, // color_data
+    FLAGS = 1,  // color_flags
+    LOD = 2,    // Octree blocks without their bottom layer, one after another
+    AO = 3,     // Ambient occlusion texture, always whole
+    SHADOW = 4  // Shadow map texture, always whole
+};
+constexpr unsigned int UPLOAD_TARGET_COUNT = 5;
+
+struct UploadSpan {
+    UploadTarget target;
+    const void * data;
+    std::size_t offset; // In bytes, into the target buffer
+    std::size_t size;   // In bytes
+};
+
+// Rough cost of one more upload call, in bytes that could be uploaded in its
+// place. Dirty runs closer than this are uploaded as one, clean gap included
+constexpr std::size_t UPLOAD_CALL_COST_BYTES = 4096;
+// A color span is 2 calls (colors and flags) of 5 bytes per voxel together
+constexpr std::size_t COLOR_UPLOAD_MAX_GAP = 2 * UPLOAD_CALL_COST_BYTES / (COLOR_DATA_PAGE_SIZE * (sizeof(uint32_t) + sizeof(uint8_t)));
+constexpr std::size_t LOD_UPLOAD_MAX_GAP = UPLOAD_CALL_COST_BYTES / OctreeBlockMetadata::lod_page_size;
+
+/**
+ * @brief Bytes sent to the GPU in a frame, see Renderer::upload_stats
+ */
+struct UploadStats {
+    std::size_t color_bytes = 0;
+    std::size_t flag_bytes = 0;
+    std::size_t lod_bytes = 0;
+    std::size_t texture_bytes = 0; // AO and shadow map
+    unsigned int calls = 0;
+
+    void add(const UploadSpan &span);
+    std::size_t total_bytes() const { return color_bytes + flag_bytes + lod_bytes + texture_bytes; }
+};
+
+/**
+ * @brief Append the spans of color_data, color_flags and the octree blocks
+ *        that changed since the last call to out, and mark them clean (see
+ *        util::DirtyPages). Touches no GL state, so it can run headless
+ */
+void take_upload_spans(SimulationGraphics &graphics, std::vector<UploadSpan> &out);
+
+#endif
@@ -0,0 +1,51 @@
+#include "voxel_uploader.h"
+#include "../../util/profiler.h"
+
+#include <cstring>
+
+void VoxelUploader::upload(SimulationGraphics &graphics, UploadBackend &backend) {
+    PROFILE_ZONE("VoxelUploader::upload");
+
+    spans.clear();
+    take_upload_spans(graphics, spans);
+
+    log.clear();
+    last_stats = UploadStats();
+    for (const auto &span : spans) {
+        log.append(span.target, span.offset, span.size);
+        last_stats.add(span);
+    }
+
+    if (!log.entries.empty()) {
+        // Null if the driver can't map it (out of memory, lost context). The
+        // pages are already marked clean, so the spans must still be sent
+        uint8_t * staging = static_cast<uint8_t *>(backend.map_staging(log.staging_size));
+        if (staging) {
+            // Dense scenes change tens of MB a frame
+            #pragma omp parallel for schedule(dynamic, 16)
+            for (std::size_t i = 0; i < spans.size(); i++)
+                std::memcpy(staging + log.entries[i].staging_offset, spans[i].data, spans[i].size);
+            backend.unmap_staging();
+
+            for (const auto &entry : log.entries)
+                backend.copy_staged(entry.target, entry.staging_offset, entry.offset, entry.size);
+        } else {
+            for (const auto &span : spans)
+                backend.upload_buffer(span.target, span.offset, span.data, span.size);
+        }
+    }
+
+    ao_data.resize(graphics.ao_blocks.size());
+    #pragma omp simd
+    for (std::size_t i = 0; i < ao_data.size(); i++)
+        ao_data[i] = ao_texel(graphics.ao_blocks[i]);
+
+    const UploadSpan textures[] = {
+        { UploadTarget::AO, ao_data.data(), 0, ao_data.size() },
+        { UploadTarget::SHADOW, graphics.shadow_map, 0, sizeof(graphics.shadow_map) }
+    };
+    for (const auto &texture : textures) {
+        backend.upload_texture(texture.target, texture.data, texture.size);
+        last_stats.add(texture);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef RENDER_VOXEL_UPLOADER_H
+#define RENDER_VOXEL_UPLOADER_H
+
+#include "upload_backend.h"
+#include "upload_spans.h"
+
+#include "stdint.h"
+#include <cstddef>
+#include <vector>
+
+// AO texture value of an AO block with filled of its voxels occupied
+constexpr uint8_t ao_texel(const int filled) {
+    return 255 * filled / (AO_BLOCK_SIZE * AO_BLOCK_SIZE * AO_BLOCK_SIZE);
+}
+
+/**
+ * @brief One frame's changes to the GPU copy of the voxel data, in the
+ *        order they are applied. Each entry is a range of the staging
+ *        buffer that is copied into a target
+ */
+struct DeltaLog {
+    struct Entry {
+        UploadTarget target;
+        std::size_t staging_offset;
+        std::size_t offset; // Into the target
+        std::size_t size;
+    };
+
+    std::vector<Entry> entries;
+    std::size_t staging_size = 0;
+
+    void clear() {
+        entries.clear();
+        staging_size = 0;
+    }
+
+    void append(const UploadTarget target, const std::size_t offset, const std::size_t size) {
+        entries.push_back(Entry{ target, staging_size, offset, size });
+        staging_size += size;
+    }
+};
+
+/**
+ * @brief Keeps a single GPU copy of color_data, color_flags, the octree LOD
+ *        data, AO and the shadow map up to date. Each frame the changed spans
+ *        (see take_upload_spans) are packed into the staging buffer and
+ *        applied with GPU side copies, in the order of the delta log
+ */
+class VoxelUploader {
+public:
+    /**
+     * @brief Send everything that changed since the last call to backend.
+     *        AO and the shadow map are sent whole
+     */
+    void upload(SimulationGraphics &graphics, UploadBackend &backend);
+
+    // What the last upload sent
+    const UploadStats &stats() const { return last_stats; }
+    const DeltaLog &delta_log() const { return log; }
+
+private:
+    std::vector<UploadSpan> spans; // Reused between frames
+    std::vector<uint8_t> ao_data;
+    DeltaLog log;
+    UploadStats last_stats;
+};
+
+#endif
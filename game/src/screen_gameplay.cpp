@@ -5,6 +5,7 @@
 
 #include "src/render/camera/camera.h"
 #include "src/render/Renderer.h"
+#include "src/render/types/gl_render_backend.h"
 #include "src/simulation/Simulation.h"
 #include "src/simulation/ElementClasses.h"
 
@@ -26,7 +27,8 @@ static RenderCamera render_camera;
 static Simulation sim;
 static BrushRenderer brush_renderer(&sim, &render_camera);
 static HUD hud(&sim, &render_camera);
-static Renderer renderer(&sim, &render_camera);
+static GLRenderBackend render_backend;
+static Renderer renderer(&sim, &render_camera, &render_backend);
 
 static double simTime = 0.0f;
 static double drawTime = 0.0f;
@@ -113,7 +115,7 @@ void ScreenGameplay::update() {
     sim.air.cells[AIR_XRES / 2][2][AIR_ZRES / 2].data[PRESSURE_IDX] = 512.0f;
     // for (int x = 10; x < 100; x += 10)
     //      for (int z = 10; z < 100; z += 10)
-    //      if (sim.pmap[z][90][x] == 0)
+    //      if (sim.pmap(x, 90, z) == 0)
     //          sim.create_part(x, 90, z, 1);
 
     auto t = GetTime();
@@ -1,6 +1,8 @@
 #include "Air.h"
+#include "Simulation.h"
 
 #include <algorithm>
+#include <cmath>
 #include <memory>
 #include <iostream>
 #include <cstring>
@@ -51,6 +53,7 @@ void Air::clear() {
 }
 
 void Air::update() {
+    SimulationStats::ScopedTimer timer(sim.stats, SimPhase::AIR_UPDATE);
     setEdgesAndWalls();
     setPressureFromVelocity();
     setVelocityFromPressure();
@@ -58,6 +61,20 @@ void Air::update() {
     advection();
 
     std::swap(cells, out_cells);
+    wakeMovingTiles();
+}
+
+// Moving air pushes particles (advection), so it keeps their sim tiles awake
+void Air::wakeMovingTiles() {
+    for (coord_t z = 0; z < AIR_ZRES; z++)
+    for (coord_t y = 0; y < AIR_YRES; y++)
+    for (coord_t x = 0; x < AIR_XRES; x++) {
+        const auto &cell = cells[z][y][x];
+        if (std::abs(cell.data[VX_IDX]) > SIM_TILE_SLEEP_AIR_VELOCITY ||
+                std::abs(cell.data[VY_IDX]) > SIM_TILE_SLEEP_AIR_VELOCITY ||
+                std::abs(cell.data[VZ_IDX]) > SIM_TILE_SLEEP_AIR_VELOCITY)
+            sim.wake_tile(TILE_FLAT_IDX(x * AIR_CELL_SIZE, y * AIR_CELL_SIZE, z * AIR_CELL_SIZE));
+    }
 }
 
 
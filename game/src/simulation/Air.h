@@ -41,6 +41,7 @@ private:
     void setVelocityFromPressure();
     void diffusion();
     void advection();
+    void wakeMovingTiles();
 };
 
 
@@ -1,5 +1,7 @@
 #include "ElementClasses.h"
 
+#include <cstdio>
+
 // This is literally stolen from TPT
 std::array<Element, PT_NUM> const &GetElements() {
 	struct DoOnce {
@@ -15,8 +17,9 @@ std::array<Element, PT_NUM> const &GetElements() {
 				bool has_diffusion = el.State == ElementState::TYPE_POWDER || el.State == ElementState::TYPE_LIQUID || el.State == ElementState::TYPE_GAS;
         		if (has_diffusion && el.Causality < el.Diffusion) {
 					el.Causality = el.Diffusion;
-					TraceLog(LOG_WARNING, TextFormat("Element %s has causality (%f) < diffusion (%f), setting causality to diffusion",
-							el.Name.c_str(), el.Causality, el.Diffusion));
+					// Not using raylib's TraceLog, the simulation library is built without raylib
+					fprintf(stderr, "WARNING: Element %s has causality (%u) < diffusion (%f), setting causality to diffusion\n",
+							el.Name.c_str(), el.Causality, el.Diffusion);
 				}
 			}
 		}
@@ -8,7 +8,7 @@
 
 enum class ElementState : uint8_t { TYPE_SOLID, TYPE_POWDER, TYPE_LIQUID, TYPE_GAS, TYPE_ENERGY };
 
-#define UPDATE_FUNC_ARGS Simulation &sim, int i, coord_t x, coord_t y, coord_t z, Particle *parts, pmap_id pmap[ZRES][YRES][XRES]
+#define UPDATE_FUNC_ARGS Simulation &sim, int i, coord_t x, coord_t y, coord_t z, ParticleStore &parts, PartMap &pmap
 #define GRAPHICS_FUNC_ARGS Simulation &sim, const Particle &part, coord_t x, coord_t y, coord_t z, RGBA &color, util::Bitset8 &flags
 
 #endif
\ No newline at end of file
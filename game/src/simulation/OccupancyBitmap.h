@@ -0,0 +1,113 @@
+#ifndef OCCUPANCY_BITMAP_H
+#define OCCUPANCY_BITMAP_H
+
+#include "SimulationDef.h"
+
+#include <atomic>
+
+// Each x row is padded to whole words, so a row never shares a word with another
+constexpr unsigned int OCCUPANCY_ROW_WORDS = (XRES + 63) / 64;
+
+// Coarser levels count the set bits per aligned cube, so empty space can be
+// skipped a cell / block at a time (see Simulation::raycast)
+constexpr unsigned int OCCUPANCY_CELL_SHIFT = 4;  // 16^3 voxels
+constexpr unsigned int OCCUPANCY_BLOCK_SHIFT = 5; // 32^3 voxels
+constexpr unsigned int OCCUPANCY_CELLS_X = (XRES >> OCCUPANCY_CELL_SHIFT) + 1;
+constexpr unsigned int OCCUPANCY_CELLS_Y = (YRES >> OCCUPANCY_CELL_SHIFT) + 1;
+constexpr unsigned int OCCUPANCY_CELLS_Z = (ZRES >> OCCUPANCY_CELL_SHIFT) + 1;
+constexpr unsigned int OCCUPANCY_BLOCKS_X = (XRES >> OCCUPANCY_BLOCK_SHIFT) + 1;
+constexpr unsigned int OCCUPANCY_BLOCKS_Y = (YRES >> OCCUPANCY_BLOCK_SHIFT) + 1;
+constexpr unsigned int OCCUPANCY_BLOCKS_Z = (ZRES >> OCCUPANCY_BLOCK_SHIFT) + 1;
+
+/**
+ * @brief One bit per voxel, set where a map has a part. 1.25 MB at 200^3 so
+ *        emptiness checks usually hit L1 / L2 instead of the 32 bit map, and
+ *        a whole x run can be checked a word at a time
+ *        Bits are updated with atomic or / and since neighboring tiles
+ *        share words, reads are relaxed like reads of the map itself
+ *        Also counts the set bits per 16^3 cell and 32^3 block
+ */
+class OccupancyBitmap {
+public:
+    OccupancyBitmap() { clear_all(); }
+    OccupancyBitmap(const OccupancyBitmap&) = delete;
+    OccupancyBitmap& operator=(const OccupancyBitmap&) = delete;
+
+    bool test(const coord_t x, const coord_t y, const coord_t z) const {
+        return (words[_word(x, y, z)].load(std::memory_order_relaxed) >> (x & 63)) & 1;
+    }
+
+    void set(const coord_t x, const coord_t y, const coord_t z) {
+        const uint64_t bit = uint64_t(1) << (x & 63);
+        if (words[_word(x, y, z)].fetch_or(bit, std::memory_order_relaxed) & bit)
+            return;
+        cell_counts[_cell(x, y, z)].fetch_add(1, std::memory_order_relaxed);
+        block_counts[_block(x, y, z)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void clear(const coord_t x, const coord_t y, const coord_t z) {
+        const uint64_t bit = uint64_t(1) << (x & 63);
+        if (!(words[_word(x, y, z)].fetch_and(~bit, std::memory_order_relaxed) & bit))
+            return;
+        cell_counts[_cell(x, y, z)].fetch_sub(1, std::memory_order_relaxed);
+        block_counts[_block(x, y, z)].fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void clear_all() {
+        for (auto &word : words)
+            word.store(0, std::memory_order_relaxed);
+        for (auto &count : cell_counts)
+            count.store(0, std::memory_order_relaxed);
+        for (auto &count : block_counts)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Whether the 16^3 cell / 32^3 block containing (x, y, z) has no set bits
+     */
+    bool cell_empty(const coord_t x, const coord_t y, const coord_t z) const {
+        return !cell_counts[_cell(x, y, z)].load(std::memory_order_relaxed);
+    }
+    bool block_empty(const coord_t x, const coord_t y, const coord_t z) const {
+        return !block_counts[_block(x, y, z)].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Bits x0 to x1 (inclusive) of row (y, z), shifted so bit 0 is x0
+     *        At most 64 bits, x1 - x0 must be < 64
+     */
+    uint64_t row_bits(const coord_t x0, const coord_t x1, const coord_t y, const coord_t z) const {
+        const unsigned int w0 = x0 >> 6, w1 = x1 >> 6;
+        const unsigned int shift = x0 & 63;
+        const uint64_t mask = (x1 - x0 == 63) ? ~uint64_t(0) : (uint64_t(1) << (x1 - x0 + 1)) - 1;
+        uint64_t bits = words[_word(x0, y, z)].load(std::memory_order_relaxed) >> shift;
+        if (w1 != w0 && shift)
+            bits |= words[_word(x1, y, z)].load(std::memory_order_relaxed) << (64 - shift);
+        return bits & mask;
+    }
+
+    /**
+     * @brief The words, x row (y, z) starts at word (z * YRES + y) * OCCUPANCY_ROW_WORDS.
+     *        For vector code that gathers bits, read them relaxed like test()
+     */
+    const std::atomic<uint64_t> * data() const { return words; }
+
+private:
+    std::atomic<uint64_t> words[OCCUPANCY_ROW_WORDS * YRES * ZRES];
+    std::atomic<uint16_t> cell_counts[OCCUPANCY_CELLS_X * OCCUPANCY_CELLS_Y * OCCUPANCY_CELLS_Z];
+    std::atomic<uint16_t> block_counts[OCCUPANCY_BLOCKS_X * OCCUPANCY_BLOCKS_Y * OCCUPANCY_BLOCKS_Z];
+
+    static uint32_t _word(const coord_t x, const coord_t y, const coord_t z) {
+        return (z * YRES + y) * OCCUPANCY_ROW_WORDS + (x >> 6);
+    }
+    static uint32_t _cell(const coord_t x, const coord_t y, const coord_t z) {
+        return (x >> OCCUPANCY_CELL_SHIFT) + OCCUPANCY_CELLS_X * ((y >> OCCUPANCY_CELL_SHIFT) +
+            OCCUPANCY_CELLS_Y * (z >> OCCUPANCY_CELL_SHIFT));
+    }
+    static uint32_t _block(const coord_t x, const coord_t y, const coord_t z) {
+        return (x >> OCCUPANCY_BLOCK_SHIFT) + OCCUPANCY_BLOCKS_X * ((y >> OCCUPANCY_BLOCK_SHIFT) +
+            OCCUPANCY_BLOCKS_Y * (z >> OCCUPANCY_BLOCK_SHIFT));
+    }
+};
+
+#endif
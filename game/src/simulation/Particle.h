@@ -5,28 +5,469 @@
 #include "../util/types/color.h"
 #include "../util/types/bitset8.h"
 
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#ifdef TPT_COMPACT_PARTICLES
+#include "../util/types/half.h"
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#endif
+
 namespace PartFlags {
     constexpr uint8_t UPDATE_FRAME = 0;
     constexpr uint8_t MOVE_FRAME = 1;
     constexpr uint8_t IS_ENERGY = 2;
+    constexpr uint8_t VELOCITY_FRAME = 3; // Loss / advection applied, same parity rules as UPDATE_FRAME
+}
+
+class ParticleStore;
+
+#ifdef TPT_COMPACT_PARTICLES
+// Compact layout (--compact-particles): positions are 8.8 fixed point (the
+// rounded position is derived from them), velocities are half floats and
+// the rarely used fields live in a side table only allocated where written
+namespace ParticleFields {
+    struct Fixed88 {
+        using storage_t = uint16_t;
+        static float decode(const uint16_t raw) { return raw * (1.0f / 256.0f); }
+        static uint16_t encode(const float value) { return static_cast<uint16_t>(std::clamp(value * 256.0f + 0.5f, 0.0f, 65535.0f)); }
+    };
+    struct Half {
+        using storage_t = uint16_t;
+        static float decode(const uint16_t raw) { return util::half_to_float(raw); }
+        static uint16_t encode(const float value) { return util::float_to_half(value); }
+    };
+
+    /**
+     * @brief Reference to a field stored encoded, reads / writes convert
+     *        to and from T so it can be used like a T &
+     */
+    template <class T, class Codec, bool is_const>
+    class EncodedRef {
+    public:
+        using storage_t = std::conditional_t<is_const, const typename Codec::storage_t, typename Codec::storage_t>;
+
+        explicit EncodedRef(storage_t &raw): raw(raw) {}
+        EncodedRef(const EncodedRef &other) = default;
+
+        operator T() const { return Codec::decode(raw); }
+        EncodedRef &operator=(const T value) requires (!is_const) { raw = Codec::encode(value); return *this; }
+        EncodedRef &operator=(const EncodedRef &other) requires (!is_const) { return *this = static_cast<T>(other); }
+        EncodedRef &operator+=(const T value) requires (!is_const) { return *this = static_cast<T>(*this) + value; }
+        EncodedRef &operator-=(const T value) requires (!is_const) { return *this = static_cast<T>(*this) - value; }
+        EncodedRef &operator*=(const T value) requires (!is_const) { return *this = static_cast<T>(*this) * value; }
+        EncodedRef &operator/=(const T value) requires (!is_const) { return *this = static_cast<T>(*this) / value; }
+    private:
+        storage_t &raw;
+    };
+
+    /**
+     * @brief Rounded coordinate derived from a fixed point position. Assigning
+     *        is a no-op, positions are quantized (see ParticleStore::quantize_position)
+     *        so rounding them always gives what the caller would have stored
+     */
+    template <bool is_const>
+    class RoundedRef {
+    public:
+        using storage_t = std::conditional_t<is_const, const uint16_t, uint16_t>;
+
+        explicit RoundedRef(storage_t &raw): raw(raw) {}
+        RoundedRef(const RoundedRef &other) = default;
+
+        operator coord_t() const { return static_cast<coord_t>((raw + 128u) >> 8); }
+        RoundedRef &operator=(const coord_t value) requires (!is_const) {
+            #ifdef DEBUG
+            if (value != static_cast<coord_t>(*this))
+                throw std::invalid_argument("Rounded position " + std::to_string(value) + " does not match position");
+            #endif
+            (void)value;
+            return *this;
+        }
+    private:
+        storage_t &raw;
+    };
+
+    constexpr unsigned int COLD_PAGE_SIZE = 4096;
+    constexpr unsigned int COLD_PAGE_COUNT = (NPARTS + COLD_PAGE_SIZE - 1) / COLD_PAGE_SIZE;
+
+    struct ColdPage {
+        uint16_t ctype[COLD_PAGE_SIZE];
+        int16_t life[COLD_PAGE_SIZE];
+        float temp[COLD_PAGE_SIZE];
+        uint16_t tmp1[COLD_PAGE_SIZE], tmp2[COLD_PAGE_SIZE];
+        RGBA dcolor[COLD_PAGE_SIZE];
+
+        ColdPage() {
+            std::fill(&ctype[0], &ctype[COLD_PAGE_SIZE], 0);
+            std::fill(&life[0], &life[COLD_PAGE_SIZE], 0);
+            std::fill(&temp[0], &temp[COLD_PAGE_SIZE], 0.0f);
+            std::fill(&tmp1[0], &tmp1[COLD_PAGE_SIZE], 0);
+            std::fill(&tmp2[0], &tmp2[COLD_PAGE_SIZE], 0);
+            std::fill(&dcolor[0], &dcolor[COLD_PAGE_SIZE], RGBA(0, 0, 0, 0));
+        }
+    };
+
+    /**
+     * @brief Cold fields of all particles, in pages allocated on first write
+     *        Reads of unallocated pages see the defaults. Thread safe
+     */
+    class ColdTable {
+    public:
+        ColdTable() {
+            for (auto &page : pages)
+                page.store(nullptr, std::memory_order_relaxed);
+        }
+        ~ColdTable() {
+            for (auto &page : pages)
+                delete page.load(std::memory_order_relaxed);
+        }
+        ColdTable(const ColdTable&) = delete;
+        ColdTable& operator=(const ColdTable&) = delete;
+
+        const ColdPage &read(const part_id i) const {
+            const ColdPage * page = pages[i / COLD_PAGE_SIZE].load(std::memory_order_acquire);
+            return page ? *page : empty_page();
+        }
+
+        ColdPage &write(const part_id i) {
+            auto &slot = pages[i / COLD_PAGE_SIZE];
+            ColdPage * page = slot.load(std::memory_order_acquire);
+            if (!page) {
+                // Another thread may be allocating the same page, only one wins
+                ColdPage * fresh = new ColdPage();
+                if (slot.compare_exchange_strong(page, fresh, std::memory_order_acq_rel))
+                    page = fresh;
+                else
+                    delete fresh;
+            }
+            return *page;
+        }
+
+        /**
+         * @brief Reset the cold fields of part i to the defaults, without
+         *        allocating its page if it has none
+         */
+        void reset(const part_id i) {
+            ColdPage * page = pages[i / COLD_PAGE_SIZE].load(std::memory_order_acquire);
+            if (!page)
+                return;
+            const unsigned int s = i % COLD_PAGE_SIZE;
+            page->ctype[s] = 0;
+            page->life[s] = 0;
+            page->temp[s] = 0.0f;
+            page->tmp1[s] = 0;
+            page->tmp2[s] = 0;
+            page->dcolor[s] = RGBA(0, 0, 0, 0);
+        }
+
+        /**
+         * @brief Renumber like ParticleStore::reorder, part old_ids[k] becomes
+         *        part k + 1. Pages are only allocated where a moved part had
+         *        one, everything else reads as the defaults. Not thread safe
+         */
+        void reorder(const part_id * old_ids, const part_id count) {
+            std::vector<ColdPage *> reordered(COLD_PAGE_COUNT, nullptr);
+            for (part_id k = 0; k < count; k++) {
+                const part_id from = old_ids[k], to = k + 1;
+                const ColdPage * src = pages[from / COLD_PAGE_SIZE].load(std::memory_order_relaxed);
+                if (!src)
+                    continue;
+                ColdPage *& dst = reordered[to / COLD_PAGE_SIZE];
+                if (!dst)
+                    dst = new ColdPage();
+
+                const unsigned int s = from % COLD_PAGE_SIZE, d = to % COLD_PAGE_SIZE;
+                dst->ctype[d] = src->ctype[s];
+                dst->life[d] = src->life[s];
+                dst->temp[d] = src->temp[s];
+                dst->tmp1[d] = src->tmp1[s];
+                dst->tmp2[d] = src->tmp2[s];
+                dst->dcolor[d] = src->dcolor[s];
+            }
+            for (unsigned int page = 0; page < COLD_PAGE_COUNT; page++) {
+                delete pages[page].load(std::memory_order_relaxed);
+                pages[page].store(reordered[page], std::memory_order_relaxed);
+            }
+        }
+
+        std::size_t allocated_bytes() const {
+            std::size_t bytes = 0;
+            for (const auto &page : pages)
+                if (page.load(std::memory_order_relaxed))
+                    bytes += sizeof(ColdPage);
+            return bytes;
+        }
+    private:
+        std::atomic<ColdPage *> pages[COLD_PAGE_COUNT];
+
+        static const ColdPage &empty_page() {
+            static const ColdPage page;
+            return page;
+        }
+    };
+
+    /**
+     * @brief Reference to a cold field of one particle, see ColdTable
+     */
+    template <class T, T (ColdPage::*field)[COLD_PAGE_SIZE], bool is_const>
+    class ColdRef {
+    public:
+        using table_t = std::conditional_t<is_const, const ColdTable, ColdTable>;
+
+        ColdRef(table_t &table, const part_id i): table(table), i(i) {}
+        ColdRef(const ColdRef &other) = default;
+
+        operator T() const { return (table.read(i).*field)[i % COLD_PAGE_SIZE]; }
+        ColdRef &operator=(const T value) requires (!is_const) {
+            (table.write(i).*field)[i % COLD_PAGE_SIZE] = value;
+            return *this;
+        }
+        ColdRef &operator=(const ColdRef &other) requires (!is_const) { return *this = static_cast<T>(other); }
+        ColdRef &operator+=(const T value) requires (!is_const) { return *this = static_cast<T>(*this) + value; }
+        ColdRef &operator-=(const T value) requires (!is_const) { return *this = static_cast<T>(*this) - value; }
+        ColdRef &operator*=(const T value) requires (!is_const) { return *this = static_cast<T>(*this) * value; }
+        ColdRef &operator/=(const T value) requires (!is_const) { return *this = static_cast<T>(*this) / value; }
+    private:
+        table_t &table;
+        const part_id i;
+    };
 }
+#endif
+
+/**
+ * @brief View of a single particle in a ParticleStore, each member is a
+ *        reference into that field's array so part.x etc... work as before
+ *        Cheap to create, only the fields that are used get loaded
+ *        Not copyable, copying a view would alias the same particle
+ *        With the compact layout some members are proxies that convert on
+ *        access instead, read them into a value before passing to varargs
+ * @tparam is_const Whether the fields are read only
+ */
+template <bool is_const>
+struct ParticleRef {
+    template <class T>
+    using field = std::conditional_t<is_const, const T, T> &;
+    using store_t = std::conditional_t<is_const, const ParticleStore, ParticleStore>;
+
+#ifdef TPT_COMPACT_PARTICLES
+    using position_field = ParticleFields::EncodedRef<float, ParticleFields::Fixed88, is_const>;
+    using velocity_field = ParticleFields::EncodedRef<float, ParticleFields::Half, is_const>;
+    using rounded_field = ParticleFields::RoundedRef<is_const>;
+    template <class T, T (ParticleFields::ColdPage::*member)[ParticleFields::COLD_PAGE_SIZE]>
+    using cold_field = ParticleFields::ColdRef<T, member, is_const>;
+
+    field<uint16_t> type;
+    field<part_id> id;
+    field<util::Bitset8> flag;
+
+    cold_field<uint16_t, &ParticleFields::ColdPage::ctype> ctype;
+    cold_field<int16_t, &ParticleFields::ColdPage::life> life;
+    position_field x, y, z;
+    velocity_field vx, vy, vz;
+    rounded_field rx, ry, rz; // Rounded coordinates
+    cold_field<float, &ParticleFields::ColdPage::temp> temp;
+    cold_field<uint16_t, &ParticleFields::ColdPage::tmp1> tmp1;
+    cold_field<uint16_t, &ParticleFields::ColdPage::tmp2> tmp2;
+    cold_field<RGBA, &ParticleFields::ColdPage::dcolor> dcolor;
+#else
+    field<uint16_t> type;
+    field<part_id> id;
+    field<util::Bitset8> flag;
+
+    field<uint16_t> ctype;
+    field<int16_t> life;
+    field<float> x, y, z, vx, vy, vz;
+    field<coord_t> rx, ry, rz; // Rounded coordinates
+    field<float> temp;
+    field<uint16_t> tmp1, tmp2;
+    field<RGBA> dcolor;
+#endif
+
+    ParticleRef(store_t &store, const part_id i);
+    ParticleRef(const ParticleRef&) = delete;
+    ParticleRef& operator=(const ParticleRef&) = delete;
+};
+
+using Particle = ParticleRef<false>;
+using ConstParticle = ParticleRef<true>;
 
-struct Particle {
-    uint16_t type;
-    part_id id;
-    util::Bitset8 flag;
-
-    uint16_t ctype;
-    int16_t life = 0;
-    float x, y, z, vx, vy, vz;
-    coord_t rx, ry, rz; // Rounded coordinates
-    float temp;
-    uint16_t tmp1, tmp2;
-    RGBA dcolor{0, 0, 0, 0};
-
-    Particle(): type(0), id(0) {}
-    Particle(const Particle&) = delete;
-	Particle& operator=(const Particle&) = delete;
+/**
+ * @brief Structure of arrays storage for all particles, one contiguous
+ *        array per field so passes only stream the fields they touch
+ *        Fields used every frame (position, velocity, flags, type) come first
+ *        parts[i] gives a Particle view, or use the arrays directly in hot loops
+ */
+class ParticleStore {
+public:
+#ifdef TPT_COMPACT_PARTICLES
+    // Hot
+    uint16_t x[NPARTS], y[NPARTS], z[NPARTS];    // 8.8 fixed point, rx / ry / rz are derived
+    uint16_t vx[NPARTS], vy[NPARTS], vz[NPARTS]; // Half floats
+    util::Bitset8 flag[NPARTS];
+    uint16_t type[NPARTS];
+    part_id id[NPARTS];
+
+    // Cold
+    ParticleFields::ColdTable cold;
+#else
+    // Hot
+    float x[NPARTS], y[NPARTS], z[NPARTS];
+    float vx[NPARTS], vy[NPARTS], vz[NPARTS];
+    coord_t rx[NPARTS], ry[NPARTS], rz[NPARTS];
+    util::Bitset8 flag[NPARTS];
+    uint16_t type[NPARTS];
+
+    // Cold
+    part_id id[NPARTS];
+    uint16_t ctype[NPARTS];
+    int16_t life[NPARTS];
+    float temp[NPARTS];
+    uint16_t tmp1[NPARTS], tmp2[NPARTS];
+    RGBA dcolor[NPARTS];
+#endif
+
+    ParticleStore() {
+        std::fill(&type[0], &type[NPARTS], 0);
+        std::fill(&id[0], &id[NPARTS], 0);
+#ifndef TPT_COMPACT_PARTICLES
+        std::fill(&ctype[0], &ctype[NPARTS], 0);
+        std::fill(&life[0], &life[NPARTS], 0);
+        std::fill(&temp[0], &temp[NPARTS], 0.0f);
+        std::fill(&tmp1[0], &tmp1[NPARTS], 0);
+        std::fill(&tmp2[0], &tmp2[NPARTS], 0);
+        std::fill(&dcolor[0], &dcolor[NPARTS], RGBA(0, 0, 0, 0));
+#endif
+    }
+    ParticleStore(const ParticleStore&) = delete;
+    ParticleStore& operator=(const ParticleStore&) = delete;
+
+    Particle operator[](const part_id i) { return Particle(*this, i); }
+    ConstParticle operator[](const part_id i) const { return ConstParticle(*this, i); }
+
+    /**
+     * @brief Swap the positions (exact and rounded) of two parts
+     */
+    void swap_positions(const part_id a, const part_id b) {
+        std::swap(x[a], x[b]);
+        std::swap(y[a], y[b]);
+        std::swap(z[a], z[b]);
+#ifndef TPT_COMPACT_PARTICLES
+        std::swap(rx[a], rx[b]);
+        std::swap(ry[a], ry[b]);
+        std::swap(rz[a], rz[b]);
+#endif
+    }
+
+    /**
+     * @brief Reset the cold fields (ctype, life, temp, tmp1, tmp2, dcolor)
+     *        of part i, slots are reused so a new part must not inherit them
+     */
+    void reset_cold(const part_id i) {
+#ifdef TPT_COMPACT_PARTICLES
+        cold.reset(i);
+#else
+        ctype[i] = 0;
+        life[i] = 0;
+        temp[i] = 0.0f;
+        tmp1[i] = 0;
+        tmp2[i] = 0;
+        dcolor[i] = RGBA(0, 0, 0, 0);
+#endif
+    }
+
+    /**
+     * @brief Round a position component to what the store can represent,
+     *        positions must go through this before their rounded coordinate
+     *        is computed, so the two agree
+     */
+    static float quantize_position(const float value) {
+#ifdef TPT_COMPACT_PARTICLES
+        return ParticleFields::Fixed88::decode(ParticleFields::Fixed88::encode(value));
+#else
+        return value;
+#endif
+    }
+
+    /**
+     * @brief Renumber parts: part old_ids[k] becomes part k + 1 (and its id
+     *        field is updated to match). Parts count + 1 to old_max are left dead
+     *        Call outside of a parallel region, it starts its own
+     * @param old_ids Distinct live part ids, in their new order
+     * @param count Length of old_ids
+     * @param old_max One past the highest live id before the call
+     */
+    void reorder(const part_id * old_ids, const part_id count, const part_id old_max) {
+        _reorder_field(x, old_ids, count);
+        _reorder_field(y, old_ids, count);
+        _reorder_field(z, old_ids, count);
+        _reorder_field(vx, old_ids, count);
+        _reorder_field(vy, old_ids, count);
+        _reorder_field(vz, old_ids, count);
+        _reorder_field(flag, old_ids, count);
+        _reorder_field(type, old_ids, count);
+#ifdef TPT_COMPACT_PARTICLES
+        cold.reorder(old_ids, count);
+#else
+        _reorder_field(rx, old_ids, count);
+        _reorder_field(ry, old_ids, count);
+        _reorder_field(rz, old_ids, count);
+        _reorder_field(ctype, old_ids, count);
+        _reorder_field(life, old_ids, count);
+        _reorder_field(temp, old_ids, count);
+        _reorder_field(tmp1, old_ids, count);
+        _reorder_field(tmp2, old_ids, count);
+        _reorder_field(dcolor, old_ids, count);
+#endif
+        for (part_id i = 1; i <= count; i++)
+            id[i] = i;
+        for (part_id i = count + 1; i < old_max; i++)
+            type[i] = 0;
+    }
+
+    /**
+     * @brief Bytes used by particle storage, including allocated side tables
+     */
+    std::size_t memory_bytes() const {
+#ifdef TPT_COMPACT_PARTICLES
+        return sizeof(ParticleStore) + cold.allocated_bytes();
+#else
+        return sizeof(ParticleStore);
+#endif
+    }
+
+private:
+    // Gather into a temporary, the new order may read any slot
+    template <class T>
+    static void _reorder_field(T * field, const part_id * old_ids, const part_id count) {
+        std::vector<T> reordered(count);
+        #pragma omp parallel for schedule(static)
+        for (part_id k = 0; k < count; k++)
+            reordered[k] = field[old_ids[k]];
+        std::copy(reordered.begin(), reordered.end(), field + 1);
+    }
 };
 
-#endif
\ No newline at end of file
+template <bool is_const>
+inline ParticleRef<is_const>::ParticleRef(store_t &store, const part_id i):
+#ifdef TPT_COMPACT_PARTICLES
+    type(store.type[i]), id(store.id[i]), flag(store.flag[i]),
+    ctype(store.cold, i), life(store.cold, i),
+    x(store.x[i]), y(store.y[i]), z(store.z[i]),
+    vx(store.vx[i]), vy(store.vy[i]), vz(store.vz[i]),
+    rx(store.x[i]), ry(store.y[i]), rz(store.z[i]),
+    temp(store.cold, i), tmp1(store.cold, i), tmp2(store.cold, i),
+    dcolor(store.cold, i) {}
+#else
+    type(store.type[i]), id(store.id[i]), flag(store.flag[i]),
+    ctype(store.ctype[i]), life(store.life[i]),
+    x(store.x[i]), y(store.y[i]), z(store.z[i]),
+    vx(store.vx[i]), vy(store.vy[i]), vz(store.vz[i]),
+    rx(store.rx[i]), ry(store.ry[i]), rz(store.rz[i]),
+    temp(store.temp[i]), tmp1(store.tmp1[i]), tmp2(store.tmp2[i]),
+    dcolor(store.dcolor[i]) {}
+#endif
+
+#endif
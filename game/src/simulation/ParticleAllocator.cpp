@@ -0,0 +1,83 @@
+#include "ParticleAllocator.h"
+
+#include <algorithm>
+
+// Id 0 is never handed out, it means "no part" in pmap and elsewhere
+ParticleAllocator::ParticleAllocator(): next_unused(1) {}
+
+void ParticleAllocator::set_thread_count(const unsigned int thread_count) {
+    if (thread_count < thread_free.size())
+        flush();
+    thread_free.resize(thread_count);
+}
+
+part_id ParticleAllocator::allocate(const unsigned int tid) {
+    if (tid >= thread_free.size())
+        return _allocate_shared();
+
+    auto &ids = thread_free[tid].ids;
+    if (ids.empty()) {
+        // Refill a batch at once so the mutex is rarely taken
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        const std::size_t count = std::min(BATCH_SIZE, shared_free.size());
+        ids.insert(ids.end(), shared_free.end() - count, shared_free.end());
+        shared_free.resize(shared_free.size() - count);
+    }
+    if (ids.empty())
+        return _allocate_unused();
+
+    const part_id i = ids.back();
+    ids.pop_back();
+    return i;
+}
+
+void ParticleAllocator::free(const unsigned int tid, const part_id i) {
+    if (tid >= thread_free.size()) {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        shared_free.push_back(i);
+        return;
+    }
+
+    auto &ids = thread_free[tid].ids;
+    ids.push_back(i);
+    if (ids.size() >= 2 * BATCH_SIZE) {
+        // Keep the most recently freed ids (still in cache) for this thread
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        shared_free.insert(shared_free.end(), ids.begin(), ids.begin() + BATCH_SIZE);
+        ids.erase(ids.begin(), ids.begin() + BATCH_SIZE);
+    }
+}
+
+void ParticleAllocator::flush() {
+    for (auto &list : thread_free) {
+        shared_free.insert(shared_free.end(), list.ids.begin(), list.ids.end());
+        list.ids.clear();
+    }
+}
+
+void ParticleAllocator::reset(const part_id first_unused) {
+    for (auto &list : thread_free)
+        list.ids.clear();
+    shared_free.clear();
+    next_unused.store(std::max(first_unused, 1), std::memory_order_relaxed);
+}
+
+part_id ParticleAllocator::_allocate_shared() {
+    {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        if (!shared_free.empty()) {
+            const part_id i = shared_free.back();
+            shared_free.pop_back();
+            return i;
+        }
+    }
+    return _allocate_unused();
+}
+
+part_id ParticleAllocator::_allocate_unused() {
+    // Check first so failed calls once full don't keep growing the counter
+    if (next_unused.load(std::memory_order_relaxed) >= static_cast<part_id>(NPARTS))
+        return PartErr::PARTS_FULL;
+    const part_id i = next_unused.fetch_add(1, std::memory_order_relaxed);
+    return i < static_cast<part_id>(NPARTS) ? i : PartErr::PARTS_FULL;
+}
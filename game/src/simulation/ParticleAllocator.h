@@ -0,0 +1,89 @@
+#ifndef PARTICLE_ALLOCATOR_H
+#define PARTICLE_ALLOCATOR_H
+
+#include "SimulationDef.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Hands out particle ids, safe to use from element updates running
+ *        on the simulation threads. Each thread keeps its own free list,
+ *        moving batches to / from a shared list (behind a mutex) when its own
+ *        runs dry or grows too large. Ids that were never used come from
+ *        an atomic counter
+ *
+ * Usage:
+ * allocator.set_thread_count(n); // Outside the parallel region
+ * const part_id i = allocator.allocate(tid);
+ * allocator.free(tid, i);
+ * allocator.flush(); // Between frames, so no free id is stuck with a thread
+ */
+class ParticleAllocator {
+public:
+    ParticleAllocator();
+
+    ParticleAllocator(const ParticleAllocator &other) = delete;
+    ParticleAllocator &operator=(const ParticleAllocator &other) = delete;
+
+    /**
+     * @brief Number of threads that may call allocate() / free(), other
+     *        thread numbers fall back to the shared list. Not thread safe
+     */
+    void set_thread_count(const unsigned int thread_count);
+
+    /**
+     * @brief Get an unused id, freed ids are reused before new ones. Which
+     *        freed id depends on what the calling thread freed and on the
+     *        order threads flushed, so it is not deterministic across thread
+     *        counts (and neither are the CounterRNG streams keyed by it)
+     * @param tid Thread number of the calling thread
+     * @return part_id Id > 0, or PartErr::PARTS_FULL
+     */
+    part_id allocate(const unsigned int tid);
+
+    /**
+     * @brief Return an id from allocate(), the part must already be dead
+     * @param tid Thread number of the calling thread
+     */
+    void free(const unsigned int tid, const part_id i);
+
+    /**
+     * @brief Move every thread's free ids to the shared list. Not thread safe
+     */
+    void flush();
+
+    /**
+     * @brief Forget every free id, afterwards ids are handed out from
+     *        first_unused upwards. For when ids below it are all in use
+     *        (see Simulation::compact_parts). Not thread safe
+     */
+    void reset(const part_id first_unused);
+
+    /**
+     * @brief One past the highest id ever handed out
+     */
+    part_id high_water() const {
+        return std::min(next_unused.load(std::memory_order_relaxed), static_cast<part_id>(NPARTS));
+    }
+
+private:
+    // Ids moved between a thread and the shared list at a time
+    static constexpr std::size_t BATCH_SIZE = 256;
+
+    struct alignas(64) ThreadFreeList {
+        std::vector<part_id> ids;
+    };
+
+    std::vector<ThreadFreeList> thread_free;
+    std::vector<part_id> shared_free;
+    std::mutex shared_mutex;
+    std::atomic<part_id> next_unused;
+
+    part_id _allocate_shared();
+    part_id _allocate_unused();
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include "ParticleKernels.h"
+#include "Air.h"
+
+#include <cmath>
+#include <cstddef>
+
+// The vector paths gather the raw float / coord_t arrays, the compact layout
+// (TPT_COMPACT_PARTICLES) encodes those so it only has the scalar path
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(TPT_COMPACT_PARTICLES)
+#define PARTICLE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// The vector paths gather 32 bits at a time from the uint16_t / uint8_t field
+// arrays, so up to 3 bytes past the last element are read. Those must still be
+// inside the store (they are discarded)
+#ifdef PARTICLE_KERNELS_X86
+static_assert(offsetof(ParticleStore, rx) < offsetof(ParticleStore, ry) &&
+    offsetof(ParticleStore, ry) < offsetof(ParticleStore, rz) &&
+    offsetof(ParticleStore, rz) < offsetof(ParticleStore, flag) &&
+    offsetof(ParticleStore, type) < offsetof(ParticleStore, id),
+    "Kernels over-read the small fields of ParticleStore, they can't be the last member");
+#endif
+static_assert(AIR_CELL_SIZE == 4, "Vector kernels divide by AIR_CELL_SIZE with a shift by 2");
+static_assert(sizeof(AirCell) == 4 * sizeof(float), "Vector kernels index AirCell as 4 floats");
+
+namespace ParticleKernels {
+    static void integrate_velocity_scalar(ParticleStore &parts, const part_id * ids, const unsigned int count,
+            const Air &air, const ElementTables &tables) {
+        for (unsigned int k = 0; k < count; k++) {
+            auto part = parts[ids[k]];
+            const uint16_t type = part.type;
+
+            part.vx *= tables.loss[type];
+            part.vy *= tables.loss[type];
+            part.vz *= tables.loss[type];
+
+            // Fused like the vector paths, so every ISA gives the same bits
+            const float advection = tables.advection[type];
+            if (advection) {
+                const coord_t x = part.rx, y = part.ry, z = part.rz;
+                const auto &cell = air.cells[z / AIR_CELL_SIZE][y / AIR_CELL_SIZE][x / AIR_CELL_SIZE];
+                part.vx = std::fma(advection, cell.data[VX_IDX], static_cast<float>(part.vx));
+                part.vy = std::fma(advection, cell.data[VY_IDX], static_cast<float>(part.vy));
+                part.vz = std::fma(advection, cell.data[VZ_IDX], static_cast<float>(part.vz));
+            }
+        }
+    }
+
+#ifdef PARTICLE_KERNELS_X86
+    __attribute__((target("avx2,fma")))
+    static void integrate_velocity_avx2(ParticleStore &parts, const part_id * ids, const unsigned int count,
+            const Air &air, const ElementTables &tables) {
+        const float * air_base = &air.cells[0][0][0].data[0];
+        const __m256i mask_u8 = _mm256_set1_epi32(0xFF);
+        const __m256i mask_u16 = _mm256_set1_epi32(0xFFFF);
+        const __m256i air_stride_y = _mm256_set1_epi32(AIR_XRES * 4);
+        const __m256i air_stride_z = _mm256_set1_epi32(AIR_YRES * AIR_XRES * 4);
+
+        unsigned int k = 0;
+        for (; k + 8 <= count; k += 8) {
+            const __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ids + k));
+            const __m256i type = _mm256_and_si256(
+                _mm256_i32gather_epi32(reinterpret_cast<const int *>(parts.type), idx, 2), mask_u16);
+            const __m256 loss = _mm256_i32gather_ps(tables.loss, type, 4);
+            const __m256 advection = _mm256_i32gather_ps(tables.advection, type, 4);
+
+            __m256 vx = _mm256_mul_ps(_mm256_i32gather_ps(parts.vx, idx, 4), loss);
+            __m256 vy = _mm256_mul_ps(_mm256_i32gather_ps(parts.vy, idx, 4), loss);
+            __m256 vz = _mm256_mul_ps(_mm256_i32gather_ps(parts.vz, idx, 4), loss);
+
+            // Only sample air for lanes that have advection, like the scalar path
+            const __m256 has_advection = _mm256_cmp_ps(advection, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+            if (!_mm256_testz_ps(has_advection, has_advection)) {
+                const __m256i rx = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(parts.rx), idx, 1), mask_u8);
+                const __m256i ry = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(parts.ry), idx, 1), mask_u8);
+                const __m256i rz = _mm256_and_si256(_mm256_i32gather_epi32(reinterpret_cast<const int *>(parts.rz), idx, 1), mask_u8);
+
+                // Float offset of the cell: (x / 4) * 4 + (y / 4) * stride_y + (z / 4) * stride_z
+                const __m256i cell = _mm256_add_epi32(
+                    _mm256_slli_epi32(_mm256_srli_epi32(rx, 2), 2),
+                    _mm256_add_epi32(
+                        _mm256_mullo_epi32(_mm256_srli_epi32(ry, 2), air_stride_y),
+                        _mm256_mullo_epi32(_mm256_srli_epi32(rz, 2), air_stride_z)));
+
+                // Lanes without advection keep their velocity as is (adding 0 would turn -0 into 0)
+                const __m256 zero = _mm256_setzero_ps();
+                vx = _mm256_blendv_ps(vx, _mm256_fmadd_ps(advection, _mm256_mask_i32gather_ps(zero, air_base + VX_IDX, cell, has_advection, 4), vx), has_advection);
+                vy = _mm256_blendv_ps(vy, _mm256_fmadd_ps(advection, _mm256_mask_i32gather_ps(zero, air_base + VY_IDX, cell, has_advection, 4), vy), has_advection);
+                vz = _mm256_blendv_ps(vz, _mm256_fmadd_ps(advection, _mm256_mask_i32gather_ps(zero, air_base + VZ_IDX, cell, has_advection, 4), vz), has_advection);
+            }
+
+            // No scatter in AVX2
+            alignas(32) float out_x[8], out_y[8], out_z[8];
+            _mm256_store_ps(out_x, vx);
+            _mm256_store_ps(out_y, vy);
+            _mm256_store_ps(out_z, vz);
+            for (unsigned int j = 0; j < 8; j++) {
+                parts.vx[ids[k + j]] = out_x[j];
+                parts.vy[ids[k + j]] = out_y[j];
+                parts.vz[ids[k + j]] = out_z[j];
+            }
+        }
+        integrate_velocity_scalar(parts, ids + k, count - k, air, tables);
+    }
+
+    __attribute__((target("avx512f")))
+    static void integrate_velocity_avx512(ParticleStore &parts, const part_id * ids, const unsigned int count,
+            const Air &air, const ElementTables &tables) {
+        const float * air_base = &air.cells[0][0][0].data[0];
+        const __m512i mask_u8 = _mm512_set1_epi32(0xFF);
+        const __m512i mask_u16 = _mm512_set1_epi32(0xFFFF);
+        const __m512i air_stride_y = _mm512_set1_epi32(AIR_XRES * 4);
+        const __m512i air_stride_z = _mm512_set1_epi32(AIR_YRES * AIR_XRES * 4);
+
+        unsigned int k = 0;
+        for (; k + 16 <= count; k += 16) {
+            const __m512i idx = _mm512_loadu_si512(ids + k);
+            const __m512i type = _mm512_and_si512(_mm512_i32gather_epi32(idx, parts.type, 2), mask_u16);
+            const __m512 loss = _mm512_i32gather_ps(type, tables.loss, 4);
+            const __m512 advection = _mm512_i32gather_ps(type, tables.advection, 4);
+
+            __m512 vx = _mm512_mul_ps(_mm512_i32gather_ps(idx, parts.vx, 4), loss);
+            __m512 vy = _mm512_mul_ps(_mm512_i32gather_ps(idx, parts.vy, 4), loss);
+            __m512 vz = _mm512_mul_ps(_mm512_i32gather_ps(idx, parts.vz, 4), loss);
+
+            const __mmask16 has_advection = _mm512_cmp_ps_mask(advection, _mm512_setzero_ps(), _CMP_NEQ_OQ);
+            if (has_advection) {
+                const __m512i rx = _mm512_and_si512(_mm512_i32gather_epi32(idx, parts.rx, 1), mask_u8);
+                const __m512i ry = _mm512_and_si512(_mm512_i32gather_epi32(idx, parts.ry, 1), mask_u8);
+                const __m512i rz = _mm512_and_si512(_mm512_i32gather_epi32(idx, parts.rz, 1), mask_u8);
+
+                const __m512i cell = _mm512_add_epi32(
+                    _mm512_slli_epi32(_mm512_srli_epi32(rx, 2), 2),
+                    _mm512_add_epi32(
+                        _mm512_mullo_epi32(_mm512_srli_epi32(ry, 2), air_stride_y),
+                        _mm512_mullo_epi32(_mm512_srli_epi32(rz, 2), air_stride_z)));
+
+                const __m512 zero = _mm512_setzero_ps();
+                vx = _mm512_mask3_fmadd_ps(advection, _mm512_mask_i32gather_ps(zero, has_advection, cell, air_base + VX_IDX, 4), vx, has_advection);
+                vy = _mm512_mask3_fmadd_ps(advection, _mm512_mask_i32gather_ps(zero, has_advection, cell, air_base + VY_IDX, 4), vy, has_advection);
+                vz = _mm512_mask3_fmadd_ps(advection, _mm512_mask_i32gather_ps(zero, has_advection, cell, air_base + VZ_IDX, 4), vz, has_advection);
+            }
+
+            _mm512_i32scatter_ps(parts.vx, idx, vx, 4);
+            _mm512_i32scatter_ps(parts.vy, idx, vy, 4);
+            _mm512_i32scatter_ps(parts.vz, idx, vz, 4);
+        }
+        integrate_velocity_scalar(parts, ids + k, count - k, air, tables);
+    }
+#endif
+
+    ISA detect_isa() {
+#ifdef PARTICLE_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return ISA::AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return ISA::AVX2;
+#endif
+        return ISA::SCALAR;
+    }
+
+    static ISA current_isa = detect_isa();
+
+    ISA active_isa() { return current_isa; }
+
+    bool set_isa(const ISA isa) {
+        if (static_cast<int>(isa) > static_cast<int>(detect_isa()))
+            return false;
+        current_isa = isa;
+        return true;
+    }
+
+    const char * isa_name(const ISA isa) {
+        switch (isa) {
+            case ISA::SCALAR: return "scalar";
+            case ISA::AVX2:   return "avx2";
+            case ISA::AVX512: return "avx512";
+        }
+        return "unknown";
+    }
+
+    void integrate_velocity(ParticleStore &parts, const part_id * ids, const unsigned int count,
+            const Air &air, const ElementTables &tables) {
+        switch (current_isa) {
+#ifdef PARTICLE_KERNELS_X86
+            case ISA::AVX512:
+                integrate_velocity_avx512(parts, ids, count, air, tables);
+                return;
+            case ISA::AVX2:
+                integrate_velocity_avx2(parts, ids, count, air, tables);
+                return;
+#endif
+            default:
+                integrate_velocity_scalar(parts, ids, count, air, tables);
+                return;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef PARTICLE_KERNELS_H
+#define PARTICLE_KERNELS_H
+
+#include "SimulationDef.h"
+#include "Particle.h"
+
+class Air;
+
+/**
+ * @brief Batched per-particle math that used to run one part at a time in
+ *        update_part. Each kernel has a scalar version plus AVX2 / AVX-512
+ *        versions on x86-64 GCC / Clang, the best one the CPU supports is
+ *        picked at startup (can be overridden with set_isa for comparisons)
+ */
+namespace ParticleKernels {
+    enum class ISA {
+        SCALAR = 0,
+        AVX2 = 1,
+        AVX512 = 2
+    };
+
+    // Per element constants used by the kernels, indexed by type
+    struct ElementTables {
+        float loss[ELEMENT_COUNT + 1];
+        float advection[ELEMENT_COUNT + 1];
+    };
+
+    /**
+     * @brief Air loss then advection for the given parts:
+     *        v = v * Loss + Advection * air velocity of the part's air cell
+     * @param parts Particle storage
+     * @param ids Parts to integrate, no duplicates
+     * @param count Number of ids
+     * @param air Air to sample advection from
+     * @param tables Per element loss / advection
+     */
+    void integrate_velocity(ParticleStore &parts, const part_id * ids, const unsigned int count,
+        const Air &air, const ElementTables &tables);
+
+    ISA detect_isa();
+    ISA active_isa();
+
+    /**
+     * @brief Force a code path, fails if the CPU doesn't support it
+     * @return Whether the ISA is now active
+     */
+    bool set_isa(const ISA isa);
+    const char * isa_name(const ISA isa);
+}
+
+#endif
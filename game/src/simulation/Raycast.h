@@ -11,6 +11,9 @@ namespace RayCast {
     const RayHitFace FACE_Z = 0b100;
 }
 
+// Rays Simulation::raycast_packet steps at a time, the lanes of an AVX-512 register
+constexpr unsigned int RAYCAST_PACKET_LANES = 16;
+
 struct RaycastInput {
     coord_t x, y, z;
     float vx, vy, vz;
@@ -3,6 +3,7 @@
 #include "ElementDefs.h"
 #include "../util/vector_op.h"
 #include "../util/math.h"
+#include "../util/profiler.h"
 
 #include <omp.h>
 #include <algorithm>
@@ -15,16 +16,27 @@
 
 Simulation::Simulation():
     paused(false),
+    auto_compact(true),
+    raycast_skip_empty(false),
+    raycast_packets(true),
+    ballistic_energy(true),
     air(*this)
 {
-    std::fill(&pmap[0][0][0], &pmap[ZRES][YRES][XRES], 0);
-    std::fill(&photons[0][0][0], &photons[ZRES][YRES][XRES], 0);
+    pmap.clear();
+    photons.clear();
 
-    std::fill(&max_y_per_zslice[0], &max_y_per_zslice[ZRES - 2], YRES - 1);
-    std::fill(&min_y_per_zslice[0], &min_y_per_zslice[ZRES - 2], 1);
+    // Empty slices have min > max, so nothing is scanned
+    std::fill(&max_y_per_zslice[0], &max_y_per_zslice[ZRES - 2], 0);
+    std::fill(&min_y_per_zslice[0], &min_y_per_zslice[ZRES - 2], YRES - 1);
+    std::fill(&zslice_row_parts[0][0], &zslice_row_parts[ZRES - 3][YRES], 0);
+    std::fill(&tile_part_count[0], &tile_part_count[SIM_TILE_COUNT], 0);
+    std::fill(&tile_occupied[0], &tile_occupied[SIM_TILE_COUNT], 0);
+    std::fill(&tile_awake[0], &tile_awake[SIM_TILE_COUNT], 0);
+    for (auto &activity : tile_activity)
+        activity.store(0, std::memory_order_relaxed);
+    wake_all_tiles();
     // std::fill(&parts[0], &parts[NPARTS], 0);
 
-    pfree = 1;
     maxId = 0;
     frame_count = 0;
     parts_count = 0;
@@ -34,15 +46,18 @@ Simulation::Simulation():
     
 
     // ---- Threads ------
-    constexpr int MIN_CASUALITY_RADIUS = 4; // Width of each slice = 2 * this
-    constexpr int MAX_THREADS = ZRES / (4 * MIN_CASUALITY_RADIUS); // Threads = number of slices / 2
-
-    sim_thread_count = std::min(omp_get_max_threads(), MAX_THREADS);
-    max_ok_causality_range = ZRES / (sim_thread_count * 4);
+    // Thread count is not limited by the sim size, tiles are handed out
+    // dynamically. Causality is instead limited by the tile size
+    sim_thread_count = omp_get_max_threads();
+    max_ok_causality_range = SIM_TILE_CAUSALITY;
     actual_thread_count = 0;
+    thread_scratch.resize(sim_thread_count);
+    part_allocator.set_thread_count(sim_thread_count);
+    color_resolved.assign(X_BLOCKS * Y_BLOCKS * Z_BLOCKS * COLOR_RESOLVED_BLOCK_WORDS, 0);
 
     // TODO: singleton?
     _init_can_move();
+    _init_element_tables();
 }
 
 Simulation::~Simulation() {}
@@ -67,10 +82,75 @@ void Simulation::_init_can_move() {
                 can_move[movingType][destinationType] = PartSwapBehavior::OCCUPY_SAME;
         }
     }
+
+    // Only energy parts are in photons, eval_move turns SPECIAL into NOOP
+    for (movingType = 0; movingType <= ELEMENT_COUNT; movingType++) {
+        photons_can_stop[movingType] = false;
+        for (destinationType = 1; destinationType <= ELEMENT_COUNT; destinationType++)
+            if (elements[destinationType].State == ElementState::TYPE_ENERGY &&
+                    (can_move[movingType][destinationType] == PartSwapBehavior::NOOP ||
+                     can_move[movingType][destinationType] == PartSwapBehavior::SPECIAL))
+                photons_can_stop[movingType] = true;
+    }
+
+    // Ballistic energy parts fly straight until they bounce off matter, which
+    // they never displace: no Update / Graphics of their own and air / loss
+    // leave their velocity alone (move_behavior does nothing for energy)
+    // Nothing they do changes pmap, see _update_energy_parts
+    ballistic_types[PT_NONE] = false;
+    for (movingType = 1; movingType <= ELEMENT_COUNT; movingType++) {
+        const auto &el = elements[movingType];
+        bool ballistic = el.State == ElementState::TYPE_ENERGY && !el.Update && !el.Graphics &&
+            el.Loss == 1.0f && el.Advection == 0.0f;
+        for (destinationType = 1; destinationType <= ELEMENT_COUNT; destinationType++)
+            if (elements[destinationType].State != ElementState::TYPE_ENERGY &&
+                    can_move[movingType][destinationType] != PartSwapBehavior::NOOP)
+                ballistic = false;
+        ballistic_types[movingType] = ballistic;
+    }
+
+    energy_wakes_tiles = false;
+    for (movingType = 1; movingType <= ELEMENT_COUNT; movingType++)
+        for (destinationType = 1; destinationType <= ELEMENT_COUNT; destinationType++)
+            if (elements[movingType].State != ElementState::TYPE_ENERGY && ballistic_types[destinationType] &&
+                    (can_move[movingType][destinationType] == PartSwapBehavior::NOOP ||
+                     can_move[movingType][destinationType] == PartSwapBehavior::SPECIAL))
+                energy_wakes_tiles = true;
+}
+
+void Simulation::_init_element_tables() {
+    const auto &elements = GetElements();
+    for (ElementType type = 0; type <= ELEMENT_COUNT; type++) {
+        element_tables.loss[type] = elements[type].Loss;
+        element_tables.advection[type] = elements[type].Advection;
+    }
 }
 
 void Simulation::cycle_gravity_mode() {
     gravity_mode = static_cast<GravityMode>( ((int)gravity_mode + 1) % 3 );
+    wake_all_tiles(); // Settled parts aren't settled in the new direction
+}
+
+/**
+ * @brief Wake the tile containing (x, y, z) and any tile within
+ *        one voxel of it, since parts there could now move into / out of it
+ */
+void Simulation::wake_tiles_near(const coord_t x, const coord_t y, const coord_t z) {
+    const unsigned int tx0 = (x > 0 ? x - 1 : 0) / SIM_TILE_DIM;
+    const unsigned int ty0 = (y > 0 ? y - 1 : 0) / SIM_TILE_DIM;
+    const unsigned int tz0 = (z > 0 ? z - 1 : 0) / SIM_TILE_DIM;
+    const unsigned int tx1 = std::min(x + 1u, XRES - 1u) / SIM_TILE_DIM;
+    const unsigned int ty1 = std::min(y + 1u, YRES - 1u) / SIM_TILE_DIM;
+    const unsigned int tz1 = std::min(z + 1u, ZRES - 1u) / SIM_TILE_DIM;
+
+    for (unsigned int tz = tz0; tz <= tz1; tz++)
+    for (unsigned int ty = ty0; ty <= ty1; ty++)
+    for (unsigned int tx = tx0; tx <= tx1; tx++)
+        wake_tile(tx + ty * SIM_TILES_X + tz * SIM_TILES_X * SIM_TILES_Y);
+}
+
+void Simulation::wake_all_tiles() {
+    std::fill(&tile_quiet_frames[0], &tile_quiet_frames[SIM_TILE_COUNT], 0);
 }
 
 part_id Simulation::create_part(const coord_t x, const coord_t y, const coord_t z, const ElementType type) {
@@ -81,94 +161,148 @@ part_id Simulation::create_part(const coord_t x, const coord_t y, const coord_t
     #endif
 
     auto is_energy = GetElements()[type].State == ElementState::TYPE_ENERGY;
-    const auto part_map = is_energy ? photons : pmap;
+    auto &part_map = is_energy ? photons : pmap;
 
-    if (part_map[z][y][x]) return PartErr::ALREADY_OCCUPIED;
-    if (pfree >= NPARTS) return PartErr::PARTS_FULL;
+    if (part_map(x, y, z)) return PartErr::ALREADY_OCCUPIED;
+    const part_id i = part_allocator.allocate(omp_get_thread_num());
+    if (i < 0) return i;
 
     // Create new part
     // Note: should it allow creation off screen? TODO
-    const part_id next_pfree = parts[pfree].id < 0 ? -parts[pfree].id : pfree + 1;
-    const part_id old_pfree = pfree;
-
-    parts[pfree].flag[PartFlags::UPDATE_FRAME] = 1 - (frame_count & 1);
-    parts[pfree].flag[PartFlags::MOVE_FRAME]   = 1 - (frame_count & 1);
-    parts[pfree].flag[PartFlags::IS_ENERGY]    = is_energy;
-
-    parts[pfree].id = pfree;
-    parts[pfree].type = type;
-    parts[pfree].x = x;
-    parts[pfree].y = y;
-    parts[pfree].z = z;
-    parts[pfree].rx = x;
-    parts[pfree].ry = y;
-    parts[pfree].rz = z;
-    parts[pfree].vx = 0.0f;
-    parts[pfree].vy = 0.0f;
-    parts[pfree].vz = 0.0f;
-    if (paused) {
-        if (_should_do_lighting(parts[pfree])) {
-            graphics.ao_blocks[AO_FLAT_IDX(x, y, z)]++;
-            _update_shadow_map(x, y, z);
-        }
-        parts_count++;
-    }
-
-    part_map[z][y][x] = PMAP(type, pfree);
-    _set_color_data_at(x, y, z, &parts[pfree]);
-
-    maxId = std::max(maxId, pfree + 1);
-    pfree = next_pfree;
-    return old_pfree;
+    parts[i].flag[PartFlags::UPDATE_FRAME] = 1 - (frame_count & 1);
+    parts[i].flag[PartFlags::MOVE_FRAME]   = 1 - (frame_count & 1);
+    parts[i].flag[PartFlags::VELOCITY_FRAME] = 1 - (frame_count & 1);
+    parts[i].flag[PartFlags::IS_ENERGY]    = is_energy;
+
+    parts[i].id = i;
+    parts[i].type = type;
+    parts[i].x = x;
+    parts[i].y = y;
+    parts[i].z = z;
+    parts[i].rx = x;
+    parts[i].ry = y;
+    parts[i].rz = z;
+    parts[i].vx = 0.0f;
+    parts[i].vy = 0.0f;
+    parts[i].vz = 0.0f;
+    parts.reset_cold(i);
+    wake_tiles_near(x, y, z);
+    _record_placement(x, y, z, _is_lit(i), false);
+    if (ballistic_types[type])
+        thread_scratch[omp_get_thread_num()].bookkeeping.energy.push_back(i);
+
+    part_map.set(x, y, z, PMAP(type, i));
+    _mark_color_dirty(x, y, z);
+
+    // Atomic max, other threads may be creating parts too
+    part_id max_id = maxId.load(std::memory_order_relaxed);
+    while (max_id < i + 1 && !maxId.compare_exchange_weak(max_id, i + 1, std::memory_order_relaxed)) {}
+    return i;
 }
 
 void Simulation::kill_part(const part_id i) {
-    auto &part = parts[i];
+    auto part = parts[i];
     if (part.type <= 0) return;
 
     coord_t x = part.rx;
     coord_t y = part.ry;
     coord_t z = part.rz;
 
-    if (pmap[z][y][x] && ID(pmap[z][y][x]) == i)
-        pmap[z][y][x] = 0;
-    else if (photons[z][y][x] && ID(photons[z][y][x]) == i)
-        photons[z][y][x] = 0;
+    // Energy parts sharing the voxel get the photons entry back in _apply_bookkeeping
+    if (pmap(x, y, z) && ID(pmap(x, y, z)) == i) {
+        pmap.set(x, y, z, 0);
+        _mark_color_dirty(x, y, z);
+    } else if (photons(x, y, z) && ID(photons(x, y, z)) == i) {
+        photons.set(x, y, z, 0);
+        _mark_color_dirty(x, y, z);
+    }
+    _record_placement(x, y, z, _is_lit(i), true);
+    if (ballistic_types[part.type])
+        thread_scratch[omp_get_thread_num()].bookkeeping.energy_killed++;
 
     part.type = PT_NONE;
     part.flag[PartFlags::IS_ENERGY] = 0;
 
-    if (i == maxId && i > 0)
-        maxId--;
-
-    _set_color_data_at(x, y, z, nullptr);
-    if (paused) {
-        if (_should_do_lighting(part))
-            graphics.ao_blocks[AO_FLAT_IDX(x, y, z)]--;
-        graphics.shadows_force_update = true;
-        parts_count--;
-    }
-    part.id = -pfree;
-    pfree = i;
+    wake_tiles_near(x, y, z);
+    part_allocator.free(omp_get_thread_num(), i);
 }
 
-void Simulation::update_zslice(const coord_t pz) {
-    if (pz < 1 || pz >= ZRES - 1)
-        return;
+void Simulation::update_tile(const unsigned int tile) {
+    SimulationStats::ScopedTimer timer(stats, SimPhase::UPDATE_TILE);
+
+    const unsigned int tx = tile % SIM_TILES_X;
+    const unsigned int ty = (tile / SIM_TILES_X) % SIM_TILES_Y;
+    const unsigned int tz = tile / (SIM_TILES_X * SIM_TILES_Y);
+
+    // Tile bounds clipped to the inside of the sim (edges are never simulated)
+    const coord_t x_start = std::max(1u, tx * SIM_TILE_DIM);
+    const coord_t y_start = std::max(1u, ty * SIM_TILE_DIM);
+    const coord_t z_start = std::max(1u, tz * SIM_TILE_DIM);
+    const coord_t x_end = std::min(XRES - 1, (tx + 1) * SIM_TILE_DIM); // Exclusive
+    const coord_t y_end = std::min(YRES - 1, (ty + 1) * SIM_TILE_DIM);
+    const coord_t z_end = std::min(ZRES - 1, (tz + 1) * SIM_TILE_DIM);
+
+    // Collect the parts in the tile (in scan order) that haven't been touched
+    // this frame yet, parts that moved in from earlier tiles are already done
+    // Ballistic energy parts are moved later by _update_energy_parts instead
+    auto &scratch = thread_scratch[omp_get_thread_num()];
+    auto &batch = scratch.integrate;
+    batch.clear();
+    const bool frame_count_parity = frame_count & 1;
+    const auto collect = [&](const pmap_id pid) {
+        const part_id i = ID(pid);
+        if (parts.flag[i][PartFlags::VELOCITY_FRAME] != frame_count_parity) {
+            parts.flag[i][PartFlags::VELOCITY_FRAME] = frame_count_parity;
+            batch.push_back(i);
+        }
+    };
+
+    for (coord_t pz = z_start; pz < z_end; pz++) {
+        // Only scan the part of the tile that had particles in this z slice
+        const coord_t py_start = std::max(y_start, min_y_per_zslice[pz - 1]);
+        const coord_t py_end = std::min(y_end, static_cast<coord_t>(max_y_per_zslice[pz - 1] + 1));
+
+        for (coord_t py = py_start; py < py_end; py++)
+        for (coord_t px = x_start; px < x_end; px++) {
+            if (pmap(px, py, pz))
+                collect(pmap(px, py, pz));
+            if (photons(px, py, pz) && !(ballistic_energy && ballistic_types[TYP(photons(px, py, pz))]))
+                collect(photons(px, py, pz));
+        }
+    }
 
-    // Dirty rect does not have any impact on performance
-    // for these sizes of YRES / XRES (could slow/speed up by a factor of a few ns)
-    for (coord_t py = min_y_per_zslice[pz - 1]; py < max_y_per_zslice[pz - 1]; py++)
-    for (coord_t px = 1; px < XRES - 1; px++) {
-        if (pmap[pz][py][px])
-            update_part(ID(pmap[pz][py][px]));
-        if (photons[pz][py][px])
-            update_part(ID(photons[pz][py][px]));
+    // Integrating all at once keeps this vectorized, the parts' own update
+    // order is kept since loss / advection don't depend on other parts
+    ParticleKernels::integrate_velocity(parts, batch.data(), batch.size(), air, element_tables);
+
+    // Only this tile's own parts can move while it is updated (tiles of the
+    // same color are too far away), so these are the parts the scan would find
+    // Runs of parts that only move (see _packet_candidate) are updated as
+    // packets, their first raycasts made together
+    for (const part_id i : batch) {
+        if (raycast_packets && _packet_candidate(i)) {
+            scratch.packet.push_back(i);
+            if (scratch.packet.size() == SIM_PACKET_PARTS)
+                _update_packet(max_ok_causality_range);
+            continue;
+        }
+        _update_packet(max_ok_causality_range);
+        update_part(i, max_ok_causality_range);
     }
+    _update_packet(max_ok_causality_range);
 }
 
-void Simulation::update_part(const part_id i, const bool consider_causality) {
-    auto &part = parts[i];
+/**
+ * @brief Update and move a particle, unless it could reach further than
+ *        causality_range in which case it is deferred to a later pass
+ *        Parts that finished a step this frame skip it, so a deferred part
+ *        picks up where it stopped
+ * @param i Part id
+ * @param causality_range Max distance the part may read / write at, NO_CAUSALITY_LIMIT when serial
+ */
+void Simulation::update_part(const part_id i, const unsigned int causality_range) {
+    auto part = parts[i];
+    if (!part.type) return; // Killed by an update earlier in the tile's batch
 
     // Since a particle might move we might update it again
     // if it moves in the direction of scanning the pmap array
@@ -185,20 +319,17 @@ void Simulation::update_part(const part_id i, const bool consider_causality) {
     if (part.flag[PartFlags::UPDATE_FRAME] != frame_count_parity) { // Need to update
         const auto &el = GetElements()[part.type];
 
-        if (consider_causality && el.Causality > max_ok_causality_range)
+        if (el.Causality > causality_range) {
+            _defer_part(i);
             return;
+        }
         part.flag[PartFlags::UPDATE_FRAME] = frame_count_parity > 0;
 
-        // Air acceleration
-        part.vx *= el.Loss;
-        part.vy *= el.Loss;
-        part.vz *= el.Loss;
-
-        if (el.Advection) {
-            const auto &airCell = air.cells[z / AIR_CELL_SIZE][y / AIR_CELL_SIZE][x / AIR_CELL_SIZE];
-            part.vx += el.Advection * airCell.data[VX_IDX];
-            part.vy += el.Advection * airCell.data[VY_IDX];
-            part.vz += el.Advection * airCell.data[VZ_IDX];
+        // Air acceleration, normally done in a batch by update_tile
+        // but parts can get here without passing through it
+        if (part.flag[PartFlags::VELOCITY_FRAME] != frame_count_parity) {
+            part.flag[PartFlags::VELOCITY_FRAME] = frame_count_parity > 0;
+            ParticleKernels::integrate_velocity(parts, &i, 1, air, element_tables);
         }
 
         if (el.Update) {
@@ -210,109 +341,529 @@ void Simulation::update_part(const part_id i, const bool consider_causality) {
 
     // Movement causality constraint: depends on velocity
     if (part.flag[PartFlags::MOVE_FRAME] != frame_count_parity) { // Need to move
-        // Causality check only needs to consider Z direction
-        // since threads operate on XY slices, so only z velocity will
-        // move a part into another thread domain
-        if (consider_causality && fabs(part.vz) > max_ok_causality_range)
+        // Threads operate on tiles split along all 3 axes, so
+        // velocity on any axis can move a part into another thread's tile
+        if (fabsf(part.vx) > causality_range ||
+                fabsf(part.vy) > causality_range ||
+                fabsf(part.vz) > causality_range) {
+            _defer_part(i);
             return;
+        }
         part.flag[PartFlags::MOVE_FRAME] = frame_count_parity > 0;
 
         if (part.vx || part.vy || part.vz)
             _raycast_movement(i, x, y, z); // Apply velocity to displacement
     }
+
+    // Animated colors are refreshed as the part updates
+    const auto &el = GetElements()[part.type];
+    if (el.Graphics)
+        _mark_color_dirty(part.rx, part.ry, part.rz);
+
+    // Moves wake tiles on their own, but a part that is still going
+    // (or has its own update / graphics logic) has to keep its tile awake too
+    if (el.Update || el.Graphics ||
+            fabsf(part.vx) > SIM_TILE_SLEEP_VELOCITY ||
+            fabsf(part.vy) > SIM_TILE_SLEEP_VELOCITY ||
+            fabsf(part.vz) > SIM_TILE_SLEEP_VELOCITY)
+        wake_tile(TILE_FLAT_IDX(part.rx, part.ry, part.rz));
 }
 
 void Simulation::update() {
-    if (paused) {
-        if (graphics.shadows_force_update)
-            _force_update_all_shadows();
+    PROFILE_ZONE("Simulation::update");
+    _apply_bookkeeping(); // Parts created / killed since the last frame, ie by the brush
+    if (paused)
         return;
-    }
 
     // air.update(); // TODO
 
+    // Only tiles that have particles and are not asleep are scheduled
+    woken_tiles.clear();
+    for (unsigned int tile = 0; tile < SIM_TILE_COUNT; tile++) {
+        const bool was_awake = tile_awake[tile];
+        tile_awake[tile] = tile_occupied[tile] && (tile_quiet_frames[tile] < SIM_TILE_SLEEP_FRAMES ||
+            tile_activity[tile].load(std::memory_order_relaxed));
+        if (tile_awake[tile] && !was_awake)
+            woken_tiles.push_back(tile);
+    }
+    tile_scheduler.prepare(tile_awake, sim_thread_count);
+    if (thread_scratch.size() < sim_thread_count)
+        thread_scratch.resize(sim_thread_count);
+    part_allocator.set_thread_count(sim_thread_count); // Also on shrink, flushes the lists of threads no longer used
+    for (auto &scratch : thread_scratch)
+        scratch.overflow.clear();
+
+    // One pass per tile color, tiles within a pass can't affect each other
+    // so threads take (and steal) whichever are left
+    [[maybe_unused]] constexpr const char * TILE_PASS_NAMES[SIM_TILE_COLORS] = {
+        "tile pass 0", "tile pass 1", "tile pass 2", "tile pass 3",
+        "tile pass 4", "tile pass 5", "tile pass 6", "tile pass 7"
+    };
+    [[maybe_unused]] constexpr const char * OVERFLOW_PASS_NAMES[SIM_OVERFLOW_LEVELS] = {
+        "overflow pass 0", "overflow pass 1", "overflow pass 2"
+    };
+
     #pragma omp parallel num_threads(sim_thread_count)
-    { 
-        const int thread_count = omp_get_num_threads();
-        const int z_chunk_size = (ZRES - 2) / (2 * thread_count) + 1;
+    {
         const int tid = omp_get_thread_num();
-        coord_t z_start = z_chunk_size * (2 * tid);
-
         if (tid == 0)
-            actual_thread_count = thread_count;
-
-        for (coord_t z = z_start; z < z_chunk_size + z_start; z++)
-            update_zslice(z);
-
-        #pragma omp barrier // Synchronize threads before processing 2nd chunk
+            actual_thread_count = omp_get_num_threads();
+
+        #pragma omp for schedule(dynamic, 4)
+        for (std::size_t k = 0; k < woken_tiles.size(); k++)
+            _wake_tile_parts(woken_tiles[k]);
+
+        for (unsigned int color = 0; color < SIM_TILE_COLORS; color++) {
+            if (!tile_scheduler.tile_count(color))
+                continue; // Same for every thread, so skipping the barrier is fine
+            {
+                PROFILE_ZONE(TILE_PASS_NAMES[color]);
+                tile_scheduler.run(color, tid, [this](const unsigned int tile) { update_tile(tile); });
+            }
+            {
+                PROFILE_ZONE("barrier");
+                #pragma omp barrier // Finish all tiles of this color before the next
+            }
+        }
 
-        z_start = z_chunk_size * (2 * tid + 1);
-        for (coord_t z = z_start; z < z_chunk_size + z_start; z++)
-            update_zslice(z);
+        // Parts that reach further than a tile allows were deferred, redo the
+        // same colored passes over coarser tiles until they fit
+        for (unsigned int level = 0; level < SIM_OVERFLOW_LEVELS; level++) {
+            #pragma omp single
+            _prepare_overflow_level(level); // Implicit barrier, every thread sees the result
+            if (overflow_scheduler.empty())
+                break;
+
+            for (unsigned int color = 0; color < SIM_TILE_COLORS; color++) {
+                if (!overflow_scheduler.tile_count(color))
+                    continue;
+                {
+                    PROFILE_ZONE(OVERFLOW_PASS_NAMES[level]);
+                    overflow_scheduler.run(color, tid, [this, level](const unsigned int tile) {
+                        _update_overflow_tile(level, tile);
+                    });
+                }
+                {
+                    PROFILE_ZONE("barrier");
+                    #pragma omp barrier
+                }
+            }
+        }
     }
 
+    _update_energy_parts(); // Matter is done moving, see SimulationEnergy.cpp
     recalc_free_particles();
+
+    const part_id max_id = maxId.load(std::memory_order_relaxed);
+    if (auto_compact && parts_count && (frame_count % SIM_COMPACT_INTERVAL == SIM_COMPACT_INTERVAL - 1 ||
+            (max_id > SIM_COMPACT_MIN_IDS && max_id - 1 > parts_count * SIM_COMPACT_FRAGMENTATION)))
+        compact_parts();
     frame_count++;
 }
 
+/**
+ * @brief End of frame work: update parts that are still deferred after the
+ *        last overflow level, then merge what changed this frame
+ */
 void Simulation::recalc_free_particles() {
-    parts_count = 0;
-    part_id newMaxId = 0;
-    std::fill(&max_y_per_zslice[0], &max_y_per_zslice[ZRES - 2], 0);
-    std::fill(&min_y_per_zslice[0], &min_y_per_zslice[ZRES - 2], YRES - 1);
-    std::fill(&graphics.shadow_map[0][0], &graphics.shadow_map[SHADOW_MAP_Y][SHADOW_MAP_X], 0);
-    graphics.ao_blocks.fill(0);
+    PROFILE_ZONE("recalc_free_particles");
+    SimulationStats::ScopedTimer timer(stats, SimPhase::RECALC_FREE_PARTICLES);
+
+    // update_part doesn't defer without a causality limit, so the list doesn't
+    // grow. In id order, so the result doesn't depend on which thread deferred what
+    overflow_parts.clear();
+    for (auto &scratch : thread_scratch) {
+        overflow_parts.insert(overflow_parts.end(), scratch.overflow.begin(), scratch.overflow.end());
+        scratch.overflow.clear();
+    }
+    std::sort(overflow_parts.begin(), overflow_parts.end());
+    for (const part_id i : overflow_parts)
+        if (parts.type[i])
+            update_part(i, NO_CAUSALITY_LIMIT);
+    _apply_bookkeeping();
+
+    for (unsigned int tile = 0; tile < SIM_TILE_COUNT; tile++) {
+        if (tile_activity[tile].load(std::memory_order_relaxed))
+            tile_quiet_frames[tile] = 0;
+        else if (tile_quiet_frames[tile] < SIM_TILE_SLEEP_FRAMES)
+            tile_quiet_frames[tile]++;
+        tile_activity[tile].store(0, std::memory_order_relaxed);
+    }
+}
 
-    for (part_id i = 0; i <= maxId; i++) {
-        auto &part = parts[i];
-        if (!part.type) continue;
+/**
+ * @brief Mark the parts of a tile that was asleep (or empty) last frame as not
+ *        updated. Their flags were last set frames ago so the parity can't be trusted
+ */
+void Simulation::_wake_tile_parts(const unsigned int tile) {
+    const unsigned int tx = tile % SIM_TILES_X;
+    const unsigned int ty = (tile / SIM_TILES_X) % SIM_TILES_Y;
+    const unsigned int tz = tile / (SIM_TILES_X * SIM_TILES_Y);
+    const coord_t x_start = std::max(1u, tx * SIM_TILE_DIM);
+    const coord_t y_start = std::max(1u, ty * SIM_TILE_DIM);
+    const coord_t z_start = std::max(1u, tz * SIM_TILE_DIM);
+    const coord_t x_end = std::min(XRES - 1, (tx + 1) * SIM_TILE_DIM);
+    const coord_t y_end = std::min(YRES - 1, (ty + 1) * SIM_TILE_DIM);
+    const coord_t z_end = std::min(ZRES - 1, (tz + 1) * SIM_TILE_DIM);
+    const bool not_updated = !(frame_count & 1);
+
+    const auto reset = [&](const pmap_id pid) {
+        auto &flag = parts.flag[ID(pid)];
+        flag[PartFlags::UPDATE_FRAME] = not_updated;
+        flag[PartFlags::MOVE_FRAME] = not_updated;
+        flag[PartFlags::VELOCITY_FRAME] = not_updated;
+    };
+    for (coord_t pz = z_start; pz < z_end; pz++) {
+        const coord_t py_start = std::max(y_start, min_y_per_zslice[pz - 1]);
+        const coord_t py_end = std::min(y_end, static_cast<coord_t>(max_y_per_zslice[pz - 1] + 1));
+
+        for (coord_t py = py_start; py < py_end; py++)
+        for (coord_t px = x_start; px < x_end; px++) {
+            if (pmap(px, py, pz))
+                reset(pmap(px, py, pz));
+            if (photons(px, py, pz))
+                reset(photons(px, py, pz));
+        }
+    }
+}
 
-        parts_count++;
-        newMaxId = i;
+void Simulation::_defer_part(const part_id idx) {
+    thread_scratch[omp_get_thread_num()].overflow.push_back(idx);
+}
 
-        const coord_t x = part.rx;
-        const coord_t y = part.ry;
-        const coord_t z = part.rz;
+// Bookkeeping
+// ------------------------
+// Part counts, tile occupancy, the y range of each z slice, ambient occlusion
+// and shadows only change where parts are added, removed or moved. Threads
+// record those changes into their own BookkeepingDelta (no locking while
+// tiles update), which are summed up between frames
+
+void Simulation::_record_placement(const coord_t x, const coord_t y, const coord_t z, const bool lit, const bool removed) {
+    auto &delta = thread_scratch[omp_get_thread_num()].bookkeeping;
+    const int32_t sign = removed ? -1 : 1;
+
+    delta.parts += sign;
+    delta.tile_parts[TILE_FLAT_IDX(x, y, z)] += sign;
+    delta.zslice_rows[(z - 1) * YRES + y] += sign;
+    delta.zslice_touched[z - 1] = 1;
+
+    if (lit) {
+        delta.ao_blocks[AO_FLAT_IDX(x, y, z)] += sign;
+        const uint32_t cell = SHADOW_MAP_FLAT_IDX(x, y, z);
+        if (removed)
+            delta.shadow_removed.push_back({ cell, z });
+        else {
+            delta.shadow_map[cell] = std::max(delta.shadow_map[cell], static_cast<uint8_t>(z));
+            delta.shadow_row_touched[cell / SHADOW_MAP_X] = 1;
+        }
+    }
+}
 
-        // Ambient occlusion and shadow rules
-        if (part.id == ID(pmap[z][y][x]) && _should_do_lighting(part)) {
-            graphics.ao_blocks[AO_FLAT_IDX(x, y, z)]++;
-            _update_shadow_map(x, y, z);
+/**
+ * @brief Record a part moving from (x1, y1, z1) to (x2, y2, z2)
+ */
+void Simulation::_record_move(const part_id idx, const coord_t x1, const coord_t y1, const coord_t z1,
+        const coord_t x2, const coord_t y2, const coord_t z2) {
+    const bool lit = _is_lit(idx);
+    _record_placement(x1, y1, z1, lit, true);
+    _record_placement(x2, y2, z2, lit, false);
+}
+
+void Simulation::_record_unmapped(const part_id idx) {
+    thread_scratch[omp_get_thread_num()].bookkeeping.unmapped.push_back(idx);
+}
+
+/**
+ * @brief Sum up the changes recorded by all threads since the last call
+ *        Call outside of a parallel region, it starts its own
+ */
+void Simulation::_apply_bookkeeping() {
+    PROFILE_ZONE("apply bookkeeping");
+    for (auto &scratch : thread_scratch) {
+        parts_count += scratch.bookkeeping.parts;
+        scratch.bookkeeping.parts = 0;
+    }
+
+    #pragma omp parallel num_threads(sim_thread_count)
+    {
+        #pragma omp for nowait
+        for (unsigned int tile = 0; tile < SIM_TILE_COUNT; tile++) {
+            for (auto &scratch : thread_scratch) {
+                tile_part_count[tile] += scratch.bookkeeping.tile_parts[tile];
+                scratch.bookkeeping.tile_parts[tile] = 0;
+            }
+            tile_occupied[tile] = tile_part_count[tile] > 0;
         }
 
-        // Pmap / other cache
-        min_y_per_zslice[z - 1] = std::min(y, min_y_per_zslice[z - 1]);
-        max_y_per_zslice[z - 1] = std::max(y, max_y_per_zslice[z - 1]);
-
-        // Pmap and graphics
-        auto &map = part.flag[PartFlags::IS_ENERGY] ? photons : pmap;
-        if (GetElements()[part.type].Graphics)
-            _set_color_data_at(part.rx, part.ry, part.rz, &part);
-        if (!map[z][y][x]) {
-            map[z][y][x] = PMAP(part.type, i);
-            _set_color_data_at(x, y, z, &part);
+        #pragma omp for nowait
+        for (unsigned int block = 0; block < graphics.ao_blocks.size(); block++) {
+            for (auto &scratch : thread_scratch) {
+                graphics.ao_blocks[block] += scratch.bookkeeping.ao_blocks[block];
+                scratch.bookkeeping.ao_blocks[block] = 0;
+            }
         }
 
-        update_part(i, false);
+        #pragma omp for schedule(dynamic, 8) nowait
+        for (unsigned int z = 1; z < ZRES - 1; z++) {
+            bool touched = false;
+            for (auto &scratch : thread_scratch) {
+                auto &delta = scratch.bookkeeping;
+                if (!delta.zslice_touched[z - 1])
+                    continue;
+                for (unsigned int y = 0; y < YRES; y++) {
+                    zslice_row_parts[z - 1][y] += delta.zslice_rows[(z - 1) * YRES + y];
+                    delta.zslice_rows[(z - 1) * YRES + y] = 0;
+                }
+                delta.zslice_touched[z - 1] = 0;
+                touched = true;
+            }
+            if (touched)
+                _recalc_zslice_bounds(z);
+        }
+
+        // Additions first (this loop's implicit barrier), removals then only
+        // matter if they could have been what cast a cell's shadow
+        #pragma omp for schedule(dynamic, 16)
+        for (unsigned int row = 0; row < SHADOW_MAP_Y; row++) {
+            for (auto &scratch : thread_scratch) {
+                auto &delta = scratch.bookkeeping;
+                if (!delta.shadow_row_touched[row])
+                    continue;
+                for (unsigned int x = 0; x < SHADOW_MAP_X; x++) {
+                    graphics.shadow_map[row][x] = std::max(graphics.shadow_map[row][x], delta.shadow_map[row * SHADOW_MAP_X + x]);
+                    delta.shadow_map[row * SHADOW_MAP_X + x] = 0;
+                }
+                delta.shadow_row_touched[row] = 0;
+            }
+        }
+
+        #pragma omp single
+        {
+            shadow_dirty_cells.clear();
+            for (auto &scratch : thread_scratch) {
+                for (const auto &removal : scratch.bookkeeping.shadow_removed)
+                    if (removal.z >= (&graphics.shadow_map[0][0])[removal.cell])
+                        shadow_dirty_cells.push_back(removal.cell);
+                scratch.bookkeeping.shadow_removed.clear();
+            }
+            std::sort(shadow_dirty_cells.begin(), shadow_dirty_cells.end());
+            shadow_dirty_cells.erase(std::unique(shadow_dirty_cells.begin(), shadow_dirty_cells.end()), shadow_dirty_cells.end());
+        }
+
+        #pragma omp for schedule(dynamic, 16)
+        for (std::size_t k = 0; k < shadow_dirty_cells.size(); k++)
+            _recalc_shadow_map_cell(shadow_dirty_cells[k]);
     }
-    maxId = newMaxId + 1;
+
+    // Energy parts that were covered by another one get the photons entry
+    // back once the voxel is free, until then they stay in the list
+    for (auto &scratch : thread_scratch) {
+        auto &unmapped = scratch.bookkeeping.unmapped;
+        unmapped_parts.insert(unmapped_parts.end(), unmapped.begin(), unmapped.end());
+        unmapped.clear();
+    }
+    // Lowest id gets a free voxel first, whichever thread covered it
+    std::sort(unmapped_parts.begin(), unmapped_parts.end());
+    std::erase_if(unmapped_parts, [this](const part_id i) {
+        if (!parts.type[i] || !parts.flag[i][PartFlags::IS_ENERGY])
+            return true;
+        const auto part = parts[i];
+        const coord_t x = part.rx, y = part.ry, z = part.rz;
+        if (photons(x, y, z))
+            return ID(photons(x, y, z)) == i;
+        photons.set(x, y, z, PMAP(parts.type[i], i));
+        _mark_color_dirty(x, y, z);
+        return true;
+    });
+    _merge_energy_parts();
+    _resolve_colors();
+
+    // Ids freed this frame are available to every thread again
+    part_allocator.flush();
+    part_id max_id = maxId.load(std::memory_order_relaxed);
+    while (max_id > 0 && !parts.type[max_id - 1])
+        max_id--;
+    maxId.store(max_id, std::memory_order_relaxed);
+}
+
+void Simulation::_recalc_zslice_bounds(const coord_t z) {
+    coord_t min_y = YRES - 1, max_y = 0;
+    for (unsigned int y = 0; y < YRES; y++) {
+        if (zslice_row_parts[z - 1][y]) {
+            min_y = std::min(min_y, static_cast<coord_t>(y));
+            max_y = y;
+        }
+    }
+    min_y_per_zslice[z - 1] = min_y;
+    max_y_per_zslice[z - 1] = max_y;
+}
+
+/**
+ * @brief Gather the parts deferred by all threads and group them by which
+ *        tile of the given overflow level they are in, then schedule those tiles
+ *        Serial, call from one thread while the others wait
+ */
+void Simulation::_prepare_overflow_level(const unsigned int level) {
+    const unsigned int dim = SIM_OVERFLOW_TILE_DIMS[level];
+    const unsigned int tiles_x = (XRES + dim - 1) / dim;
+    const unsigned int tiles_y = (YRES + dim - 1) / dim;
+    const unsigned int tiles_z = (ZRES + dim - 1) / dim;
+    const unsigned int tile_count = tiles_x * tiles_y * tiles_z;
+    const auto tile_of = [&](const Particle &part) {
+        return part.rx / dim + (part.ry / dim) * tiles_x + (part.rz / dim) * tiles_x * tiles_y;
+    };
+
+    // Counting sort by tile. Counts go 2 slots ahead so that after placing
+    // (which advances [tile + 1]) [tile] is the start and [tile + 1] the end
+    overflow_tile_start.assign(tile_count + 2, 0);
+    for (auto &scratch : thread_scratch)
+        for (const part_id i : scratch.overflow)
+            overflow_tile_start[tile_of(parts[i]) + 2]++;
+    for (unsigned int tile = 2; tile < tile_count + 2; tile++)
+        overflow_tile_start[tile] += overflow_tile_start[tile - 1];
+
+    overflow_parts.resize(overflow_tile_start[tile_count + 1]);
+    for (auto &scratch : thread_scratch) {
+        for (const part_id i : scratch.overflow)
+            overflow_parts[overflow_tile_start[tile_of(parts[i]) + 1]++] = i;
+        scratch.overflow.clear();
+    }
+    // Which thread deferred a part is up to scheduling, the order it's
+    // redone in shouldn't be
+    for (unsigned int tile = 0; tile < tile_count; tile++)
+        std::sort(overflow_parts.begin() + overflow_tile_start[tile], overflow_parts.begin() + overflow_tile_start[tile + 1]);
+
+    overflow_scheduler.clear();
+    for (unsigned int tile = 0; tile < tile_count; tile++)
+        if (overflow_tile_start[tile + 1] > overflow_tile_start[tile])
+            overflow_scheduler.add(TILE_COLOR(tile % tiles_x, (tile / tiles_x) % tiles_y, tile / (tiles_x * tiles_y)), tile);
+    overflow_scheduler.finalize(omp_get_num_threads());
+}
+
+void Simulation::_update_overflow_tile(const unsigned int level, const unsigned int tile) {
+    SimulationStats::ScopedTimer timer(stats, SimPhase::UPDATE_OVERFLOW);
+    const unsigned int dim = SIM_OVERFLOW_TILE_DIMS[level];
+
+    // Packets as in update_tile, see there
+    auto &scratch = thread_scratch[omp_get_thread_num()];
+    for (uint32_t j = overflow_tile_start[tile]; j < overflow_tile_start[tile + 1]; j++) {
+        const part_id i = overflow_parts[j];
+        if (raycast_packets && _packet_candidate(i)) {
+            scratch.packet.push_back(i);
+            if (scratch.packet.size() == SIM_PACKET_PARTS)
+                _update_packet(dim / 2, level, tile);
+            continue;
+        }
+        _update_packet(dim / 2, level, tile);
+        _update_overflow_part(level, tile, i);
+    }
+    _update_packet(dim / 2, level, tile);
+}
+
+void Simulation::_update_overflow_part(const unsigned int level, const unsigned int tile, const part_id i) {
+    const unsigned int dim = SIM_OVERFLOW_TILE_DIMS[level];
+    const unsigned int tiles_x = (XRES + dim - 1) / dim;
+    const unsigned int tiles_y = (YRES + dim - 1) / dim;
+    const coord_t x_start = (tile % tiles_x) * dim;
+    const coord_t y_start = ((tile / tiles_x) % tiles_y) * dim;
+    const coord_t z_start = (tile / (tiles_x * tiles_y)) * dim;
+
+    const auto &part = parts[i];
+    if (!part.type) return; // Killed since it was deferred
+
+    // Could have been displaced out of the tile by another part since,
+    // then it might reach into a tile updated concurrently
+    if (part.rx < x_start || part.rx >= x_start + dim ||
+            part.ry < y_start || part.ry >= y_start + dim ||
+            part.rz < z_start || part.rz >= z_start + dim) {
+        _defer_part(i);
+        return;
+    }
+    update_part(i, dim / 2);
 }
 
 
 // Octree & color data updates
 // ------------------------
-void Simulation::_set_color_data_at(const coord_t x, const coord_t y, const coord_t z, const Particle * part) {
+/**
+ * @brief Note that the part shown at a voxel may have changed. Colors are
+ *        resolved once all moves of the frame are done, see _resolve_colors
+ *        Thread safe
+ */
+void Simulation::_mark_color_dirty(const coord_t x, const coord_t y, const coord_t z) {
+    const unsigned int block = (x / OCTREE_BLOCK_DIM) + (y / OCTREE_BLOCK_DIM) * X_BLOCKS +
+        (z / OCTREE_BLOCK_DIM) * X_BLOCKS * Y_BLOCKS;
+    thread_scratch[omp_get_thread_num()].bookkeeping.color_dirty[block].push_back(_pack_voxel(x, y, z));
+}
+
+/**
+ * @brief Set the color of every voxel marked by _mark_color_dirty since the
+ *        last call, to the energy part in it if there is one, else its matter,
+ *        then rebuild the octree blocks whose leaves changed
+ *        Each octree block is done by one thread, so its tree has one writer,
+ *        and a voxel marked many times is only resolved once
+ *        Call outside of a parallel region, it starts its own
+ */
+void Simulation::_resolve_colors() {
+    PROFILE_ZONE("resolve colors");
+    SimulationStats::ScopedTimer timer(stats, SimPhase::RESOLVE_COLORS);
+    constexpr uint32_t mask = OCTREE_BLOCK_DIM - 1;
+    const auto bit_of = [](const uint32_t voxel) {
+        return (voxel & mask) | ((voxel >> 10) & mask) << OCTREE_BLOCK_DEPTH | ((voxel >> 20) & mask) << (2 * OCTREE_BLOCK_DEPTH);
+    };
+
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(sim_thread_count)
+    for (unsigned int block = 0; block < X_BLOCKS * Y_BLOCKS * Z_BLOCKS; block++) {
+        uint64_t * resolved = &color_resolved[block * COLOR_RESOLVED_BLOCK_WORDS];
+        std::size_t marked = 0;
+        for (auto &scratch : thread_scratch) {
+            for (const uint32_t voxel : scratch.bookkeeping.color_dirty[block]) {
+                const uint32_t bit = bit_of(voxel);
+                if (resolved[bit / 64] & (1ull << (bit % 64)))
+                    continue;
+                resolved[bit / 64] |= 1ull << (bit % 64);
+
+                const coord_t x = voxel & 1023, y = (voxel >> 10) & 1023, z = voxel >> 20;
+                const pmap_id shown = photons(x, y, z) ? photons(x, y, z) : pmap(x, y, z);
+                _set_color_data_at(x, y, z, ID(shown));
+            }
+            marked += scratch.bookkeeping.color_dirty[block].size();
+        }
+
+        // Clearing the whole bitset is cheaper once most of its words were touched
+        for (auto &scratch : thread_scratch) {
+            if (marked < COLOR_RESOLVED_BLOCK_WORDS)
+                for (const uint32_t voxel : scratch.bookkeeping.color_dirty[block])
+                    resolved[bit_of(voxel) / 64] = 0;
+            scratch.bookkeeping.color_dirty[block].clear();
+        }
+        if (marked >= COLOR_RESOLVED_BLOCK_WORDS)
+            std::fill(resolved, resolved + COLOR_RESOLVED_BLOCK_WORDS, 0);
+
+        // Leaves were also set by _update_energy_parts
+        auto &tree = graphics.octree_blocks[block];
+        if (tree.stale)
+            tree.rebuild();
+    }
+}
+
+/**
+ * @brief Set the color (and octree occupancy) of a voxel to that of a part
+ * @param i Part id, 0 to clear the voxel
+ */
+void Simulation::_set_color_data_at(const coord_t x, const coord_t y, const coord_t z, const part_id i) {
     uint32_t new_color = 0;
     util::Bitset8 new_flags = 0;
 
-    if (part != nullptr) {
-        const auto &el = GetElements()[part->type];
+    if (i) {
+        const auto part = parts[i];
+        const auto &el = GetElements()[part.type];
         new_color = el.Color.as_ABGR();
         new_flags = util::Bitset8(el.GraphicsFlags);
 
         if (el.Graphics) {
             RGBA color_out;
-            el.Graphics(*this, *part, part->rx, part->ry, part->rz, color_out, new_flags);
+            el.Graphics(*this, part, part.rx, part.ry, part.rz, color_out, new_flags);
             new_color = color_out.as_ABGR();
         }
     }
@@ -324,36 +875,50 @@ void Simulation::_set_color_data_at(const coord_t x, const coord_t y, const coor
         (x / OCTREE_BLOCK_DIM) + (y / OCTREE_BLOCK_DIM) * X_BLOCKS +
         (z / OCTREE_BLOCK_DIM) * X_BLOCKS * Y_BLOCKS];
 
-    graphics.color_data_modified[idx / COLOR_DATA_CHUNK_SIZE] = 0xFF;
+    graphics.color_dirty.mark(idx / COLOR_DATA_PAGE_SIZE);
     graphics.color_data[idx] = new_color;
     graphics.color_flags[idx] = new_flags;
-    tree.modified = 0xFF;
 
+    // Layers above the leaves are rebuilt once per frame, see _resolve_colors
     if (new_color)
-        tree.insert(x & (OCTREE_BLOCK_DIM - 1), y & (OCTREE_BLOCK_DIM - 1), z & (OCTREE_BLOCK_DIM - 1));
+        tree.set_leaf(x & (OCTREE_BLOCK_DIM - 1), y & (OCTREE_BLOCK_DIM - 1), z & (OCTREE_BLOCK_DIM - 1));
     else
-        tree.remove(x & (OCTREE_BLOCK_DIM - 1), y & (OCTREE_BLOCK_DIM - 1), z & (OCTREE_BLOCK_DIM - 1));
+        tree.clear_leaf(x & (OCTREE_BLOCK_DIM - 1), y & (OCTREE_BLOCK_DIM - 1), z & (OCTREE_BLOCK_DIM - 1));
 }
 
 void Simulation::_update_shadow_map(const coord_t x, const coord_t y, const coord_t z) {
-    unsigned int proj_x = (static_cast<unsigned int>(x) + (ZRES - z)) / SHADOW_MAP_SCALE;
-    unsigned int proj_y = (static_cast<unsigned int>(y) + (ZRES - z)) / SHADOW_MAP_SCALE;
-    graphics.shadow_map[proj_y][proj_x] = std::max(graphics.shadow_map[proj_y][proj_x], static_cast<uint8_t>(z));
+    uint8_t &shadow = (&graphics.shadow_map[0][0])[SHADOW_MAP_FLAT_IDX(x, y, z)];
+    shadow = std::max(shadow, static_cast<uint8_t>(z));
 }
 
-bool Simulation::_should_do_lighting(const Particle &part) {
-    return !GetElements()[part.type].GraphicsFlags[GraphicsFlagsIdx::NO_LIGHTING];
+/**
+ * @brief Recompute a shadow map cell from scratch (the highest lit part
+ *        projecting onto it), used after the part it had may have left
+ */
+void Simulation::_recalc_shadow_map_cell(const uint32_t cell) {
+    const int proj_x = (cell % SHADOW_MAP_X) * SHADOW_MAP_SCALE;
+    const int proj_y = (cell / SHADOW_MAP_X) * SHADOW_MAP_SCALE;
+    uint8_t shadow = 0;
+
+    for (int z = ZRES - 2; z >= 1 && !shadow; z--)
+    for (int y = proj_y - (ZRES - z); y < proj_y - (int)(ZRES - z) + (int)SHADOW_MAP_SCALE; y++)
+    for (int x = proj_x - (ZRES - z); x < proj_x - (int)(ZRES - z) + (int)SHADOW_MAP_SCALE; x++) {
+        if (x < 1 || x >= (int)XRES - 1 || y < 1 || y >= (int)YRES - 1)
+            continue;
+        if (pmap(x, y, z) && _should_do_lighting(TYP(pmap(x, y, z))))
+            shadow = z;
+    }
+    (&graphics.shadow_map[0][0])[cell] = shadow;
 }
 
-void Simulation::_force_update_all_shadows() {
-    std::fill(&graphics.shadow_map[0][0], &graphics.shadow_map[SHADOW_MAP_Y][SHADOW_MAP_X], 0);
-    graphics.shadows_force_update = false;
+bool Simulation::_should_do_lighting(const ElementType type) const {
+    return !GetElements()[type].GraphicsFlags[GraphicsFlagsIdx::NO_LIGHTING];
+}
 
-    #pragma parallel for
-    for (part_id i = 0; i <= maxId; i++) {
-        auto &part = parts[i];
-        if (!part.type) continue;
-        if (part.id == ID(pmap[part.rz][part.ry][part.rx]) && _should_do_lighting(part))
-            _update_shadow_map(part.rx, part.ry, part.rz);
-    }
+/**
+ * @brief Whether a part counts towards ambient occlusion and shadows,
+ *        only parts in pmap do
+ */
+bool Simulation::_is_lit(const part_id idx) const {
+    return !parts.flag[idx][PartFlags::IS_ENERGY] && _should_do_lighting(parts.type[idx]);
 }
@@ -4,17 +4,42 @@
 #include "Particle.h"
 #include "SimulationDef.h"
 #include "SimulationGraphics.h"
+#include "SimulationStats.h"
+#include "TileScheduler.h"
 #include "Raycast.h"
 #include "Air.h"
+#include "ParticleKernels.h"
+#include "ParticleAllocator.h"
+#include "VoxelGrid.h"
+#include "WorldChecksum.h"
 
 #include "../util/types/rand.h"
+#include "../util/types/counter_rand.h"
 #include "../util/types/heap_array.h"
 
 #include "../util/math.h"
 #include "../util/vector_op.h"
 #include "../render/types/octree.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
 #include <vector>
 
+// Causality range for update_part that never defers a particle
+constexpr unsigned int NO_CAUSALITY_LIMIT = std::numeric_limits<unsigned int>::max();
+
+// Parts are renumbered in Morton order (see compact_parts) every this many frames,
+// or sooner once the ids in use span this many times the live part count
+constexpr uint32_t SIM_COMPACT_INTERVAL = 600;
+constexpr float SIM_COMPACT_FRAGMENTATION = 1.5f;
+constexpr part_id SIM_COMPACT_MIN_IDS = 4096; // Fragmentation is ignored below this many ids
+
+// Parts updated as one packet at most (see _update_packet). More rays keep
+// the raycast_packet lanes busier, fewer make a stale cast less likely
+constexpr unsigned int SIM_PACKET_PARTS = 64;
+constexpr unsigned int SIM_PACKET_MIN_RAYS = 4; // Packets with fewer moving parts are updated without packet casts
+
 enum class GravityMode {
     VERTICAL = 0,
     ZERO_G = 1,
@@ -24,18 +49,26 @@ enum class GravityMode {
 class Simulation {
 public:
     bool paused;
+    bool auto_compact; // Run compact_parts every SIM_COMPACT_INTERVAL frames / when fragmented
+    bool raycast_skip_empty; // Let raycast jump over empty cells / blocks, faster in sparse sims only
+    bool raycast_packets;    // Cast the movement rays of parts without own movement logic in packets, see update_tile
+    bool ballistic_energy;   // Move energy parts of ballistic types in their own phase instead of the tile passes, see _update_energy_parts
     GravityMode gravity_mode;
 
-    Particle parts[NPARTS];
-    pmap_id pmap[ZRES][YRES][XRES];
-    pmap_id photons[ZRES][YRES][XRES];
+    ParticleStore parts;
+    PartMap pmap;    // pmap(x, y, z), see VoxelGrid
+    PartMap photons;
     PartSwapBehavior can_move[ELEMENT_COUNT + 1][ELEMENT_COUNT + 1];
+    bool photons_can_stop[ELEMENT_COUNT + 1]; // Whether a part in photons can stop a moving part of the type, from can_move
+    bool ballistic_types[ELEMENT_COUNT + 1];  // Energy types that only fly straight and bounce off matter, see _init_can_move
+    bool energy_wakes_tiles;                  // Whether any matter is stopped by a ballistic type, so their moves must wake tiles
+    ParticleKernels::ElementTables element_tables;
 
     Air air;
 
-    part_id pfree;
-    part_id maxId;
-    
+    ParticleAllocator part_allocator;
+    std::atomic<part_id> maxId; // One past the highest live part id
+
     uint32_t parts_count;
     uint32_t frame_count; // Monotomic frame counter, will overflow in ~824 days @ 60 FPS. Do not keep the program open for this long
 
@@ -47,7 +80,95 @@ public:
     unsigned int max_ok_causality_range;
     coord_t min_y_per_zslice[ZRES - 2];
     coord_t max_y_per_zslice[ZRES - 2];
-    RNG rng;
+    uint32_t zslice_row_parts[ZRES - 2][YRES]; // Parts per y row of each z slice, keeps the two above tight
+    uint32_t tile_part_count[SIM_TILE_COUNT];
+    uint8_t tile_occupied[SIM_TILE_COUNT]; // Non-zero if tile has a particle, see TileScheduler.h
+    uint8_t tile_quiet_frames[SIM_TILE_COUNT]; // Consecutive frames without activity, asleep at SIM_TILE_SLEEP_FRAMES
+    uint8_t tile_awake[SIM_TILE_COUNT];        // Tiles scheduled this frame: occupied and not asleep
+    std::atomic<uint8_t> tile_activity[SIM_TILE_COUNT]; // Something happened in / next to the tile since the last frame
+    std::vector<uint32_t> woken_tiles;         // Tiles awake this frame that weren't last frame
+    TileScheduler tile_scheduler;
+
+    // What parts being added to / removed from voxels changed since the last
+    // _apply_bookkeeping, kept per thread so recording never needs a lock
+    // and summed (in parallel) when applied. Only touched slices / rows are read
+    struct BookkeepingDelta {
+        struct ShadowRemoval {
+            uint32_t cell; // See SHADOW_MAP_FLAT_IDX
+            coord_t z;
+        };
+
+        int32_t parts;
+        util::heap_array<int32_t, SIM_TILE_COUNT> tile_parts;
+        util::heap_array<int32_t, AO_X_BLOCKS * AO_Y_BLOCKS * AO_Z_BLOCKS> ao_blocks;
+        util::heap_array<int32_t, (ZRES - 2) * YRES> zslice_rows;     // [z - 1][y]
+        util::heap_array<uint8_t, ZRES - 2> zslice_touched;
+        util::heap_array<uint8_t, SHADOW_MAP_Y * SHADOW_MAP_X> shadow_map; // Highest lit part added per cell
+        util::heap_array<uint8_t, SHADOW_MAP_Y> shadow_row_touched;
+        std::vector<ShadowRemoval> shadow_removed; // Lit parts that left a voxel
+        std::vector<part_id> unmapped;  // Energy parts that lost their photons entry to another part
+        std::vector<part_id> energy;    // Parts of ballistic types created, see energy_parts
+        uint32_t energy_killed;         // Parts of ballistic types killed
+        std::vector<uint32_t> color_dirty[X_BLOCKS * Y_BLOCKS * Z_BLOCKS]; // [octree block] voxels whose color may have changed, see _pack_voxel
+
+        BookkeepingDelta(): parts(0), energy_killed(0) {
+            tile_parts.fill(0);
+            ao_blocks.fill(0);
+            zslice_rows.fill(0);
+            zslice_touched.fill(0);
+            shadow_map.fill(0);
+            shadow_row_touched.fill(0);
+        }
+    };
+
+    // First movement raycast of a part, made ahead of its update_part
+    // together with others (see _update_packet)
+    struct PacketCast {
+        part_id id;
+        RaycastInput in;
+        RaycastOutput out;
+        bool hit;
+    };
+
+    // A voxel packed as 10 bit fields, z << 20 | y << 10 | x. Bit 9 of each field
+    // is a guard bit, so a box test checks all 3 axes at once (_take_packet_cast)
+    static constexpr uint32_t PACKED_VOXEL_GUARDS = 1 << 29 | 1 << 19 | 1 << 9;
+    static constexpr uint32_t _pack_voxel(const uint32_t x, const uint32_t y, const uint32_t z) {
+        return z << 20 | y << 10 | x;
+    }
+
+    // A ballistic energy part that changed voxel in _update_energy_parts
+    struct EnergyMove {
+        part_id id;
+        coord_t x1, y1, z1; // From
+        coord_t x2, y2, z2; // To
+    };
+
+    // Per thread scratch space, reused every frame
+    struct alignas(64) ThreadScratch {
+        std::vector<part_id> overflow;  // Parts update_part deferred for reaching too far, see SIM_OVERFLOW_LEVELS
+        std::vector<part_id> integrate; // Parts of the current tile to integrate velocity for in one batch
+        std::vector<part_id> packet;    // Parts of the current tile waiting to be updated as a packet
+        std::vector<PacketCast> packet_casts;  // Of the packet being updated, empty outside of _update_packet
+        const PacketCast * packet_cast = nullptr; // Of the part being updated, if it has one
+        std::vector<uint32_t> packet_writes;   // Voxels moves wrote to since the casts were made, see _pack_voxel
+        std::vector<EnergyMove> energy_moves;  // This thread's share of _update_energy_parts, in energy_parts order
+        std::vector<EnergyMove> energy_leaving, energy_arriving; // The same, by octree block and 16^3 cell of the voxel left / entered
+        std::vector<uint32_t> leaving_start, arriving_start;     // [bucket] first index into the above, [bucket + 1] is the end
+        BookkeepingDelta bookkeeping;
+    };
+    std::vector<ThreadScratch> thread_scratch; // [thread]
+    std::vector<part_id> overflow_parts;        // Deferred parts of the current level, grouped by tile
+    std::vector<uint32_t> overflow_tile_start;  // [tile] first index into overflow_parts, [tile + 1] is the end
+    std::vector<part_id> unmapped_parts;        // Energy parts sharing a voxel without being in photons
+    std::vector<part_id> energy_parts;          // Parts of ballistic types sorted by id, may hold parts killed this frame
+    std::vector<uint32_t> shadow_dirty_cells;   // Scratch for _apply_bookkeeping
+    std::vector<uint64_t> color_resolved;       // [octree block] bitset of its voxels, scratch for _resolve_colors
+    TileScheduler overflow_scheduler;
+    CounterRNG rng; // Keyed by frame and part id, draw a part's numbers from rng.stream(frame_count, id). See its limitation on ids
+
+    // Per-phase timings, disabled unless a benchmark turns them on
+    SimulationStats stats;
 
 
     Simulation();
@@ -60,10 +181,23 @@ public:
     void kill_part(const part_id id);
 
     void update();
-    void update_zslice(const coord_t zslice);
+    void update_tile(const unsigned int tile);
     void recalc_free_particles();
+    void compact_parts();
+    WorldChecksum checksum() const;
+
+    /**
+     * @brief Mark a tile as active so it is (kept) awake the next frame. Thread safe
+     */
+    void wake_tile(const unsigned int tile) {
+        // Check first so threads only write the cache line when it changes
+        if (!tile_activity[tile].load(std::memory_order_relaxed))
+            tile_activity[tile].store(1, std::memory_order_relaxed);
+    }
+    void wake_tiles_near(const coord_t x, const coord_t y, const coord_t z);
+    void wake_all_tiles();
 
-    void update_part(const part_id i, const bool consider_causality = true);
+    void update_part(const part_id i, const unsigned int causality_range);
 
     void move_behavior(const part_id idx);
     void try_move(const part_id idx, const float x, const float y, const float z,
@@ -77,6 +211,17 @@ public:
     template <bool compute_faces, bool take_intersect>
     bool raycast(const RaycastInput &in, RaycastOutput &out, const auto pmapOccupied) const;
 
+    /**
+     * @brief Movement raycasts of several parts at once, out[k] / hit[k] are
+     *        what raycast<true>(in[k], out[k], ...) in _raycast_movement would
+     *        give for part ids[k]. On AVX2 / AVX-512 (see ParticleKernels::active_isa)
+     *        the rays step together, one per lane, and a lane takes the next
+     *        ray once its own is done
+     * @param count Any, velocities at most MAX_VELOCITY
+     */
+    void raycast_packet(const part_id * ids, const RaycastInput * in, RaycastOutput * out, bool * hit,
+        const unsigned int count) const;
+
     PartSwapBehavior eval_move(const part_id idx, const coord_t nx, const coord_t ny, const coord_t nz) const;
 
     static const char * getGravityModeName(const GravityMode mode) {
@@ -92,11 +237,37 @@ public:
     }
 private:
     void _init_can_move();
+    void _init_element_tables();
+    void _defer_part(const part_id idx);
+    void _record_placement(const coord_t x, const coord_t y, const coord_t z, const bool lit, const bool removed);
+    void _record_move(const part_id idx, const coord_t x1, const coord_t y1, const coord_t z1,
+        const coord_t x2, const coord_t y2, const coord_t z2);
+    void _record_unmapped(const part_id idx);
+    void _apply_bookkeeping();
+    void _recalc_zslice_bounds(const coord_t z);
+    void _recalc_shadow_map_cell(const uint32_t cell);
+    void _wake_tile_parts(const unsigned int tile);
+    void _prepare_overflow_level(const unsigned int level);
+    void _update_overflow_tile(const unsigned int level, const unsigned int tile);
+    void _update_overflow_part(const unsigned int level, const unsigned int tile, const part_id i);
+    void _update_energy_parts();
+    void _advance_energy_parts(const part_id * ids, const unsigned int count, std::vector<EnergyMove> &moves);
+    void _advance_energy_part(const part_id idx, const RaycastInput &in, const RaycastOutput &out, const bool hit,
+        std::vector<EnergyMove> &moves);
+    bool _energy_ray_clear(const RaycastInput &in, RaycastOutput &out) const;
+    void _merge_energy_parts();
     void _raycast_movement(const part_id idx, const coord_t x, const coord_t y, const coord_t z);
-    void _set_color_data_at(const coord_t x, const coord_t y, const coord_t z, const Particle * part);
+    PartSwapBehavior _eval_ray_move(const part_id idx, const Vector3T<signed_coord_t> &loc) const;
+    bool _packet_candidate(const part_id idx) const;
+    void _update_packet(const unsigned int causality_range, const int overflow_level = -1, const unsigned int overflow_tile = 0);
+    const PacketCast * _take_packet_cast(const part_id idx, const RaycastInput &in);
+    void _mark_color_dirty(const coord_t x, const coord_t y, const coord_t z);
+    void _resolve_colors();
+    void _set_color_data_at(const coord_t x, const coord_t y, const coord_t z, const part_id i);
     void _update_shadow_map(const coord_t x, const coord_t y, const coord_t z);
-    bool _should_do_lighting(const Particle &part);
-    void _force_update_all_shadows();
+    bool _surrounded_by_type(const ElementType type, const coord_t x, const coord_t y, const coord_t z, const bool check_y) const;
+    bool _should_do_lighting(const ElementType type) const;
+    bool _is_lit(const part_id idx) const;
 };
 
 
@@ -107,7 +278,8 @@ private:
  *        before colliding is written to (ox, oy, oz)
  * 
  *        Pmap occupied is function that takes in Vector3T<coord_t> and returns
- *        PartSwapBehavior
+ *        PartSwapBehavior. It must not return NOOP for an empty voxel inside the
+ *        sim, those are answered from the occupancy bitmaps without calling it
  * @see https://github.com/francisengelmann/fast_voxel_traversal/tree/master
  *        Licensed under LICENSES/
  * @tparam compute_faces If true will output .faces for XYZ faces collided with
@@ -125,17 +297,24 @@ bool Simulation::raycast(const RaycastInput &in, RaycastOutput &out, const auto
     int largest_axis = util::argmax3(in.vx, in.vy, in.vz);
     bool early_stop = false;
 
-    if (largest_axis == 0 && PartSwapBehavior::NOOP == pmapOccupied(Vector3T<signed_coord_t>{ (signed_coord_t)(in.x + (in.vx < 0 ? -1 : 1)), (signed_coord_t)in.y, (signed_coord_t)in.z })) {
+    const auto blocked = [this, &pmapOccupied](const Vector3T<signed_coord_t> &loc) {
+        if (!REVERSE_BOUNDS_CHECK(loc.x, loc.y, loc.z) &&
+                !pmap.occupied(loc.x, loc.y, loc.z) && !photons.occupied(loc.x, loc.y, loc.z))
+            return false;
+        return PartSwapBehavior::NOOP == pmapOccupied(loc);
+    };
+
+    if (largest_axis == 0 && blocked(Vector3T<signed_coord_t>{ (signed_coord_t)(in.x + (in.vx < 0 ? -1 : 1)), (signed_coord_t)in.y, (signed_coord_t)in.z })) {
         early_stop = true;
         if (compute_faces)
             out.faces = RayCast::FACE_X;
     }
-    else if (largest_axis == 1 && PartSwapBehavior::NOOP == pmapOccupied(Vector3T<signed_coord_t>{ (signed_coord_t)in.x, (signed_coord_t)(in.y + (in.vy < 0 ? -1 : 1)), (signed_coord_t)in.z })) {
+    else if (largest_axis == 1 && blocked(Vector3T<signed_coord_t>{ (signed_coord_t)in.x, (signed_coord_t)(in.y + (in.vy < 0 ? -1 : 1)), (signed_coord_t)in.z })) {
         early_stop = true;
         if (compute_faces)
             out.faces = RayCast::FACE_Y;
     }
-    else if (largest_axis == 2 && PartSwapBehavior::NOOP == pmapOccupied(Vector3T<signed_coord_t>{ (signed_coord_t)in.x, (signed_coord_t)in.y, (signed_coord_t)(in.z + (in.vz < 0 ? -1 : 1)) })) {
+    else if (largest_axis == 2 && blocked(Vector3T<signed_coord_t>{ (signed_coord_t)in.x, (signed_coord_t)in.y, (signed_coord_t)(in.z + (in.vz < 0 ? -1 : 1)) })) {
         early_stop = true;
         if (compute_faces)
             out.faces = RayCast::FACE_Z;
@@ -161,25 +340,30 @@ bool Simulation::raycast(const RaycastInput &in, RaycastOutput &out, const auto
     const Vector3T<signed_coord_t> ray = last_voxel - current_voxel;
 
     // Step to take per direction (+-1)
-    const float dx = (ray.x >= 0) ? 1 : -1;
-    const float dy = (ray.y >= 0) ? 1 : -1;
-    const float dz = (ray.z >= 0) ? 1 : -1;
+    const signed_coord_t dx = (ray.x >= 0) ? 1 : -1;
+    const signed_coord_t dy = (ray.y >= 0) ? 1 : -1;
+    const signed_coord_t dz = (ray.z >= 0) ? 1 : -1;
 
-    const Vector3 next_voxel_boundary{ in.x + dx, in.y + dy, in.z + dz };
-
-    // tMaxX, tMaxY, tMaxZ -- distance until next intersection with voxel-border
-    // the value of t at which the ray crosses the first vertical voxel boundary
-    float tMaxX = (ray.x != 0) ? (dx) / ray.x : std::numeric_limits<float>::max();
-    float tMaxY = (ray.y != 0) ? (dy) / ray.y : std::numeric_limits<float>::max();
-    float tMaxZ = (ray.z != 0) ? (dz) / ray.z : std::numeric_limits<float>::max();
+    // t runs from 0 to 1 along the ray, scaled by the product of the nonzero
+    // ray lengths so every voxel crossing is an exact integer. Ties and
+    // empty space skipping (below) then can't depend on rounding
+    const int64_t t_scale = static_cast<int64_t>(std::max(1, std::abs(ray.x))) *
+        std::max(1, std::abs(ray.y)) * std::max(1, std::abs(ray.z));
+    constexpr int64_t T_NEVER = std::numeric_limits<int64_t>::max();
 
     // tDeltaX, tDeltaY, tDeltaZ --
     // how far along the ray we must move for the horizontal component to equal the width of a voxel
     // the direction in which we traverse the grid
-    // can only be FLT_MAX if we never go in that direction
-    const float tDeltaX = (ray.x != 0) ? 1.0f / ray.x * dx : std::numeric_limits<float>::max();
-    const float tDeltaY = (ray.y != 0) ? 1.0f / ray.y * dy : std::numeric_limits<float>::max();
-    const float tDeltaZ = (ray.z != 0) ? 1.0f / ray.z * dz : std::numeric_limits<float>::max();
+    // can only be T_NEVER if we never go in that direction
+    const int64_t tDeltaX = (ray.x != 0) ? t_scale / std::abs(ray.x) : T_NEVER;
+    const int64_t tDeltaY = (ray.y != 0) ? t_scale / std::abs(ray.y) : T_NEVER;
+    const int64_t tDeltaZ = (ray.z != 0) ? t_scale / std::abs(ray.z) : T_NEVER;
+
+    // tMaxX, tMaxY, tMaxZ -- distance until next intersection with voxel-border
+    // the value of t at which the ray crosses the first vertical voxel boundary
+    int64_t tMaxX = tDeltaX;
+    int64_t tMaxY = tDeltaY;
+    int64_t tMaxZ = tDeltaZ;
 
     if (ray.x < 0 && current_voxel.x != last_voxel.x) { diff.x--; }
     if (ray.y < 0 && current_voxel.y != last_voxel.y) { diff.y--; }
@@ -189,7 +373,7 @@ bool Simulation::raycast(const RaycastInput &in, RaycastOutput &out, const auto
     // prev is now, final is the voxel we will collide with if we continue
     // down our current trajectory
     // Precondition: prev_loc != final_loc
-    auto getFaces = [this, &pmapOccupied](const Vector3T<signed_coord_t> &prev_loc, const Vector3T<signed_coord_t> &final_loc) -> RayCast::RayHitFace {
+    auto getFaces = [&blocked](const Vector3T<signed_coord_t> &prev_loc, const Vector3T<signed_coord_t> &final_loc) -> RayCast::RayHitFace {
         RayCast::RayHitFace faces = 0;
 
         if ((prev_loc.x != final_loc.x) + (prev_loc.y != final_loc.y) + (prev_loc.z != final_loc.z) == 1) {
@@ -200,57 +384,136 @@ bool Simulation::raycast(const RaycastInput &in, RaycastOutput &out, const auto
             if (prev_loc.z != final_loc.z)
                 faces |= RayCast::FACE_Z;
         } else {
-            if (PartSwapBehavior::NOOP == pmapOccupied(Vector3T<signed_coord_t>{ final_loc.x, prev_loc.y, prev_loc.z }))
+            if (blocked(Vector3T<signed_coord_t>{ final_loc.x, prev_loc.y, prev_loc.z }))
                 faces |= RayCast::FACE_X;
-            if (PartSwapBehavior::NOOP == pmapOccupied(Vector3T<signed_coord_t>{ prev_loc.x, final_loc.y, prev_loc.z }))
+            if (blocked(Vector3T<signed_coord_t>{ prev_loc.x, final_loc.y, prev_loc.z }))
                 faces |= RayCast::FACE_Y;
-            if (PartSwapBehavior::NOOP == pmapOccupied(Vector3T<signed_coord_t>{ prev_loc.x, prev_loc.y, final_loc.z }))
+            if (blocked(Vector3T<signed_coord_t>{ prev_loc.x, prev_loc.y, final_loc.z }))
                 faces |= RayCast::FACE_Z;
         }
         return faces;
     };
 
-    while (current_voxel != last_voxel) {
-        previous_voxel = current_voxel;
+    // Low bits of a coordinate right after it steps into a new 2^OCCUPANCY_CELL_SHIFT
+    // cell, so step() can tell when empty space skipping should look again
+    constexpr signed_coord_t cell_mask = (1 << OCCUPANCY_CELL_SHIFT) - 1;
+    const signed_coord_t cell_entry_x = dx > 0 ? 0 : cell_mask;
+    const signed_coord_t cell_entry_y = dy > 0 ? 0 : cell_mask;
+    const signed_coord_t cell_entry_z = dz > 0 ? 0 : cell_mask;
 
+    // One voxel along the ray, returns whether it entered a new cell
+    const auto step = [&]() -> bool {
         if (tMaxX < tMaxY) {
             if (tMaxX < tMaxZ) {
                 current_voxel.x += dx;
                 tMaxX += tDeltaX;
+                return (current_voxel.x & cell_mask) == cell_entry_x;
             } else {
                 current_voxel.z += dz;
                 tMaxZ += tDeltaZ;
+                return (current_voxel.z & cell_mask) == cell_entry_z;
             }
         } else {
             if (tMaxY < tMaxZ) {
                 current_voxel.y += dy;
                 tMaxY += tDeltaY;
+                return (current_voxel.y & cell_mask) == cell_entry_y;
             } else {
                 current_voxel.z += dz;
                 tMaxZ += tDeltaZ;
+                return (current_voxel.z & cell_mask) == cell_entry_z;
             }
         }
+    };
 
-        if (PartSwapBehavior::NOOP == pmapOccupied(current_voxel)) {
-            auto voxel = take_intersect ? current_voxel : previous_voxel;
-            out.x = voxel.x;
-            out.y = voxel.y;
-            out.z = voxel.z;
-            out.move = PartSwapBehavior::SWAP;
+    // Empty space skipping: when the ray is in a 32^3 block or 16^3 cell without
+    // parts (in either map), every voxel it would visit inside is passable, so
+    // take all its steps inside at once. It ends up exactly where stepping one
+    // voxel at a time would, so results don't depend on raycast_skip_empty
+    // Only cells entirely inside the sim qualify, the border blocks rays
+    // A leap costs about as much as 8 plain steps, hence the coarse cells
+    const auto empty_cell_shift = [this](const Vector3T<signed_coord_t> &loc) -> unsigned int {
+        const auto inside = [&loc](const unsigned int shift) {
+            const signed_coord_t mask = (1 << shift) - 1;
+            return (loc.x & ~mask) >= 1 && (loc.x | mask) <= static_cast<signed_coord_t>(XRES - 2) &&
+                (loc.y & ~mask) >= 1 && (loc.y | mask) <= static_cast<signed_coord_t>(YRES - 2) &&
+                (loc.z & ~mask) >= 1 && (loc.z | mask) <= static_cast<signed_coord_t>(ZRES - 2);
+        };
+        const auto &p = pmap.occupancy(), &e = photons.occupancy();
+        if (!inside(OCCUPANCY_CELL_SHIFT) || !p.cell_empty(loc.x, loc.y, loc.z) || !e.cell_empty(loc.x, loc.y, loc.z))
+            return 0;
+        if (inside(OCCUPANCY_BLOCK_SHIFT) && p.block_empty(loc.x, loc.y, loc.z) && e.block_empty(loc.x, loc.y, loc.z))
+            return OCCUPANCY_BLOCK_SHIFT;
+        return OCCUPANCY_CELL_SHIFT;
+    };
 
-            if (compute_faces)
-                out.faces = getFaces(previous_voxel, current_voxel);
+    // Take every step before the first one that leaves the 2^shift cell of the
+    // current voxel. Returns true if the ray ends inside the cell instead
+    const auto leap = [&](const unsigned int shift) -> bool {
+        const signed_coord_t mask = (1 << shift) - 1;
+        const auto exit_time = [mask](const signed_coord_t pos, const signed_coord_t last,
+                const signed_coord_t dir, const int64_t t_max, const int64_t t_delta) {
+            const int64_t steps_inside = dir > 0 ? mask - (pos & mask) : pos & mask;
+            return (dir && std::abs(last - pos) > steps_inside) ? t_max + steps_inside * t_delta : T_NEVER;
+        };
+        const int64_t t_exit = std::min({
+            exit_time(current_voxel.x, last_voxel.x, ray.x, tMaxX, tDeltaX),
+            exit_time(current_voxel.y, last_voxel.y, ray.y, tMaxY, tDeltaY),
+            exit_time(current_voxel.z, last_voxel.z, ray.z, tMaxZ, tDeltaZ) });
+        if (t_exit == T_NEVER) {
+            current_voxel = last_voxel;
             return true;
         }
-    }
 
-    out.x = current_voxel.x;
-    out.y = current_voxel.y;
-    out.z = current_voxel.z;
-    if (compute_faces)
-        out.faces = 0; // No faces to bounce off
-    out.move = PartSwapBehavior::SWAP;
-    return false;
+        const auto advance = [t_exit](signed_coord_t &pos, const signed_coord_t d, int64_t &t_max, const int64_t t_delta) {
+            // At most 2^shift - 1 steps, cheaper than dividing
+            for (; t_max < t_exit; t_max += t_delta)
+                pos += d;
+        };
+        advance(current_voxel.x, dx, tMaxX, tDeltaX);
+        advance(current_voxel.y, dy, tMaxY, tDeltaY);
+        advance(current_voxel.z, dz, tMaxZ, tDeltaZ);
+        return false;
+    };
+
+    // The loop is instantiated with and without skipping so the plain walk
+    // pays nothing for it. Cells are only looked up when a step enters a new one
+    const auto march = [&](const auto skip_empty) -> bool {
+        bool new_cell = true;
+        while (current_voxel != last_voxel) {
+            if constexpr (skip_empty) {
+                if (new_cell) {
+                    const unsigned int shift = empty_cell_shift(current_voxel);
+                    if (shift && leap(shift))
+                        break;
+                }
+            }
+
+            previous_voxel = current_voxel;
+            new_cell = step();
+
+            if (blocked(current_voxel)) {
+                auto voxel = take_intersect ? current_voxel : previous_voxel;
+                out.x = voxel.x;
+                out.y = voxel.y;
+                out.z = voxel.z;
+                out.move = PartSwapBehavior::SWAP;
+
+                if (compute_faces)
+                    out.faces = getFaces(previous_voxel, current_voxel);
+                return true;
+            }
+        }
+
+        out.x = current_voxel.x;
+        out.y = current_voxel.y;
+        out.z = current_voxel.z;
+        if (compute_faces)
+            out.faces = 0; // No faces to bounce off
+        out.move = PartSwapBehavior::SWAP;
+        return false;
+    };
+    return raycast_skip_empty ? march(std::true_type{}) : march(std::false_type{});
 }
 
 #endif
\ No newline at end of file
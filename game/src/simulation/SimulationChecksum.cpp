@@ -0,0 +1,86 @@
+#include "Simulation.h"
+#include "WorldChecksum.h"
+#include "../util/profiler.h"
+
+#include <vector>
+
+// Ids per chunk when hashing parts in parallel
+constexpr part_id CHECKSUM_PART_CHUNK = 16384;
+
+/**
+ * @brief Hash of everything that decides how the simulation continues:
+ *        every live part's fields, which element is in each voxel of pmap
+ *        and photons, and the air cells. Computed in parallel, the result
+ *        does not depend on the thread count
+ *
+ *        Part ids are left out, parts are summed and the maps only hash
+ *        the element type. Renumbering (compact_parts, a different
+ *        allocator) keeps the checksum, as does the map storage layout
+ *        Only call between frames
+ */
+WorldChecksum Simulation::checksum() const {
+    PROFILE_ZONE("checksum");
+    using namespace ChecksumHash;
+
+    const part_id max_id = maxId.load(std::memory_order_relaxed);
+    const part_id part_chunks = (max_id + CHECKSUM_PART_CHUNK - 1) / CHECKSUM_PART_CHUNK;
+    std::vector<uint64_t> pmap_slices(ZRES), photon_slices(ZRES), air_slices(AIR_ZRES);
+    uint64_t parts_sum = 0;
+
+    #pragma omp parallel num_threads(sim_thread_count)
+    {
+        #pragma omp for schedule(dynamic, 1) reduction(+:parts_sum) nowait
+        for (part_id chunk = 0; chunk < part_chunks; chunk++) {
+            const part_id end = std::min(max_id, (chunk + 1) * CHECKSUM_PART_CHUNK);
+            for (part_id i = std::max(1, chunk * CHECKSUM_PART_CHUNK); i < end; i++) {
+                if (!parts.type[i]) continue;
+                const auto part = parts[i];
+                uint64_t hash = static_cast<uint16_t>(part.type);
+                hash = combine(hash, static_cast<uint64_t>(part.ctype) << 16 | static_cast<uint16_t>(part.life));
+                hash = combine(hash, bits(part.x) << 32 | bits(part.y));
+                hash = combine(hash, bits(part.z) << 32 | bits(part.vx));
+                hash = combine(hash, bits(part.vy) << 32 | bits(part.vz));
+                hash = combine(hash, bits(part.temp) << 32 | static_cast<uint64_t>(part.tmp1) << 16 | static_cast<uint16_t>(part.tmp2));
+                hash = combine(hash, static_cast<RGBA>(part.dcolor).as_ABGR());
+                parts_sum += mix(hash); // Order free, see above
+            }
+        }
+
+        #pragma omp for schedule(dynamic, 4) nowait
+        for (unsigned int z = 0; z < ZRES; z++) {
+            uint64_t pmap_hash = z, photon_hash = z;
+            for (unsigned int y = 0; y < YRES; y++)
+            for (unsigned int x = 0; x < XRES; x++) {
+                const uint64_t voxel = static_cast<uint64_t>(y * XRES + x) << 32;
+                if (pmap(x, y, z))
+                    pmap_hash = combine(pmap_hash, voxel | TYP(pmap(x, y, z)));
+                if (photons(x, y, z))
+                    photon_hash = combine(photon_hash, voxel | TYP(photons(x, y, z)));
+            }
+            pmap_slices[z] = pmap_hash;
+            photon_slices[z] = photon_hash;
+        }
+
+        #pragma omp for schedule(dynamic, 1)
+        for (unsigned int z = 0; z < AIR_ZRES; z++) {
+            uint64_t hash = z;
+            for (unsigned int y = 0; y < AIR_YRES; y++)
+            for (unsigned int x = 0; x < AIR_XRES; x++) {
+                const auto &cell = air.cells[z][y][x].data;
+                hash = combine(hash, bits(cell[PRESSURE_IDX]) << 32 | bits(cell[VX_IDX]));
+                hash = combine(hash, bits(cell[VY_IDX]) << 32 | bits(cell[VZ_IDX]));
+            }
+            air_slices[z] = hash;
+        }
+    }
+
+    WorldChecksum out;
+    out.parts = mix(parts_sum ^ parts_count);
+    for (unsigned int z = 0; z < ZRES; z++) {
+        out.pmap = combine(out.pmap, pmap_slices[z]);
+        out.photons = combine(out.photons, photon_slices[z]);
+    }
+    for (unsigned int z = 0; z < AIR_ZRES; z++)
+        out.air = combine(out.air, air_slices[z]);
+    return out;
+}
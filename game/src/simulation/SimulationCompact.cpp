@@ -0,0 +1,124 @@
+#include "Simulation.h"
+#include "../util/morton.h"
+#include "../util/profiler.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+// Parts are sorted by the Morton code of their voxel, bucketed first by its
+// top bits (one bucket per 16^3 block) so the sort is split across threads
+constexpr unsigned int COMPACT_BUCKET_SHIFT = 12;
+constexpr unsigned int COMPACT_BUCKETS = 1 << (24 - COMPACT_BUCKET_SHIFT);
+
+/**
+ * @brief Renumber the live parts 1 to parts_count in Morton order of their
+ *        position, so nearby parts are nearby in memory and the tile sweeps
+ *        read parts close to sequentially. Ids in pmap / photons are rewritten
+ *        and maxId shrinks to the live count again
+ *        Only call between frames, every part id held elsewhere is invalidated
+ */
+void Simulation::compact_parts() {
+    PROFILE_ZONE("compact_parts");
+    SimulationStats::ScopedTimer timer(stats, SimPhase::COMPACT_PARTS);
+
+    const part_id old_max = maxId.load(std::memory_order_relaxed);
+    part_id count = 0;
+    std::vector<uint64_t> keys;      // Morton code << 32 | old id, old id breaks ties
+    std::vector<part_id> old_ids;    // [new id - 1]
+    std::vector<part_id> remap(std::max(old_max, 1), 0); // [old id] new id
+    std::vector<uint32_t> bucket_offsets;  // [thread][bucket]
+    std::vector<uint32_t> bucket_start(COMPACT_BUCKETS + 1);
+
+    #pragma omp parallel num_threads(sim_thread_count)
+    {
+        const int tid = omp_get_thread_num();
+        const int thread_count = omp_get_num_threads();
+        const auto key_of = [this](const part_id i) {
+            const auto part = parts[i];
+            return static_cast<uint64_t>(util::morton_decode8(part.rx, part.ry, part.rz)) << 32 | static_cast<uint64_t>(i);
+        };
+
+        #pragma omp single
+        bucket_offsets.assign(static_cast<std::size_t>(thread_count) * COMPACT_BUCKETS, 0);
+
+        // Count per thread and bucket, then scatter with the same static
+        // schedule so every thread writes only its own slots
+        uint32_t * offsets = &bucket_offsets[static_cast<std::size_t>(tid) * COMPACT_BUCKETS];
+        #pragma omp for schedule(static)
+        for (part_id i = 1; i < old_max; i++)
+            if (parts.type[i])
+                offsets[key_of(i) >> (32 + COMPACT_BUCKET_SHIFT)]++;
+
+        #pragma omp single
+        {
+            uint32_t total = 0;
+            for (unsigned int bucket = 0; bucket < COMPACT_BUCKETS; bucket++) {
+                bucket_start[bucket] = total;
+                for (int t = 0; t < thread_count; t++) {
+                    uint32_t &offset = bucket_offsets[static_cast<std::size_t>(t) * COMPACT_BUCKETS + bucket];
+                    const uint32_t bucket_count = offset;
+                    offset = total;
+                    total += bucket_count;
+                }
+            }
+            bucket_start[COMPACT_BUCKETS] = total;
+            count = static_cast<part_id>(total);
+            keys.resize(count);
+            old_ids.resize(count);
+        }
+
+        #pragma omp for schedule(static)
+        for (part_id i = 1; i < old_max; i++) {
+            if (parts.type[i]) {
+                const uint64_t key = key_of(i);
+                keys[offsets[key >> (32 + COMPACT_BUCKET_SHIFT)]++] = key;
+            }
+        }
+
+        #pragma omp for schedule(dynamic, 16)
+        for (unsigned int bucket = 0; bucket < COMPACT_BUCKETS; bucket++)
+            std::sort(keys.begin() + bucket_start[bucket], keys.begin() + bucket_start[bucket + 1]);
+
+        #pragma omp for schedule(static)
+        for (part_id k = 0; k < count; k++) {
+            const part_id i = static_cast<part_id>(keys[k] & 0xFFFFFFFF);
+            old_ids[k] = i;
+            remap[i] = k + 1;
+        }
+    }
+
+    #ifdef DEBUG
+    if (static_cast<uint32_t>(count) != parts_count)
+        throw std::logic_error("compact_parts: parts_count does not match the live parts");
+    #endif
+
+    parts.reorder(old_ids.data(), count, old_max);
+
+    // Only the y range of each z slice can have parts
+    #pragma omp parallel for schedule(dynamic, 4) num_threads(sim_thread_count)
+    for (unsigned int z = 1; z < ZRES - 1; z++) {
+        for (unsigned int y = min_y_per_zslice[z - 1]; y <= max_y_per_zslice[z - 1]; y++)
+        for (unsigned int x = 1; x < XRES - 1; x++) {
+            if (pmap(x, y, z))
+                pmap.set(x, y, z, PMAP(TYP(pmap(x, y, z)), remap[ID(pmap(x, y, z))]));
+            if (photons(x, y, z))
+                photons.set(x, y, z, PMAP(TYP(photons(x, y, z)), remap[ID(photons(x, y, z))]));
+        }
+    }
+
+    // Dead parts still in the list (dropped by the next merge anyway) map to 0
+    for (auto &i : unmapped_parts)
+        i = i < old_max ? remap[i] : 0;
+    std::erase(unmapped_parts, 0);
+
+    // Still sorted by id for _update_energy_parts
+    for (auto &i : energy_parts)
+        i = i < old_max ? remap[i] : 0;
+    std::erase(energy_parts, 0);
+    std::sort(energy_parts.begin(), energy_parts.end());
+
+    part_allocator.reset(count + 1);
+    maxId.store(count ? count + 1 : 0, std::memory_order_relaxed);
+}
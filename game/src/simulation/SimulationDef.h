@@ -7,8 +7,8 @@ using coord_t = uint8_t;
 using signed_coord_t = int16_t;
 using ElementType = unsigned int;
 
-// Must be signed, negative values are used for pfree
-// and error codes in some functions
+// Must be signed, negative values are used for
+// error codes in some functions
 using part_id = int32_t;
 using pmap_id = int32_t; // This is ID and type merged into 1 32 bit value
 
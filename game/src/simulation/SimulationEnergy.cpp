@@ -0,0 +1,305 @@
+#include "Simulation.h"
+#include "ElementClasses.h"
+#include "../util/math.h"
+#include "../util/profiler.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <vector>
+
+// Energy parts of ballistic types (see _init_can_move) skip the tile passes.
+// They only stop at matter and the sim border and never change pmap, so once
+// matter is done moving for the frame they can all move at the same time:
+// each thread advances a share of energy_parts reading pmap only, then the
+// photons entries / colors are updated one octree block at a time
+
+// Moves are applied by octree block (so no two threads write the same one)
+// and within it by 16^3 cell, which keeps the maps' cache lines warm
+constexpr unsigned int ENERGY_BLOCKS = X_BLOCKS * Y_BLOCKS * Z_BLOCKS;
+constexpr unsigned int ENERGY_CELL_SHIFT = 4;
+constexpr unsigned int ENERGY_CELLS_PER_AXIS = OCTREE_BLOCK_DIM >> ENERGY_CELL_SHIFT;
+constexpr unsigned int ENERGY_CELLS_PER_BLOCK = ENERGY_CELLS_PER_AXIS * ENERGY_CELLS_PER_AXIS * ENERGY_CELLS_PER_AXIS;
+constexpr unsigned int ENERGY_BUCKETS = ENERGY_BLOCKS * ENERGY_CELLS_PER_BLOCK;
+
+static unsigned int energy_bucket(const coord_t x, const coord_t y, const coord_t z) {
+    constexpr unsigned int mask = ENERGY_CELLS_PER_AXIS - 1;
+    const unsigned int block = (x / OCTREE_BLOCK_DIM) + (y / OCTREE_BLOCK_DIM) * X_BLOCKS + (z / OCTREE_BLOCK_DIM) * X_BLOCKS * Y_BLOCKS;
+    const unsigned int cell = ((x >> ENERGY_CELL_SHIFT) & mask) +
+        ((y >> ENERGY_CELL_SHIFT) & mask) * ENERGY_CELLS_PER_AXIS +
+        ((z >> ENERGY_CELL_SHIFT) & mask) * ENERGY_CELLS_PER_AXIS * ENERGY_CELLS_PER_AXIS;
+    return block * ENERGY_CELLS_PER_BLOCK + cell;
+}
+
+/**
+ * @brief Stable counting sort of moves by the bucket of the voxel
+ *        they left (to_voxel false) or entered (to_voxel true)
+ */
+static void sort_energy_moves(const std::vector<Simulation::EnergyMove> &moves, std::vector<Simulation::EnergyMove> &sorted,
+        std::vector<uint32_t> &start, const bool to_voxel) {
+    const auto bucket_of = [to_voxel](const Simulation::EnergyMove &move) {
+        return to_voxel ? energy_bucket(move.x2, move.y2, move.z2) : energy_bucket(move.x1, move.y1, move.z1);
+    };
+
+    // Counts go 2 slots ahead, see _prepare_overflow_level
+    start.assign(ENERGY_BUCKETS + 2, 0);
+    for (const auto &move : moves)
+        start[bucket_of(move) + 2]++;
+    for (unsigned int bucket = 2; bucket < ENERGY_BUCKETS + 2; bucket++)
+        start[bucket] += start[bucket - 1];
+
+    sorted.resize(moves.size());
+    for (const auto &move : moves)
+        sorted[start[bucket_of(move) + 1]++] = move;
+}
+
+/**
+ * @brief Move every part in energy_parts along its velocity, bouncing off
+ *        matter as _raycast_movement would. Energy parts pass through each
+ *        other, the last one to enter a voxel gets its photons entry
+ *        Call outside of a parallel region once pmap won't change, it starts its own
+ */
+void Simulation::_update_energy_parts() {
+    PROFILE_ZONE("update energy parts");
+    SimulationStats::ScopedTimer timer(stats, SimPhase::UPDATE_ENERGY);
+    if (!ballistic_energy || energy_parts.empty())
+        return;
+
+    #pragma omp parallel num_threads(sim_thread_count)
+    {
+        const int thread_count = omp_get_num_threads();
+        auto &scratch = thread_scratch[omp_get_thread_num()];
+        scratch.energy_moves.clear();
+
+        // Static, so the threads' moves are in energy_parts order when taken in thread order
+        #pragma omp for schedule(static)
+        for (std::size_t start = 0; start < energy_parts.size(); start += SIM_PACKET_PARTS)
+            _advance_energy_parts(&energy_parts[start],
+                static_cast<unsigned int>(std::min<std::size_t>(SIM_PACKET_PARTS, energy_parts.size() - start)),
+                scratch.energy_moves);
+
+        sort_energy_moves(scratch.energy_moves, scratch.energy_leaving, scratch.leaving_start, false);
+        sort_energy_moves(scratch.energy_moves, scratch.energy_arriving, scratch.arriving_start, true);
+        #pragma omp barrier
+
+        // A part that was covered by another one left nothing behind,
+        // one that uncovers another gives it the entry back in _apply_bookkeeping
+        // Colors are set right away (energy shows over matter, as in _resolve_colors),
+        // the thread that has the block is the only one writing its octree
+        #pragma omp for schedule(dynamic, 1)
+        for (unsigned int block = 0; block < ENERGY_BLOCKS; block++) {
+            for (unsigned int bucket = block * ENERGY_CELLS_PER_BLOCK; bucket < (block + 1) * ENERGY_CELLS_PER_BLOCK; bucket++)
+            for (int t = 0; t < thread_count; t++) {
+                const auto &other = thread_scratch[t];
+                for (uint32_t k = other.leaving_start[bucket]; k < other.leaving_start[bucket + 1]; k++) {
+                    const auto &move = other.energy_leaving[k];
+                    if (ID(photons(move.x1, move.y1, move.z1)) == move.id) {
+                        photons.set(move.x1, move.y1, move.z1, 0);
+                        _set_color_data_at(move.x1, move.y1, move.z1, ID(pmap(move.x1, move.y1, move.z1)));
+                    }
+                }
+            }
+        }
+
+        #pragma omp for schedule(dynamic, 1)
+        for (unsigned int block = 0; block < ENERGY_BLOCKS; block++) {
+            for (unsigned int bucket = block * ENERGY_CELLS_PER_BLOCK; bucket < (block + 1) * ENERGY_CELLS_PER_BLOCK; bucket++)
+            for (int t = 0; t < thread_count; t++) {
+                const auto &other = thread_scratch[t];
+                for (uint32_t k = other.arriving_start[bucket]; k < other.arriving_start[bucket + 1]; k++) {
+                    const auto &move = other.energy_arriving[k];
+                    if (photons(move.x2, move.y2, move.z2))
+                        _record_unmapped(ID(photons(move.x2, move.y2, move.z2)));
+                    photons.set(move.x2, move.y2, move.z2, PMAP(parts.type[move.id], move.id));
+                    _set_color_data_at(move.x2, move.y2, move.z2, move.id);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Advance up to SIM_PACKET_PARTS consecutive entries of energy_parts,
+ *        their movement raycasts are made as one packet
+ * @param moves Parts that changed voxel are appended to it
+ */
+void Simulation::_advance_energy_parts(const part_id * ids, const unsigned int count, std::vector<EnergyMove> &moves) {
+    part_id move_ids[SIM_PACKET_PARTS];
+    RaycastInput in[SIM_PACKET_PARTS];
+    RaycastOutput out[SIM_PACKET_PARTS];
+    bool hit[SIM_PACKET_PARTS];
+    unsigned int move_count = 0;
+
+    // The rays that need to be cast, the others cross only empty space
+    unsigned int cast_idx[SIM_PACKET_PARTS];
+    part_id cast_ids[SIM_PACKET_PARTS];
+    RaycastInput cast_in[SIM_PACKET_PARTS];
+    RaycastOutput cast_out[SIM_PACKET_PARTS];
+    bool cast_hit[SIM_PACKET_PARTS];
+    unsigned int cast_count = 0;
+
+    for (unsigned int k = 0; k < count; k++) {
+        const part_id i = ids[k];
+        if (!ballistic_types[parts.type[i]]) // Killed since the last merge
+            continue;
+
+        auto part = parts[i];
+        if (!(part.vx || part.vy || part.vz))
+            continue;
+        part.vx = util::clampf(part.vx, -MAX_VELOCITY, MAX_VELOCITY);
+        part.vy = util::clampf(part.vy, -MAX_VELOCITY, MAX_VELOCITY);
+        part.vz = util::clampf(part.vz, -MAX_VELOCITY, MAX_VELOCITY);
+
+        move_ids[move_count] = i;
+        in[move_count] = RaycastInput {
+            .x = part.rx, .y = part.ry, .z = part.rz,
+            .vx = part.vx, .vy = part.vy, .vz = part.vz
+        };
+        if (_energy_ray_clear(in[move_count], out[move_count]))
+            hit[move_count] = false;
+        else {
+            cast_idx[cast_count] = move_count;
+            cast_ids[cast_count] = i;
+            cast_in[cast_count] = in[move_count];
+            cast_count++;
+        }
+        move_count++;
+    }
+
+    // Only pmap can stop the rays, and nothing writes it during this phase
+    if (raycast_packets && cast_count >= SIM_PACKET_MIN_RAYS)
+        raycast_packet(cast_ids, cast_in, cast_out, cast_hit, cast_count);
+    else {
+        for (unsigned int k = 0; k < cast_count; k++) {
+            const part_id i = cast_ids[k];
+            cast_hit[k] = raycast<true>(cast_in[k], cast_out[k], [i, this](const Vector3T<signed_coord_t> &loc) {
+                return _eval_ray_move(i, loc);
+            });
+        }
+    }
+    for (unsigned int k = 0; k < cast_count; k++) {
+        out[cast_idx[k]] = cast_out[k];
+        hit[cast_idx[k]] = cast_hit[k];
+    }
+
+    for (unsigned int k = 0; k < move_count; k++)
+        _advance_energy_part(move_ids[k], in[k], out[k], hit[k], moves);
+}
+
+/**
+ * @brief Whether a movement ray of a ballistic part can't hit anything: the
+ *        voxels it could look at are all inside the sim and their 16^3 cells
+ *        have no matter. out is then what raycast would give
+ */
+bool Simulation::_energy_ray_clear(const RaycastInput &in, RaycastOutput &out) const {
+    const int last_x = in.x + util::ceil_proper(in.vx);
+    const int last_y = in.y + util::ceil_proper(in.vy);
+    const int last_z = in.z + util::ceil_proper(in.vz);
+
+    // The path from the start to the last voxel, and the voxel ahead of the start
+    const int min_x = std::min<int>(in.x, last_x) - 1, max_x = std::max<int>(in.x, last_x) + 1;
+    const int min_y = std::min<int>(in.y, last_y) - 1, max_y = std::max<int>(in.y, last_y) + 1;
+    const int min_z = std::min<int>(in.z, last_z) - 1, max_z = std::max<int>(in.z, last_z) + 1;
+    if (REVERSE_BOUNDS_CHECK(min_x, min_y, min_z) || REVERSE_BOUNDS_CHECK(max_x, max_y, max_z))
+        return false;
+
+    const auto &occupancy = pmap.occupancy();
+    constexpr int cell = 1 << OCCUPANCY_CELL_SHIFT;
+    for (int z = min_z & ~(cell - 1); z <= max_z; z += cell)
+    for (int y = min_y & ~(cell - 1); y <= max_y; y += cell)
+    for (int x = min_x & ~(cell - 1); x <= max_x; x += cell)
+        if (!occupancy.cell_empty(x, y, z))
+            return false;
+
+    out.x = last_x;
+    out.y = last_y;
+    out.z = last_z;
+    out.faces = 0;
+    out.move = PartSwapBehavior::SWAP;
+    return true;
+}
+
+/**
+ * @brief Bounce and move one part from its movement raycast, the same
+ *        target _raycast_movement / try_move pick. Writes only the part itself,
+ *        the maps are updated from moves afterwards
+ */
+void Simulation::_advance_energy_part(const part_id idx, const RaycastInput &in, const RaycastOutput &out, const bool hit,
+        std::vector<EnergyMove> &moves) {
+    auto part = parts[idx];
+    bool no_move = true;
+
+    if (hit) {
+        no_move = out.x == in.x && out.y == in.y && out.z == in.z;
+
+        const float bounce = GetElements()[part.type].Collision;
+        if ((out.faces & RayCast::FACE_X).any()) part.vx *= bounce;
+        if ((out.faces & RayCast::FACE_Y).any()) part.vy *= bounce;
+        if ((out.faces & RayCast::FACE_Z).any()) part.vz *= bounce;
+
+        // Same early out as _raycast_movement
+        if (fabsf(part.vx) < 0.1f && fabsf(part.vy) < 0.1f && fabsf(part.vz) < 0.1f)
+            no_move = true;
+    }
+
+    float tx, ty, tz;
+    if (no_move) {
+        tx = ParticleStore::quantize_position(util::clampf(part.x + part.vx, 1.0f, XRES - 1.0f));
+        ty = ParticleStore::quantize_position(util::clampf(part.y + part.vy, 1.0f, YRES - 1.0f));
+        tz = ParticleStore::quantize_position(util::clampf(part.z + part.vz, 1.0f, ZRES - 1.0f));
+    } else {
+        tx = out.x;
+        ty = out.y;
+        tz = out.z;
+    }
+
+    const coord_t x = util::roundf(tx);
+    const coord_t y = util::roundf(ty);
+    const coord_t z = util::roundf(tz);
+    if (REVERSE_BOUNDS_CHECK(x, y, z))
+        return;
+
+    const coord_t oldx = part.rx, oldy = part.ry, oldz = part.rz;
+    if (x != oldx || y != oldy || z != oldz) {
+        if (pmap.occupied(x, y, z)) // Only matter stops a ballistic part
+            return;
+        moves.push_back(EnergyMove{ .id = idx, .x1 = oldx, .y1 = oldy, .z1 = oldz, .x2 = x, .y2 = y, .z2 = z });
+        _record_move(idx, oldx, oldy, oldz, x, y, z);
+        if (energy_wakes_tiles) {
+            wake_tiles_near(oldx, oldy, oldz);
+            wake_tiles_near(x, y, z);
+        }
+    }
+
+    part.x = tx;
+    part.y = ty;
+    part.z = tz;
+    part.rx = x;
+    part.ry = y;
+    part.rz = z;
+}
+
+/**
+ * @brief Add the ballistic energy parts created since the last call to
+ *        energy_parts and drop the ones killed, keeping it sorted by id so
+ *        _update_energy_parts reads parts in memory order
+ *        Serial, called from _apply_bookkeeping
+ */
+void Simulation::_merge_energy_parts() {
+    const std::size_t old_size = energy_parts.size();
+    uint32_t killed = 0;
+    for (auto &scratch : thread_scratch) {
+        auto &created = scratch.bookkeeping.energy;
+        energy_parts.insert(energy_parts.end(), created.begin(), created.end());
+        created.clear();
+        killed += scratch.bookkeeping.energy_killed;
+        scratch.bookkeeping.energy_killed = 0;
+    }
+    if (energy_parts.size() == old_size && !killed)
+        return;
+
+    // An id can be killed and reused within a frame, so it may be in twice
+    std::sort(energy_parts.begin() + old_size, energy_parts.end());
+    std::inplace_merge(energy_parts.begin(), energy_parts.begin() + old_size, energy_parts.end());
+    energy_parts.erase(std::unique(energy_parts.begin(), energy_parts.end()), energy_parts.end());
+    std::erase_if(energy_parts, [this](const part_id i) { return !ballistic_types[parts.type[i]]; });
+}
@@ -4,6 +4,7 @@
 #include "SimulationDef.h"
 #include "../util/types/heap_array.h"
 #include "../util/types/bitset8.h"
+#include "../util/types/dirty_pages.h"
 
 #include <cmath>
 
@@ -12,10 +13,12 @@ constexpr unsigned int OCTREE_BLOCK_DIM = 1 << OCTREE_BLOCK_DEPTH; // Sim split
 constexpr unsigned int X_BLOCKS = static_cast<unsigned int>(std::ceil(static_cast<float>(XRES) / OCTREE_BLOCK_DIM));
 constexpr unsigned int Y_BLOCKS = static_cast<unsigned int>(std::ceil(static_cast<float>(YRES) / OCTREE_BLOCK_DIM));
 constexpr unsigned int Z_BLOCKS = static_cast<unsigned int>(std::ceil(static_cast<float>(ZRES) / OCTREE_BLOCK_DIM));
-// Size (arr el. count) of contigious element chunks to upload and diff at a time for color_data
-constexpr unsigned int COLOR_DATA_CHUNK_SIZE = 16000; // Somewhat arbitrary
-constexpr unsigned int COLOR_DATA_CHUNK_COUNT = static_cast<unsigned int>(std::ceil(
-    (XRES * YRES * ZRES) / static_cast<float>(COLOR_DATA_CHUNK_SIZE)));
+// 64 bit words of a bitset with a bit per voxel of an octree block
+constexpr unsigned int COLOR_RESOLVED_BLOCK_WORDS = OCTREE_BLOCK_DIM * OCTREE_BLOCK_DIM * OCTREE_BLOCK_DIM / 64;
+// Size (arr el. count) of the pages color_data and color_flags are tracked for changes
+// and uploaded in. Small so one moving part uploads a few hundred bytes, not a whole slab
+constexpr unsigned int COLOR_DATA_PAGE_SIZE = 32;
+constexpr unsigned int COLOR_DATA_PAGE_COUNT = (XRES * YRES * ZRES + COLOR_DATA_PAGE_SIZE - 1) / COLOR_DATA_PAGE_SIZE;
 
 // Ambient occlusion counter block size
 constexpr unsigned int AO_BLOCK_SIZE = 12;
@@ -27,6 +30,11 @@ constexpr uint32_t AO_FLAT_IDX(coord_t x, coord_t y, coord_t z) {
     return (x / AO_BLOCK_SIZE) + (y / AO_BLOCK_SIZE) * AO_X_BLOCKS + (z / AO_BLOCK_SIZE) * AO_X_BLOCKS * AO_Y_BLOCKS;
 }
 
+// Shadow map cell a voxel projects onto (the map is indexed [y][x], this is y * SHADOW_MAP_X + x)
+constexpr uint32_t SHADOW_MAP_FLAT_IDX(coord_t x, coord_t y, coord_t z) {
+    return (x + (ZRES - z)) / SHADOW_MAP_SCALE + (y + (ZRES - z)) / SHADOW_MAP_SCALE * SHADOW_MAP_X;
+}
+
 // Graphics are stored as 8 bit texture, so can only fit 8 bits
 // Defaults should be when the flag = 0
 namespace GraphicsFlagsIdx {
@@ -51,19 +59,16 @@ class BitOctreeBlock;
 struct SimulationGraphics {
     util::heap_array<uint32_t, XRES * YRES * ZRES> color_data;
     util::heap_array<uint8_t, XRES * YRES * ZRES> color_flags;
-    util::heap_array<uint8_t, COLOR_DATA_CHUNK_COUNT> color_data_modified;
+    util::DirtyPages<COLOR_DATA_PAGE_COUNT> color_dirty; // Pages of color_data / color_flags changed since the last upload, see take_upload_spans
     util::heap_array<BitOctreeBlock, X_BLOCKS * Y_BLOCKS * Z_BLOCKS> octree_blocks;
     util::heap_array<int, AO_X_BLOCKS * AO_Y_BLOCKS * AO_Z_BLOCKS> ao_blocks;
     uint8_t shadow_map[SHADOW_MAP_Y][SHADOW_MAP_X];
-    bool shadows_force_update;
 
     SimulationGraphics() {
-        shadows_force_update = false;
         color_data.fill(0);
         color_flags.fill(0);
         ao_blocks.fill(0);
-        color_data_modified.fill(0);
-        std::fill(&shadow_map[0][0], &shadow_map[SHADOW_MAP_Y][SHADOW_MAP_X], 0);
+        std::fill(&shadow_map[0][0], &shadow_map[SHADOW_MAP_Y - 1][SHADOW_MAP_X], 0);
     }
 };
 
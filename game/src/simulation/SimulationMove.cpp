@@ -7,6 +7,7 @@
 #include "raylib.h"
 #include "raymath.h"
 
+#include <omp.h>
 #include <algorithm>
 #include <iostream>
 #include <vector>
@@ -24,11 +25,15 @@ void Simulation::move_behavior(const part_id idx) {
     if (el.State == ElementState::TYPE_SOLID || el.State == ElementState::TYPE_ENERGY)
         return; // Solids can't move, energy doesn't have custom behavior
 
-    auto &part = parts[idx];
+    auto part = parts[idx];
     const coord_t x = part.rx;
     const coord_t y = part.ry;
     const coord_t z = part.rz;
 
+    // Random numbers depend only on the frame and the part, not on which
+    // thread updates it or what was drawn before
+    auto part_rng = rng.stream(frame_count, idx);
+
     // Apply gravity
     Vector3 gravity_force{0.0f, 0.0f, 0.0f};
     bool gravity_radial_neighbors_occupied = false;
@@ -42,13 +47,7 @@ void Simulation::move_behavior(const part_id idx) {
                     part.vy -= el.Gravity;
                 break;
             case GravityMode::RADIAL:
-                gravity_radial_neighbors_occupied =
-                    TYP(pmap[z - 1][y][x]) == part.type &&
-                    TYP(pmap[z + 1][y][x]) == part.type &&
-                    TYP(pmap[z][y][x - 1]) == part.type &&
-                    TYP(pmap[z][y][x + 1]) == part.type &&
-                    TYP(pmap[z][y + 1][x]) == part.type &&
-                    TYP(pmap[z][y - 1][x]) == part.type;
+                gravity_radial_neighbors_occupied = _surrounded_by_type(part.type, x, y, z, true);
 
                 if (!gravity_radial_neighbors_occupied) {
                     gravity_force = Vector3{ XRES / 2 - part.x, YRES / 2 - part.y, ZRES / 2 - part.z };
@@ -73,15 +72,11 @@ void Simulation::move_behavior(const part_id idx) {
                 if (y > 1 && eval_move(idx, x, y - 1, z) != PartSwapBehavior::NOOP) // Particle can move down
                     return;
 
-                if ( // No neighboring spots anyways, terminate
-                    TYP(pmap[z - 1][y][x]) == part.type &&
-                    TYP(pmap[z + 1][y][x]) == part.type &&
-                    TYP(pmap[z][y][x - 1]) == part.type &&
-                    TYP(pmap[z][y][x + 1]) == part.type
-                ) return;
+                if (_surrounded_by_type(part.type, x, y, z, false)) // No neighboring spots anyways, terminate
+                    return;
 
-                float dx = rng.uniform(-el.Diffusion, el.Diffusion);
-                float dz = rng.uniform(-el.Diffusion, el.Diffusion);
+                float dx = part_rng.uniform(-el.Diffusion, el.Diffusion);
+                float dz = part_rng.uniform(-el.Diffusion, el.Diffusion);
                 const int newy = is_liquid ? y : y - 1;
 
                 if (REVERSE_BOUNDS_CHECK(x + util::ceil_proper(dx), newy, z + util::ceil_proper(dz)))
@@ -99,7 +94,7 @@ void Simulation::move_behavior(const part_id idx) {
                         auto pmapOccupied = [idx, this](const Vector3T<signed_coord_t> &loc) -> PartSwapBehavior {
                             if (REVERSE_BOUNDS_CHECK(loc.x, loc.y, loc.z))
                                 return PartSwapBehavior::NOOP;
-                            if (TYP(pmap[loc.z][loc.y][loc.x]) == parts[idx].type)
+                            if (TYP(pmap(loc.x, loc.y, loc.z)) == parts[idx].type)
                                 return PartSwapBehavior::SWAP;
                             return eval_move(idx, loc.x, loc.y, loc.z);
                         };
@@ -134,7 +129,7 @@ void Simulation::move_behavior(const part_id idx) {
                 ) {
                     if (gravity_radial_neighbors_occupied) return;
 
-                    Vector3 randv = rng.rand_perpendicular_vector(gravity_force);
+                    Vector3 randv = part_rng.rand_perpendicular_vector(gravity_force);
                     randv = el.Diffusion * util::norm_vector(randv);
 
                     auto nx = x + randv.x;
@@ -152,7 +147,7 @@ void Simulation::move_behavior(const part_id idx) {
         }
     }
     else if (el.State == ElementState::TYPE_GAS) {
-        Vector3 randv = rng.rand_norm_vector();
+        Vector3 randv = part_rng.rand_norm_vector();
         auto nx = x + el.Diffusion * randv.x;
         auto ny = y + el.Diffusion * randv.y;
         auto nz = z + el.Diffusion * randv.z;
@@ -170,7 +165,12 @@ void Simulation::move_behavior(const part_id idx) {
  * @param y Target y
  * @param z Target z
  */
-void Simulation::try_move(const part_id idx, const float tx, const float ty, const float tz, PartSwapBehavior behavior) {
+void Simulation::try_move(const part_id idx, float tx, float ty, float tz, PartSwapBehavior behavior) {
+    // Round to what parts can store first so the rounded position agrees with it
+    tx = ParticleStore::quantize_position(tx);
+    ty = ParticleStore::quantize_position(ty);
+    tz = ParticleStore::quantize_position(tz);
+
     const coord_t x = util::roundf(tx);
     const coord_t y = util::roundf(ty);
     const coord_t z = util::roundf(tz);
@@ -197,8 +197,7 @@ void Simulation::try_move(const part_id idx, const float tx, const float ty, con
         return;
     }
 
-    auto part_map = parts[idx].flag[PartFlags::IS_ENERGY] ? photons : pmap;
-    auto old_pmap_val = part_map[oldz][oldy][oldx];
+    auto &part_map = parts[idx].flag[PartFlags::IS_ENERGY] ? photons : pmap;
 
     if (behavior == PartSwapBehavior::NOT_EVALED_YET)
         behavior = eval_move(idx, x, y, z);
@@ -207,14 +206,21 @@ void Simulation::try_move(const part_id idx, const float tx, const float ty, con
         case PartSwapBehavior::NOOP:
             return;
         case PartSwapBehavior::SWAP:
-            swap_part(x, y, z, oldx, oldy, oldz, ID(part_map[z][y][x]), idx);
+            swap_part(x, y, z, oldx, oldy, oldz, ID(part_map(x, y, z)), idx);
             break;
         case PartSwapBehavior::OCCUPY_SAME:
-            part_map[oldz][oldy][oldx] = 0;
-            part_map[z][y][x] = old_pmap_val;
+            // Other parts can share either voxel, only this part's entry moves
+            // and one it covers gets it back once free (see _apply_bookkeeping)
+            if (ID(part_map(oldx, oldy, oldz)) == idx) {
+                part_map.set(oldx, oldy, oldz, 0);
+                _mark_color_dirty(oldx, oldy, oldz);
+            }
+            if (part_map(x, y, z))
+                _record_unmapped(ID(part_map(x, y, z)));
+            part_map.set(x, y, z, PMAP(parts[idx].type, idx));
 
-            _set_color_data_at(x, y, z, &parts[idx]);
-            _set_color_data_at(oldx, oldy, oldz, nullptr);
+            _mark_color_dirty(x, y, z);
+            _record_move(idx, oldx, oldy, oldz, x, y, z);
             break;
         // The special behavior is resolved into one of the three
         // cases above by eval_move
@@ -224,6 +230,8 @@ void Simulation::try_move(const part_id idx, const float tx, const float ty, con
             break;
         #endif
     }
+    wake_tiles_near(oldx, oldy, oldz);
+    wake_tiles_near(x, y, z);
 
     parts[idx].x = tx;
     parts[idx].y = ty;
@@ -239,37 +247,46 @@ void Simulation::try_move(const part_id idx, const float tx, const float ty, con
  */
 void Simulation::swap_part(const coord_t x1, const coord_t y1, const coord_t z1,
         const coord_t x2, const coord_t y2, const coord_t z2, const part_id id1, const part_id id2) {
-    _set_color_data_at(x1, y1, z1, id2 ? &parts[id2] : nullptr);
-    _set_color_data_at(x2, y2, z2, id1 ? &parts[id1] : nullptr);
+    parts.swap_positions(id1, id2);
+    if (parts[id1].type)
+        _record_move(id1, x1, y1, z1, x2, y2, z2);
+    if (parts[id2].type)
+        _record_move(id2, x2, y2, z2, x1, y1, z1);
 
-    std::swap(parts[id1].x, parts[id2].x);
-    std::swap(parts[id1].y, parts[id2].y);
-    std::swap(parts[id1].z, parts[id2].z);
-
-    std::swap(parts[id1].rx, parts[id2].rx);
-    std::swap(parts[id1].ry, parts[id2].ry);
-    std::swap(parts[id1].rz, parts[id2].rz);
-
-    auto part1_is_e = parts[id1].flag[PartFlags::IS_ENERGY];
+    // An empty spot (id 0) takes the map of the part moving into it
     auto part2_is_e = parts[id2].flag[PartFlags::IS_ENERGY];
+    auto part1_is_e = id1 ? parts[id1].flag[PartFlags::IS_ENERGY] : part2_is_e;
 
     if (!part1_is_e && !part2_is_e)
-        std::swap(pmap[z1][y1][x1], pmap[z2][y2][x2]);
-    else if (part1_is_e && part2_is_e)
-        std::swap(photons[z1][y1][x1], photons[z2][y2][x2]);
+        pmap.swap(x1, y1, z1, x2, y2, z2);
+    else if (part1_is_e && part2_is_e) {
+        if (!photons(x2, y2, z2) || ID(photons(x2, y2, z2)) == id2)
+            photons.swap(x1, y1, z1, x2, y2, z2);
+        else {
+            // id2 was covered by another energy part, which stays in the map
+            // so id1 (if any) is now the covered one
+            photons.set(x1, y1, z1, PMAP(parts[id2].type, id2));
+            if (id1)
+                _record_unmapped(id1);
+        }
+    }
     else {
         // Swapping energy with regular. May cause problems
         // if we displace a pmap onto something that can't normally
         // be displayed, but this option shouldn't be used anyways
-        std::swap(pmap[z1][y1][x1], pmap[z2][y2][x2]);
-        std::swap(photons[z1][y1][x1], photons[z2][y2][x2]);
+        pmap.swap(x1, y1, z1, x2, y2, z2);
+        photons.swap(x1, y1, z1, x2, y2, z2);
     }
+
+    _mark_color_dirty(x1, y1, z1);
+    _mark_color_dirty(x2, y2, z2);
 }
 
 
 // Try to move a particle with velocity to new location
 void Simulation::_raycast_movement(const part_id idx, const coord_t x, const coord_t y, const coord_t z) {
-    auto &part = parts[idx];
+    SimulationStats::ScopedTimer timer(stats, SimPhase::RAYCAST_MOVEMENT);
+    auto part = parts[idx];
     part.vx = util::clampf(part.vx, -MAX_VELOCITY, MAX_VELOCITY);
     part.vy = util::clampf(part.vy, -MAX_VELOCITY, MAX_VELOCITY);
     part.vz = util::clampf(part.vz, -MAX_VELOCITY, MAX_VELOCITY);
@@ -284,23 +301,31 @@ void Simulation::_raycast_movement(const part_id idx, const coord_t x, const coo
     // return true if it "hit" something (current spot is occupied or the next spot)
     // is outside of the simulation bounds
     auto pmapOccupied = [idx, this](const Vector3T<signed_coord_t> &loc) -> PartSwapBehavior {
-        if (REVERSE_BOUNDS_CHECK(loc.x, loc.y, loc.z))
-            return PartSwapBehavior::NOOP;
-        return eval_move(idx, loc.x, loc.y, loc.z);
+        return _eval_ray_move(idx, loc);
     };
 
     // Repeatedly ray cast until we "run out" of distance
     // Initial distance being the magnitude of the velocity vector
     float portion_velocity = 1.0f;
-    float org_dis = util::hypot(part.vx, part.vy, part.vz);
+    float org_dis = util::hypot<float>(part.vx, part.vy, part.vz);
+    bool first_cast = true;
 
     do {
-        hit = raycast<true>(RaycastInput {
+        const RaycastInput in {
             .x = sx, .y = sy, .z = sz,
             .vx = part.vx * portion_velocity,
             .vy = part.vy * portion_velocity,
             .vz = part.vz * portion_velocity
-        }, out, pmapOccupied);
+        };
+
+        // The first cast may have been made already in a packet, see _update_packet
+        const PacketCast * packet_cast = first_cast ? _take_packet_cast(idx, in) : nullptr;
+        first_cast = false;
+        if (packet_cast) {
+            out = packet_cast->out;
+            hit = packet_cast->hit;
+        } else
+            hit = raycast<true>(in, out, pmapOccupied);
 
         if (!hit) break;
 
@@ -315,7 +340,7 @@ void Simulation::_raycast_movement(const part_id idx, const coord_t x, const coo
         // The little velocity we have left is not enough to move to
         // another voxel, so the next raycast is always no_move, terminate early
         // Not exactly accurate but close enough
-        if (fabsf(part.vy) < 0.1f && fabsf(part.vx) < 0.1f && fabsf(part.vx) < 0.1f) {
+        if (fabsf(part.vx) < 0.1f && fabsf(part.vy) < 0.1f && fabsf(part.vz) < 0.1f) {
             no_move = true;
             break;
         }
@@ -333,6 +358,14 @@ void Simulation::_raycast_movement(const part_id idx, const coord_t x, const coo
     } else {
         try_move(idx, out.x, out.y, out.z, out.move);
     }
+
+    // The move wrote at most these two voxels (a swap moves the other part
+    // the other way), later casts of the packet check against them
+    auto &scratch = thread_scratch[omp_get_thread_num()];
+    if (!scratch.packet_casts.empty()) {
+        scratch.packet_writes.push_back(_pack_voxel(x, y, z));
+        scratch.packet_writes.push_back(_pack_voxel(part.rx, part.ry, part.rz));
+    }
 }
 
 /**
@@ -345,9 +378,14 @@ void Simulation::_raycast_movement(const part_id idx, const coord_t x, const coo
  * @return part swap behavior, special cases are resolved
  */
 PartSwapBehavior Simulation::eval_move(const part_id idx, const coord_t nx, const coord_t ny, const coord_t nz) const {
-    auto other_type = TYP(pmap[nz][ny][nx]);
-    if (!other_type) other_type = TYP(photons[nz][ny][nx]);
-    if (!other_type) return PartSwapBehavior::SWAP;
+    // Only read the (much larger) maps where the bitmaps say there is a part
+    ElementType other_type;
+    if (pmap.occupied(nx, ny, nz))
+        other_type = TYP(pmap(nx, ny, nz));
+    else if (photons.occupied(nx, ny, nz))
+        other_type = TYP(photons(nx, ny, nz));
+    else
+        return PartSwapBehavior::SWAP;
 
     auto this_type = parts[idx].type;
 
@@ -357,3 +395,22 @@ PartSwapBehavior Simulation::eval_move(const part_id idx, const coord_t nx, cons
     // Deal with special cases:
     return PartSwapBehavior::NOOP; // TODO
 }
+
+/**
+ * @brief Whether the x and z (and y if check_y) neighbors of (x, y, z) in pmap
+ *        are all of the given type. Checks the occupancy bitmap first, which
+ *        rules out most parts without reading the neighbors' types
+ */
+bool Simulation::_surrounded_by_type(const ElementType type, const coord_t x, const coord_t y, const coord_t z, const bool check_y) const {
+    const auto &occupancy = pmap.occupancy();
+    if ((occupancy.row_bits(x - 1, x + 1, y, z) & 0b101) != 0b101 ||
+            !occupancy.test(x, y, z - 1) || !occupancy.test(x, y, z + 1) ||
+            (check_y && (!occupancy.test(x, y - 1, z) || !occupancy.test(x, y + 1, z))))
+        return false;
+
+    return TYP(pmap(x, y, z - 1)) == type &&
+        TYP(pmap(x, y, z + 1)) == type &&
+        TYP(pmap(x - 1, y, z)) == type &&
+        TYP(pmap(x + 1, y, z)) == type &&
+        (!check_y || (TYP(pmap(x, y + 1, z)) == type && TYP(pmap(x, y - 1, z)) == type));
+}
@@ -0,0 +1,517 @@
+#include "Simulation.h"
+#include "ElementClasses.h"
+
+#include <omp.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+// The vector paths gather 32 bit halves of the occupancy words, which is only
+// the right half order on little endian x86
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RAYCAST_PACKET_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+    // Rays are stepped on exact integer t like Simulation::raycast. Its scale is
+    // the product of the ray lengths, at most (MAX_VELOCITY + 1)^3, and t stays
+    // below twice that, so 32 bit lanes can't overflow
+    constexpr int32_t PACKET_T_NEVER = std::numeric_limits<int32_t>::max();
+    static_assert(2 * (MAX_VELOCITY + 1) * (MAX_VELOCITY + 1) * (MAX_VELOCITY + 1) < PACKET_T_NEVER,
+        "Packet raycasts step t in 32 bits");
+
+    // Per lane state of a packet, struct of arrays so lanes load as vectors
+    struct alignas(64) PacketLanes {
+        int32_t x[RAYCAST_PACKET_LANES], y[RAYCAST_PACKET_LANES], z[RAYCAST_PACKET_LANES];
+        int32_t last_x[RAYCAST_PACKET_LANES], last_y[RAYCAST_PACKET_LANES], last_z[RAYCAST_PACKET_LANES];
+        int32_t dx[RAYCAST_PACKET_LANES], dy[RAYCAST_PACKET_LANES], dz[RAYCAST_PACKET_LANES];
+        int32_t t_max_x[RAYCAST_PACKET_LANES], t_max_y[RAYCAST_PACKET_LANES], t_max_z[RAYCAST_PACKET_LANES];
+        int32_t t_delta_x[RAYCAST_PACKET_LANES], t_delta_y[RAYCAST_PACKET_LANES], t_delta_z[RAYCAST_PACKET_LANES];
+    };
+
+#ifdef RAYCAST_PACKET_X86
+    // Step every active lane one voxel at a time, like raycast's step(). Lanes
+    // that reach a voxel outside the sim or with a part in pmap (or photons,
+    // for photon_lanes) are handed to resolve, which returns whether the ray
+    // stops there. Lanes that get to their last voxel are handed to finish. Returns the lanes still going once fewer than
+    // refill_below are, their state is stored back to lanes
+    template <class Resolve, class Finish>
+    __attribute__((target("avx512f")))
+    static uint32_t step_lanes_avx512(PacketLanes &lanes, const uint32_t active_lanes, const int refill_below,
+            const uint32_t photon_lanes, const int32_t * pmap_words, const int32_t * photon_words, Resolve &resolve, Finish &finish) {
+        __m512i x = _mm512_load_si512(lanes.x), y = _mm512_load_si512(lanes.y), z = _mm512_load_si512(lanes.z);
+        const __m512i last_x = _mm512_load_si512(lanes.last_x);
+        const __m512i last_y = _mm512_load_si512(lanes.last_y);
+        const __m512i last_z = _mm512_load_si512(lanes.last_z);
+        const __m512i dx = _mm512_load_si512(lanes.dx), dy = _mm512_load_si512(lanes.dy), dz = _mm512_load_si512(lanes.dz);
+        __m512i t_max_x = _mm512_load_si512(lanes.t_max_x);
+        __m512i t_max_y = _mm512_load_si512(lanes.t_max_y);
+        __m512i t_max_z = _mm512_load_si512(lanes.t_max_z);
+        const __m512i t_delta_x = _mm512_load_si512(lanes.t_delta_x);
+        const __m512i t_delta_y = _mm512_load_si512(lanes.t_delta_y);
+        const __m512i t_delta_z = _mm512_load_si512(lanes.t_delta_z);
+
+        const __m512i zero = _mm512_setzero_si512();
+        const __m512i one = _mm512_set1_epi32(1);
+        const __m512i low_5 = _mm512_set1_epi32(31);
+        const __m512i row_stride = _mm512_set1_epi32(OCCUPANCY_ROW_WORDS * 2); // In 32 bit halves
+        const __m512i y_stride = _mm512_set1_epi32(YRES);
+        // Inside is 1 to RES - 2, so c - 1 as unsigned is at most RES - 3
+        const __m512i max_x = _mm512_set1_epi32(XRES - 3);
+        const __m512i max_y = _mm512_set1_epi32(YRES - 3);
+        const __m512i max_z = _mm512_set1_epi32(ZRES - 3);
+
+        __mmask16 active = static_cast<__mmask16>(active_lanes);
+        while (__builtin_popcount(active) >= refill_below) {
+            const __mmask16 x_lt_y = _mm512_cmplt_epi32_mask(t_max_x, t_max_y);
+            const __mmask16 x_lt_z = _mm512_cmplt_epi32_mask(t_max_x, t_max_z);
+            const __mmask16 y_lt_z = _mm512_cmplt_epi32_mask(t_max_y, t_max_z);
+            const __mmask16 step_x = active & x_lt_y & x_lt_z;
+            const __mmask16 step_y = active & ~x_lt_y & y_lt_z;
+            const __mmask16 step_z = active & ~step_x & ~step_y;
+            x = _mm512_mask_add_epi32(x, step_x, x, dx);
+            y = _mm512_mask_add_epi32(y, step_y, y, dy);
+            z = _mm512_mask_add_epi32(z, step_z, z, dz);
+            t_max_x = _mm512_mask_add_epi32(t_max_x, step_x, t_max_x, t_delta_x);
+            t_max_y = _mm512_mask_add_epi32(t_max_y, step_y, t_max_y, t_delta_y);
+            t_max_z = _mm512_mask_add_epi32(t_max_z, step_z, t_max_z, t_delta_z);
+
+            const __mmask16 outside = active & (
+                _mm512_cmpgt_epu32_mask(_mm512_sub_epi32(x, one), max_x) |
+                _mm512_cmpgt_epu32_mask(_mm512_sub_epi32(y, one), max_y) |
+                _mm512_cmpgt_epu32_mask(_mm512_sub_epi32(z, one), max_z));
+            const __mmask16 inside = active & ~outside;
+
+            const __m512i word = _mm512_add_epi32(
+                _mm512_mullo_epi32(_mm512_add_epi32(_mm512_mullo_epi32(z, y_stride), y), row_stride),
+                _mm512_srli_epi32(x, 5));
+            const __m512i words = _mm512_or_si512(
+                _mm512_mask_i32gather_epi32(zero, inside, word, pmap_words, 4),
+                _mm512_mask_i32gather_epi32(zero, static_cast<__mmask16>(inside & photon_lanes), word, photon_words, 4));
+            const __mmask16 occupied = inside & _mm512_test_epi32_mask(
+                _mm512_srlv_epi32(words, _mm512_and_si512(x, low_5)), one);
+
+            if (const uint32_t stop = outside | occupied) {
+                _mm512_store_si512(lanes.x, x);
+                _mm512_store_si512(lanes.y, y);
+                _mm512_store_si512(lanes.z, z);
+                for (uint32_t lanes_left = stop; lanes_left; lanes_left &= lanes_left - 1) {
+                    const unsigned int k = __builtin_ctz(lanes_left);
+                    const unsigned int axis = ((step_x >> k) & 1) ? 0 : ((step_y >> k) & 1) ? 1 : 2;
+                    if (resolve(k, axis))
+                        active &= ~(1u << k);
+                }
+            }
+
+            const uint32_t reached = active & _mm512_cmpeq_epi32_mask(x, last_x) &
+                _mm512_cmpeq_epi32_mask(y, last_y) & _mm512_cmpeq_epi32_mask(z, last_z);
+            for (uint32_t lanes_left = reached; lanes_left; lanes_left &= lanes_left - 1)
+                finish(__builtin_ctz(lanes_left));
+            active &= ~reached;
+        }
+
+        _mm512_store_si512(lanes.x, x);
+        _mm512_store_si512(lanes.y, y);
+        _mm512_store_si512(lanes.z, z);
+        _mm512_store_si512(lanes.t_max_x, t_max_x);
+        _mm512_store_si512(lanes.t_max_y, t_max_y);
+        _mm512_store_si512(lanes.t_max_z, t_max_z);
+        return active;
+    }
+
+    __attribute__((target("avx2")))
+    static inline __m256i load_lanes_avx2(const int32_t * lane_values) {
+        return _mm256_load_si256(reinterpret_cast<const __m256i *>(lane_values));
+    }
+
+    __attribute__((target("avx2")))
+    static inline void store_lanes_avx2(int32_t * lane_values, const __m256i values) {
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lane_values), values);
+    }
+
+    __attribute__((target("avx2")))
+    static inline uint32_t lane_bits_avx2(const __m256i mask) {
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+    }
+
+    // The first 8 lanes, same as step_lanes_avx512
+    template <class Resolve, class Finish>
+    __attribute__((target("avx2")))
+    static uint32_t step_lanes_avx2(PacketLanes &lanes, const uint32_t active_lanes, const int refill_below,
+            const uint32_t photon_lanes, const int32_t * pmap_words, const int32_t * photon_words, Resolve &resolve, Finish &finish) {
+        __m256i x = load_lanes_avx2(lanes.x);
+        __m256i y = load_lanes_avx2(lanes.y);
+        __m256i z = load_lanes_avx2(lanes.z);
+        const __m256i last_x = load_lanes_avx2(lanes.last_x);
+        const __m256i last_y = load_lanes_avx2(lanes.last_y);
+        const __m256i last_z = load_lanes_avx2(lanes.last_z);
+        const __m256i dx = load_lanes_avx2(lanes.dx);
+        const __m256i dy = load_lanes_avx2(lanes.dy);
+        const __m256i dz = load_lanes_avx2(lanes.dz);
+        __m256i t_max_x = load_lanes_avx2(lanes.t_max_x);
+        __m256i t_max_y = load_lanes_avx2(lanes.t_max_y);
+        __m256i t_max_z = load_lanes_avx2(lanes.t_max_z);
+        const __m256i t_delta_x = load_lanes_avx2(lanes.t_delta_x);
+        const __m256i t_delta_y = load_lanes_avx2(lanes.t_delta_y);
+        const __m256i t_delta_z = load_lanes_avx2(lanes.t_delta_z);
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i low_5 = _mm256_set1_epi32(31);
+        const __m256i row_stride = _mm256_set1_epi32(OCCUPANCY_ROW_WORDS * 2);
+        const __m256i y_stride = _mm256_set1_epi32(YRES);
+        const __m256i max_x = _mm256_set1_epi32(XRES - 2);
+        const __m256i max_y = _mm256_set1_epi32(YRES - 2);
+        const __m256i max_z = _mm256_set1_epi32(ZRES - 2);
+        const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        const __m256i photon_mask = _mm256_cmpeq_epi32(
+            _mm256_and_si256(_mm256_set1_epi32(photon_lanes), lane_bits), lane_bits);
+
+        uint32_t active_bits = active_lanes;
+        while (__builtin_popcount(active_bits) >= refill_below) {
+            const __m256i active = _mm256_cmpeq_epi32(
+                _mm256_and_si256(_mm256_set1_epi32(active_bits), lane_bits), lane_bits);
+            const __m256i x_lt_y = _mm256_cmpgt_epi32(t_max_y, t_max_x);
+            const __m256i x_lt_z = _mm256_cmpgt_epi32(t_max_z, t_max_x);
+            const __m256i y_lt_z = _mm256_cmpgt_epi32(t_max_z, t_max_y);
+            const __m256i step_x = _mm256_and_si256(active, _mm256_and_si256(x_lt_y, x_lt_z));
+            const __m256i step_y = _mm256_andnot_si256(x_lt_y, _mm256_and_si256(active, y_lt_z));
+            const __m256i step_z = _mm256_andnot_si256(_mm256_or_si256(step_x, step_y), active);
+            x = _mm256_add_epi32(x, _mm256_and_si256(step_x, dx));
+            y = _mm256_add_epi32(y, _mm256_and_si256(step_y, dy));
+            z = _mm256_add_epi32(z, _mm256_and_si256(step_z, dz));
+            t_max_x = _mm256_add_epi32(t_max_x, _mm256_and_si256(step_x, t_delta_x));
+            t_max_y = _mm256_add_epi32(t_max_y, _mm256_and_si256(step_y, t_delta_y));
+            t_max_z = _mm256_add_epi32(t_max_z, _mm256_and_si256(step_z, t_delta_z));
+
+            // Coordinates stay within -1 to 256, signed compares are enough
+            const __m256i outside = _mm256_and_si256(active, _mm256_or_si256(
+                _mm256_or_si256(_mm256_or_si256(_mm256_cmpgt_epi32(one, x), _mm256_cmpgt_epi32(x, max_x)),
+                    _mm256_or_si256(_mm256_cmpgt_epi32(one, y), _mm256_cmpgt_epi32(y, max_y))),
+                _mm256_or_si256(_mm256_cmpgt_epi32(one, z), _mm256_cmpgt_epi32(z, max_z))));
+            const __m256i inside = _mm256_andnot_si256(outside, active);
+
+            const __m256i word = _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(z, y_stride), y), row_stride),
+                _mm256_srli_epi32(x, 5));
+            const __m256i words = _mm256_or_si256(
+                _mm256_mask_i32gather_epi32(zero, pmap_words, word, inside, 4),
+                _mm256_mask_i32gather_epi32(zero, photon_words, word, _mm256_and_si256(inside, photon_mask), 4));
+            const __m256i occupied = _mm256_and_si256(inside, _mm256_cmpeq_epi32(one,
+                _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(x, low_5)), one)));
+
+            if (const uint32_t stop = lane_bits_avx2(_mm256_or_si256(outside, occupied))) {
+                store_lanes_avx2(lanes.x, x);
+                store_lanes_avx2(lanes.y, y);
+                store_lanes_avx2(lanes.z, z);
+                const uint32_t stepped_x = lane_bits_avx2(step_x), stepped_y = lane_bits_avx2(step_y);
+                for (uint32_t lanes_left = stop; lanes_left; lanes_left &= lanes_left - 1) {
+                    const unsigned int k = __builtin_ctz(lanes_left);
+                    const unsigned int axis = ((stepped_x >> k) & 1) ? 0 : ((stepped_y >> k) & 1) ? 1 : 2;
+                    if (resolve(k, axis))
+                        active_bits &= ~(1u << k);
+                }
+            }
+
+            const uint32_t reached = active_bits & lane_bits_avx2(_mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpeq_epi32(x, last_x), _mm256_cmpeq_epi32(y, last_y)),
+                _mm256_cmpeq_epi32(z, last_z)));
+            for (uint32_t lanes_left = reached; lanes_left; lanes_left &= lanes_left - 1)
+                finish(__builtin_ctz(lanes_left));
+            active_bits &= ~reached;
+        }
+
+        store_lanes_avx2(lanes.x, x);
+        store_lanes_avx2(lanes.y, y);
+        store_lanes_avx2(lanes.z, z);
+        store_lanes_avx2(lanes.t_max_x, t_max_x);
+        store_lanes_avx2(lanes.t_max_y, t_max_y);
+        store_lanes_avx2(lanes.t_max_z, t_max_z);
+        return active_bits;
+    }
+#endif
+}
+
+/**
+ * @brief Whether a movement ray of part idx stops at loc
+ */
+PartSwapBehavior Simulation::_eval_ray_move(const part_id idx, const Vector3T<signed_coord_t> &loc) const {
+    if (REVERSE_BOUNDS_CHECK(loc.x, loc.y, loc.z))
+        return PartSwapBehavior::NOOP;
+    return eval_move(idx, loc.x, loc.y, loc.z);
+}
+
+void Simulation::raycast_packet(const part_id * ids, const RaycastInput * in, RaycastOutput * out, bool * hit,
+        const unsigned int count) const {
+    const auto isa = ParticleKernels::active_isa();
+#ifdef RAYCAST_PACKET_X86
+    if (isa == ParticleKernels::ISA::SCALAR) {
+#else
+    {
+#endif
+        for (unsigned int k = 0; k < count; k++) {
+            const part_id idx = ids[k];
+            hit[k] = raycast<true>(in[k], out[k], [idx, this](const Vector3T<signed_coord_t> &loc) {
+                return _eval_ray_move(idx, loc);
+            });
+        }
+        return;
+    }
+
+#ifdef RAYCAST_PACKET_X86
+    PacketLanes lanes{};
+    unsigned int lane_ray[RAYCAST_PACKET_LANES]; // Ray each lane is casting
+    uint32_t photon_lanes = 0; // Lanes whose part a part in photons can stop, the others ignore photons
+
+    // Set up a lane like raycast does. Rays that stop before their first step
+    // are finished right away, returns whether the lane has to step
+    const auto start_ray = [&](const unsigned int k, const unsigned int lane) {
+        const RaycastInput &ray_in = in[k];
+        const part_id idx = ids[k];
+        const auto blocked = [idx, this](const Vector3T<signed_coord_t> &loc) {
+            if (!REVERSE_BOUNDS_CHECK(loc.x, loc.y, loc.z) &&
+                    !pmap.occupied(loc.x, loc.y, loc.z) && !photons.occupied(loc.x, loc.y, loc.z))
+                return false;
+            return _eval_ray_move(idx, loc) == PartSwapBehavior::NOOP;
+        };
+
+        const int largest_axis = util::argmax3(ray_in.vx, ray_in.vy, ray_in.vz);
+        Vector3T<signed_coord_t> ahead{ ray_in.x, ray_in.y, ray_in.z };
+        if (largest_axis == 0) ahead.x += ray_in.vx < 0 ? -1 : 1;
+        else if (largest_axis == 1) ahead.y += ray_in.vy < 0 ? -1 : 1;
+        else ahead.z += ray_in.vz < 0 ? -1 : 1;
+
+        out[k].x = ray_in.x;
+        out[k].y = ray_in.y;
+        out[k].z = ray_in.z;
+        if (blocked(ahead)) {
+            out[k].faces = largest_axis == 0 ? RayCast::FACE_X : largest_axis == 1 ? RayCast::FACE_Y : RayCast::FACE_Z;
+            out[k].move = PartSwapBehavior::NOOP;
+            hit[k] = true;
+            return false;
+        }
+        out[k].faces = 0;
+        out[k].move = PartSwapBehavior::SWAP;
+        hit[k] = false;
+
+        const int32_t ray_x = util::ceil_proper(ray_in.vx);
+        const int32_t ray_y = util::ceil_proper(ray_in.vy);
+        const int32_t ray_z = util::ceil_proper(ray_in.vz);
+        if (!ray_x && !ray_y && !ray_z)
+            return false;
+
+        const int32_t t_scale = std::max(1, std::abs(ray_x)) * std::max(1, std::abs(ray_y)) * std::max(1, std::abs(ray_z));
+        lanes.x[lane] = ray_in.x;
+        lanes.y[lane] = ray_in.y;
+        lanes.z[lane] = ray_in.z;
+        lanes.last_x[lane] = ray_in.x + ray_x;
+        lanes.last_y[lane] = ray_in.y + ray_y;
+        lanes.last_z[lane] = ray_in.z + ray_z;
+        lanes.dx[lane] = ray_x >= 0 ? 1 : -1;
+        lanes.dy[lane] = ray_y >= 0 ? 1 : -1;
+        lanes.dz[lane] = ray_z >= 0 ? 1 : -1;
+        lanes.t_delta_x[lane] = lanes.t_max_x[lane] = ray_x ? t_scale / std::abs(ray_x) : PACKET_T_NEVER;
+        lanes.t_delta_y[lane] = lanes.t_max_y[lane] = ray_y ? t_scale / std::abs(ray_y) : PACKET_T_NEVER;
+        lanes.t_delta_z[lane] = lanes.t_max_z[lane] = ray_z ? t_scale / std::abs(ray_z) : PACKET_T_NEVER;
+        lane_ray[lane] = k;
+        if (photons_can_stop[parts.type[idx]])
+            photon_lanes |= 1u << lane;
+        else
+            photon_lanes &= ~(1u << lane);
+        return true;
+    };
+
+    // Lanes stop at every voxel that is outside or has a part, those are
+    // checked here like raycast's pmapOccupied. Returns whether the ray is done
+    const auto resolve = [&](const unsigned int lane, const unsigned int axis) {
+        const unsigned int k = lane_ray[lane];
+        const Vector3T<signed_coord_t> loc{ static_cast<signed_coord_t>(lanes.x[lane]),
+            static_cast<signed_coord_t>(lanes.y[lane]), static_cast<signed_coord_t>(lanes.z[lane]) };
+        if (_eval_ray_move(ids[k], loc) != PartSwapBehavior::NOOP)
+            return false;
+
+        // Stopped right before the voxel, the face is the axis it stepped along
+        out[k].x = loc.x - (axis == 0 ? lanes.dx[lane] : 0);
+        out[k].y = loc.y - (axis == 1 ? lanes.dy[lane] : 0);
+        out[k].z = loc.z - (axis == 2 ? lanes.dz[lane] : 0);
+        out[k].faces = axis == 0 ? RayCast::FACE_X : axis == 1 ? RayCast::FACE_Y : RayCast::FACE_Z;
+        hit[k] = true;
+        return true;
+    };
+    const auto finish = [&](const unsigned int lane) {
+        const unsigned int k = lane_ray[lane];
+        out[k].x = lanes.last_x[lane];
+        out[k].y = lanes.last_y[lane];
+        out[k].z = lanes.last_z[lane];
+    };
+
+    // Lanes are refilled with the next rays once half of them are done,
+    // so long rays don't leave most lanes idle
+    const int32_t * pmap_words = reinterpret_cast<const int32_t *>(pmap.occupancy().data());
+    const int32_t * photon_words = reinterpret_cast<const int32_t *>(photons.occupancy().data());
+    const unsigned int width = isa == ParticleKernels::ISA::AVX512 ? 16 : 8;
+    uint32_t active = 0;
+    unsigned int next = 0;
+    do {
+        for (unsigned int lane = 0; lane < width && next < count; lane++)
+            while (!((active >> lane) & 1) && next < count)
+                if (start_ray(next++, lane))
+                    active |= 1u << lane;
+
+        const int refill_below = next < count ? width / 2 : 1;
+        if (isa == ParticleKernels::ISA::AVX512)
+            active = step_lanes_avx512(lanes, active, refill_below, photon_lanes, pmap_words, photon_words, resolve, finish);
+        else
+            active = step_lanes_avx2(lanes, active, refill_below, photon_lanes, pmap_words, photon_words, resolve, finish);
+    } while (active || next < count);
+#endif
+}
+
+/**
+ * @brief Whether update_part of the part does nothing but move it along its
+ *        velocity or defer it (no Update, and move_behavior does nothing for
+ *        it), so its movement raycast can be made ahead of time in a packet
+ */
+bool Simulation::_packet_candidate(const part_id idx) const {
+    if (!parts.type[idx]) return false; // Killed since it was deferred
+    const auto &el = GetElements()[parts.type[idx]];
+    return !el.Update && (el.State == ElementState::TYPE_ENERGY || el.State == ElementState::TYPE_SOLID);
+}
+
+/**
+ * @brief update_part the parts in this thread's packet list, in order. The
+ *        first movement raycasts of those that will move are made all at
+ *        once beforehand. A part uses its cast only if no move of the parts
+ *        before it wrote a voxel the cast could have looked at (see
+ *        _take_packet_cast), otherwise it casts again
+ * @param overflow_level If >= 0 the packet is from _update_overflow_tile of
+ *        this level and overflow_tile, and goes through _update_overflow_part
+ */
+void Simulation::_update_packet(const unsigned int causality_range, const int overflow_level, const unsigned int overflow_tile) {
+    auto &scratch = thread_scratch[omp_get_thread_num()];
+    if (scratch.packet.empty())
+        return;
+
+    // Same checks update_part makes before _raycast_movement, deferred
+    // parts stay in the packet so it isn't split up
+    const bool frame_count_parity = frame_count & 1;
+    part_id ids[SIM_PACKET_PARTS];
+    RaycastInput in[SIM_PACKET_PARTS];
+    RaycastOutput out[SIM_PACKET_PARTS];
+    bool hit[SIM_PACKET_PARTS];
+    unsigned int count = 0;
+    for (const part_id i : scratch.packet) {
+        const auto part = parts[i];
+        const float vx = part.vx, vy = part.vy, vz = part.vz;
+        if (part.flag[PartFlags::MOVE_FRAME] == frame_count_parity || !(vx || vy || vz) ||
+                GetElements()[part.type].Causality > causality_range ||
+                fabsf(vx) > causality_range || fabsf(vy) > causality_range || fabsf(vz) > causality_range)
+            continue;
+
+        ids[count] = i;
+        in[count] = RaycastInput {
+            .x = part.rx, .y = part.ry, .z = part.rz,
+            .vx = util::clampf(vx, -MAX_VELOCITY, MAX_VELOCITY),
+            .vy = util::clampf(vy, -MAX_VELOCITY, MAX_VELOCITY),
+            .vz = util::clampf(vz, -MAX_VELOCITY, MAX_VELOCITY)
+        };
+        count++;
+    }
+
+    // A few rays don't fill enough lanes to pay for setting them up, those
+    // parts cast on their own
+    if (count >= SIM_PACKET_MIN_RAYS) {
+        {
+            SimulationStats::ScopedTimer timer(stats, SimPhase::RAYCAST_MOVEMENT);
+            raycast_packet(ids, in, out, hit, count);
+        }
+        for (unsigned int k = 0; k < count; k++)
+            scratch.packet_casts.push_back(PacketCast{ .id = ids[k], .in = in[k], .out = out[k], .hit = hit[k] });
+        scratch.packet_writes.clear();
+    } else
+        count = 0;
+
+    unsigned int next_cast = 0;
+    for (const part_id i : scratch.packet) {
+        scratch.packet_cast = next_cast < count && ids[next_cast] == i ? &scratch.packet_casts[next_cast++] : nullptr;
+        if (overflow_level >= 0)
+            _update_overflow_part(overflow_level, overflow_tile, i);
+        else
+            update_part(i, causality_range);
+    }
+
+    scratch.packet_cast = nullptr;
+    scratch.packet_casts.clear();
+    scratch.packet.clear();
+}
+
+/**
+ * @brief Take the packet cast _update_packet set for the part being updated,
+ *        if it is part idx's for the given input and still what raycast
+ *        would give. raycast only looks at single voxels (eval_move reads
+ *        no neighbors), so it holds if no move wrote one of them since
+ * @return nullptr if there is none
+ */
+const Simulation::PacketCast * Simulation::_take_packet_cast(const part_id idx, const RaycastInput &in) {
+    auto &scratch = thread_scratch[omp_get_thread_num()];
+    const PacketCast * cast = scratch.packet_cast;
+    scratch.packet_cast = nullptr; // Later casts of the part are made normally
+    if (!cast || cast->id != idx || cast->in.x != in.x || cast->in.y != in.y || cast->in.z != in.z ||
+            cast->in.vx != in.vx || cast->in.vy != in.vy || cast->in.vz != in.vz)
+        return nullptr;
+
+    // The ray looked at the voxel ahead of its start (the early stop check)
+    // and the voxels it stepped through up to the one it hit, all in this box
+    const int ray_x = util::ceil_proper(in.vx), ray_y = util::ceil_proper(in.vy), ray_z = util::ceil_proper(in.vz);
+    int min_x = std::min(in.x, cast->out.x), max_x = std::max(in.x, cast->out.x);
+    int min_y = std::min(in.y, cast->out.y), max_y = std::max(in.y, cast->out.y);
+    int min_z = std::min(in.z, cast->out.z), max_z = std::max(in.z, cast->out.z);
+    const auto extend = [](int &min, int &max, const bool negative) {
+        if (negative) min--;
+        else max++;
+    };
+    const int largest_axis = util::argmax3(in.vx, in.vy, in.vz);
+    Vector3T<int> ahead{ in.x, in.y, in.z };
+    if (largest_axis == 0) { extend(min_x, max_x, in.vx < 0); ahead.x += in.vx < 0 ? -1 : 1; }
+    else if (largest_axis == 1) { extend(min_y, max_y, in.vy < 0); ahead.y += in.vy < 0 ? -1 : 1; }
+    else { extend(min_z, max_z, in.vz < 0); ahead.z += in.vz < 0 ? -1 : 1; }
+    if (cast->hit) {
+        if ((cast->out.faces & RayCast::FACE_X).any()) extend(min_x, max_x, ray_x < 0);
+        if ((cast->out.faces & RayCast::FACE_Y).any()) extend(min_y, max_y, ray_y < 0);
+        if ((cast->out.faces & RayCast::FACE_Z).any()) extend(min_z, max_z, ray_z < 0);
+    }
+
+    // The DDA is offset j voxels along an axis while t is in [j, j + 1] * t_delta
+    // of that axis (closed, so ties go either way), a voxel it stepped through
+    // has a t in all 3
+    const int64_t t_scale = static_cast<int64_t>(std::max(1, std::abs(ray_x))) *
+        std::max(1, std::abs(ray_y)) * std::max(1, std::abs(ray_z));
+    const auto on_ray = [t_scale](int64_t &t_min, int64_t &t_max, const int c, const int start, const int ray) {
+        const int offset = ray < 0 ? start - c : c - start;
+        if (!ray)
+            return offset == 0;
+        if (offset < 0)
+            return false;
+        const int64_t t_delta = t_scale / std::abs(ray);
+        t_min = std::max(t_min, offset * t_delta);
+        t_max = std::min(t_max, (offset + 1) * t_delta);
+        return t_min <= t_max;
+    };
+
+    // A field of (voxel | guards) - low keeps its guard bit if it is >= min,
+    // one of high - voxel if it is <= max
+    const uint32_t low = _pack_voxel(min_x, min_y, min_z);
+    const uint32_t high = _pack_voxel(max_x, max_y, max_z) | PACKED_VOXEL_GUARDS;
+    for (const uint32_t voxel : scratch.packet_writes) {
+        if ((((voxel | PACKED_VOXEL_GUARDS) - low) & (high - voxel) & PACKED_VOXEL_GUARDS) != PACKED_VOXEL_GUARDS)
+            continue;
+        const int x = voxel & 0x3FF, y = (voxel >> 10) & 0x3FF, z = voxel >> 20;
+        int64_t t_min = 0, t_max = std::numeric_limits<int64_t>::max();
+        if ((x == ahead.x && y == ahead.y && z == ahead.z) || (on_ray(t_min, t_max, x, in.x, ray_x) &&
+                on_ray(t_min, t_max, y, in.y, ray_y) && on_ray(t_min, t_max, z, in.z, ray_z)))
+            return nullptr;
+    }
+    return cast;
+}
@@ -0,0 +1,97 @@
+#ifndef SIMULATION_STATS_H
+#define SIMULATION_STATS_H
+
+#include <omp.h>
+#include <array>
+#include <chrono>
+
+// Phases of a simulation frame that can be timed
+namespace SimPhase {
+    constexpr unsigned int UPDATE_TILE = 0;           // Includes the _raycast_movement calls inside it
+    constexpr unsigned int UPDATE_OVERFLOW = 1;       // Deferred parts updated over coarser tiles, same as above
+    constexpr unsigned int RECALC_FREE_PARTICLES = 2; // Includes the serial update_part calls inside it
+    constexpr unsigned int RAYCAST_MOVEMENT = 3;
+    constexpr unsigned int AIR_UPDATE = 4;
+    constexpr unsigned int COMPACT_PARTS = 5;
+    constexpr unsigned int UPDATE_ENERGY = 6;         // Ballistic energy parts, moved outside of the tile passes
+    constexpr unsigned int RESOLVE_COLORS = 7;        // Colors of the voxels parts moved in / out of, once per frame
+    constexpr unsigned int COUNT = 8;
+
+    constexpr const char * NAMES[COUNT] = {
+        "update_tile",
+        "update_overflow",
+        "recalc_free_particles",
+        "_raycast_movement",
+        "Air::update",
+        "compact_parts",
+        "_update_energy_parts",
+        "_resolve_colors"
+    };
+}
+
+constexpr unsigned int STATS_MAX_THREADS = 256;
+
+/**
+ * @brief Accumulated time per simulation phase, summed over all threads
+ *        Timing is off by default, when disabled a timer only costs a branch
+ *        Each thread writes its own cache line so threads don't contend
+ */
+class SimulationStats {
+public:
+    bool enabled = false;
+
+    SimulationStats() { reset(); }
+
+    void reset() {
+        for (auto &t : thread_times)
+            t.ms.fill(0.0);
+    }
+
+    void add(const unsigned int phase, const double ms) {
+        thread_times[omp_get_thread_num() % STATS_MAX_THREADS].ms[phase] += ms;
+    }
+
+    /**
+     * @brief Total time spent in a phase since the last reset()
+     *        summed over all threads, in ms
+     * @param phase SimPhase index
+     * @return double
+     */
+    double total_ms(const unsigned int phase) const {
+        double sum = 0.0;
+        for (const auto &t : thread_times)
+            sum += t.ms[phase];
+        return sum;
+    }
+
+    /**
+     * @brief Adds the time between construction and destruction
+     *        to the given phase, if stats are enabled
+     */
+    class ScopedTimer {
+    public:
+        ScopedTimer(SimulationStats &stats, const unsigned int phase): stats(stats), phase(phase) {
+            if (stats.enabled)
+                start = std::chrono::steady_clock::now();
+        }
+        ~ScopedTimer() {
+            if (stats.enabled)
+                stats.add(phase, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        ScopedTimer(const ScopedTimer &other) = delete;
+        ScopedTimer &operator=(const ScopedTimer &other) = delete;
+    private:
+        SimulationStats &stats;
+        const unsigned int phase;
+        std::chrono::steady_clock::time_point start;
+    };
+
+private:
+    struct alignas(64) ThreadTimes {
+        std::array<double, SimPhase::COUNT> ms;
+    };
+    std::array<ThreadTimes, STATS_MAX_THREADS> thread_times;
+};
+
+#endif
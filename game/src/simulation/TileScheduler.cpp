@@ -0,0 +1,44 @@
+#include "TileScheduler.h"
+
+TileScheduler::TileScheduler(): range_count(0) {
+    for (auto &color_tiles : tiles)
+        color_tiles.reserve(SIM_TILE_COUNT / SIM_TILE_COLORS + 1);
+}
+
+void TileScheduler::prepare(const uint8_t * occupied, const unsigned int thread_count) {
+    clear();
+    for (unsigned int tile = 0; tile < SIM_TILE_COUNT; tile++)
+        if (occupied[tile])
+            add(TILE_COLOR(tile), tile);
+    finalize(thread_count);
+}
+
+void TileScheduler::clear() {
+    for (auto &color_tiles : tiles)
+        color_tiles.clear();
+}
+
+bool TileScheduler::empty() const {
+    for (const auto &color_tiles : tiles)
+        if (!color_tiles.empty())
+            return false;
+    return true;
+}
+
+void TileScheduler::finalize(const unsigned int thread_count) {
+    const unsigned int count = thread_count > 0 ? thread_count : 1;
+    if (count != range_count) {
+        ranges = std::make_unique<Range[]>(SIM_TILE_COLORS * count);
+        range_count = count;
+    }
+
+    // Contiguous ranges so a thread's own tiles are near each other
+    for (unsigned int color = 0; color < SIM_TILE_COLORS; color++) {
+        const uint32_t size = tiles[color].size();
+        for (unsigned int t = 0; t < count; t++) {
+            Range &range = ranges[color * count + t];
+            range.next.store(size * t / count, std::memory_order_relaxed);
+            range.end = size * (t + 1) / count;
+        }
+    }
+}
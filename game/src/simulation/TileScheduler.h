@@ -0,0 +1,130 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include "SimulationDef.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// The simulation is split into cubic tiles of this size over all 3 axes.
+// Tiles are colored by the parity of their tile coordinates, so two tiles of the
+// same color always have a full tile between them along some axis. A particle
+// may read / write at most SIM_TILE_DIM / 2 voxels away from itself, so tiles of
+// the same color can be updated at the same time
+constexpr unsigned int SIM_TILE_DIM = 16;
+constexpr unsigned int SIM_TILES_X = (XRES + SIM_TILE_DIM - 1) / SIM_TILE_DIM;
+constexpr unsigned int SIM_TILES_Y = (YRES + SIM_TILE_DIM - 1) / SIM_TILE_DIM;
+constexpr unsigned int SIM_TILES_Z = (ZRES + SIM_TILE_DIM - 1) / SIM_TILE_DIM;
+constexpr unsigned int SIM_TILE_COUNT = SIM_TILES_X * SIM_TILES_Y * SIM_TILES_Z;
+constexpr unsigned int SIM_TILE_COLORS = 8;
+constexpr unsigned int SIM_TILE_CAUSALITY = SIM_TILE_DIM / 2;
+
+// Particles that reach further than SIM_TILE_CAUSALITY are deferred to extra
+// passes over coarser tiles (colored the same way), one level at a time.
+// Whatever still doesn't fit the last level is updated serially
+constexpr unsigned int SIM_OVERFLOW_LEVELS = 3;
+constexpr unsigned int SIM_OVERFLOW_TILE_DIMS[SIM_OVERFLOW_LEVELS] = { 32, 64, 100 };
+static_assert(SIM_OVERFLOW_TILE_DIMS[SIM_OVERFLOW_LEVELS - 1] >= 2 * MAX_VELOCITY,
+    "Last overflow level should fit any particle moving at MAX_VELOCITY");
+
+// A tile goes to sleep (isn't scheduled) after this many frames where nothing
+// in or next to it moved, no part in it had velocity or an Update function
+// and the air in it was still. Activity in or next to it wakes it up again
+constexpr uint8_t SIM_TILE_SLEEP_FRAMES = 8;
+constexpr float SIM_TILE_SLEEP_VELOCITY = 0.01f; // Abs velocity per axis still considered at rest
+constexpr float SIM_TILE_SLEEP_AIR_VELOCITY = 0.001f;
+
+constexpr uint32_t TILE_FLAT_IDX(coord_t x, coord_t y, coord_t z) {
+    return (x / SIM_TILE_DIM) + (y / SIM_TILE_DIM) * SIM_TILES_X + (z / SIM_TILE_DIM) * SIM_TILES_X * SIM_TILES_Y;
+}
+
+constexpr unsigned int TILE_COLOR(unsigned int tx, unsigned int ty, unsigned int tz) {
+    return (tx & 1) | ((ty & 1) << 1) | ((tz & 1) << 2);
+}
+constexpr unsigned int TILE_COLOR(unsigned int tile) {
+    return TILE_COLOR(tile % SIM_TILES_X, (tile / SIM_TILES_X) % SIM_TILES_Y, tile / (SIM_TILES_X * SIM_TILES_Y));
+}
+
+/**
+ * @brief Hands out non-empty tiles of one color at a time to threads
+ *        Every thread owns a contiguous range of the tiles and takes from it
+ *        first, once empty it steals single tiles from the other ranges.
+ *        Lock free, ranges are only atomic counters
+ *
+ * Usage:
+ * scheduler.prepare(occupied, thread_count); // Outside the parallel region
+ * #pragma omp parallel
+ * for (color = 0; color < SIM_TILE_COLORS; color++) {
+ *     scheduler.run(color, tid, [](unsigned int tile) { ... });
+ *     #pragma omp barrier
+ * }
+ */
+class TileScheduler {
+public:
+    TileScheduler();
+
+    TileScheduler(const TileScheduler &other) = delete;
+    TileScheduler &operator=(const TileScheduler &other) = delete;
+
+    /**
+     * @brief Collect the non-empty tiles of every color and split them between
+     *        threads. Not thread safe, call before the parallel region
+     * @param occupied Array of SIM_TILE_COUNT flags, non-zero = tile has particles
+     * @param thread_count Number of threads that will call run()
+     */
+    void prepare(const uint8_t * occupied, const unsigned int thread_count);
+
+    /**
+     * @brief Manual alternative to prepare(), for tiles that are not the
+     *        SIM_TILE_DIM grid: clear(), add() each tile then finalize()
+     *        Not thread safe, no thread may be in run() meanwhile
+     */
+    void clear();
+    void add(const unsigned int color, const unsigned int tile) { tiles[color].push_back(tile); }
+    void finalize(const unsigned int thread_count);
+
+    /**
+     * @brief Whether there are no tiles of any color, valid after prepare() / finalize()
+     */
+    bool empty() const;
+
+    /**
+     * @brief Process all tiles of the given color, call from every thread
+     *        Returns once there are no tiles left to take, other threads
+     *        may still be processing theirs (so barrier afterwards)
+     * @param color Tile color, 0 <= color < SIM_TILE_COLORS
+     * @param tid Thread number of the calling thread
+     * @param func Called as func(tile_idx) for each tile this thread takes
+     */
+    template <class F>
+    void run(const unsigned int color, const unsigned int tid, F &&func) {
+        const unsigned int count = range_count;
+        for (unsigned int i = 0; i < count; i++) {
+            // Own range first, then steal going around the other threads
+            Range &range = ranges[color * count + (tid + i) % count];
+            while (true) {
+                const uint32_t idx = range.next.fetch_add(1, std::memory_order_relaxed);
+                if (idx >= range.end) break;
+                func(tiles[color][idx]);
+            }
+        }
+    }
+
+    /**
+     * @brief Number of non-empty tiles of a color, valid after prepare()
+     */
+    std::size_t tile_count(const unsigned int color) const { return tiles[color].size(); }
+
+private:
+    struct alignas(64) Range {
+        std::atomic<uint32_t> next;
+        uint32_t end;
+    };
+
+    std::vector<uint16_t> tiles[SIM_TILE_COLORS];
+    std::unique_ptr<Range[]> ranges; // [color][thread]
+    unsigned int range_count;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef VOXEL_GRID_H
+#define VOXEL_GRID_H
+
+#include "SimulationDef.h"
+#include "OccupancyBitmap.h"
+
+#include <algorithm>
+#include <array>
+
+// Bricked layout (--bricked-maps): the grid is stored as cubes of VOXEL_BRICK_DIM^3
+// voxels, each contiguous in memory, so neighbors along y and z are usually in
+// the same few cache lines / page instead of a row or slice apart
+constexpr unsigned int VOXEL_BRICK_SHIFT = 3;
+constexpr unsigned int VOXEL_BRICK_DIM = 1 << VOXEL_BRICK_SHIFT;
+constexpr unsigned int VOXEL_BRICK_SIZE = VOXEL_BRICK_DIM * VOXEL_BRICK_DIM * VOXEL_BRICK_DIM;
+constexpr unsigned int VOXEL_BRICKS_X = (XRES + VOXEL_BRICK_DIM - 1) / VOXEL_BRICK_DIM;
+constexpr unsigned int VOXEL_BRICKS_Y = (YRES + VOXEL_BRICK_DIM - 1) / VOXEL_BRICK_DIM;
+constexpr unsigned int VOXEL_BRICKS_Z = (ZRES + VOXEL_BRICK_DIM - 1) / VOXEL_BRICK_DIM;
+
+namespace VoxelLayout {
+#ifdef TPT_BRICKED_MAPS
+    constexpr std::size_t SIZE = VOXEL_BRICKS_X * VOXEL_BRICKS_Y * VOXEL_BRICKS_Z * VOXEL_BRICK_SIZE;
+#else
+    constexpr std::size_t SIZE = XRES * YRES * ZRES;
+#endif
+
+    // Offset of each coordinate along its axis, the index of (x, y, z) is
+    // X_OFFSETS[x] + Y_OFFSETS[y] + Z_OFFSETS[z] for either layout
+    constexpr std::array<uint32_t, 256> make_offsets(const unsigned int axis) {
+        std::array<uint32_t, 256> offsets{};
+        for (unsigned int c = 0; c < offsets.size(); c++) {
+#ifdef TPT_BRICKED_MAPS
+            const uint32_t brick = c >> VOXEL_BRICK_SHIFT, inner = c & (VOXEL_BRICK_DIM - 1);
+            if (axis == 0)
+                offsets[c] = brick * VOXEL_BRICK_SIZE + inner;
+            else if (axis == 1)
+                offsets[c] = brick * VOXEL_BRICKS_X * VOXEL_BRICK_SIZE + inner * VOXEL_BRICK_DIM;
+            else
+                offsets[c] = brick * VOXEL_BRICKS_X * VOXEL_BRICKS_Y * VOXEL_BRICK_SIZE + inner * VOXEL_BRICK_DIM * VOXEL_BRICK_DIM;
+#else
+            offsets[c] = axis == 0 ? c : axis == 1 ? c * XRES : c * XRES * YRES;
+#endif
+        }
+        return offsets;
+    }
+
+    constexpr auto X_OFFSETS = make_offsets(0);
+    constexpr auto Y_OFFSETS = make_offsets(1);
+    constexpr auto Z_OFFSETS = make_offsets(2);
+
+    constexpr uint32_t index(const coord_t x, const coord_t y, const coord_t z) {
+        return X_OFFSETS[x] + Y_OFFSETS[y] + Z_OFFSETS[z];
+    }
+}
+
+/**
+ * @brief A value per voxel of the simulation, stored linearly (x fastest)
+ *        or in bricks depending on TPT_BRICKED_MAPS. Always index through
+ *        grid(x, y, z), the storage order is not z / y / x
+ * @tparam T Value type
+ */
+template <class T>
+class VoxelGrid {
+public:
+    VoxelGrid() = default;
+    VoxelGrid(const VoxelGrid&) = delete;
+    VoxelGrid& operator=(const VoxelGrid&) = delete;
+
+    T &operator()(const coord_t x, const coord_t y, const coord_t z) { return cells[VoxelLayout::index(x, y, z)]; }
+    const T &operator()(const coord_t x, const coord_t y, const coord_t z) const { return cells[VoxelLayout::index(x, y, z)]; }
+
+    void fill(const T value) { std::fill(&cells[0], &cells[VoxelLayout::SIZE], value); }
+
+private:
+    T cells[VoxelLayout::SIZE];
+};
+
+/**
+ * @brief Part per voxel (pmap / photons), with an OccupancyBitmap of the
+ *        non-zero entries. Writes go through set() / swap() so the two agree
+ */
+class PartMap {
+public:
+    PartMap() { ids.fill(0); }
+    PartMap(const PartMap&) = delete;
+    PartMap& operator=(const PartMap&) = delete;
+
+    pmap_id operator()(const coord_t x, const coord_t y, const coord_t z) const { return ids(x, y, z); }
+    bool occupied(const coord_t x, const coord_t y, const coord_t z) const { return bits.test(x, y, z); }
+    const OccupancyBitmap &occupancy() const { return bits; }
+
+    void set(const coord_t x, const coord_t y, const coord_t z, const pmap_id value) {
+        pmap_id &id = ids(x, y, z);
+        if (!id != !value) { // Bits are shared between threads, only touch them on a change
+            if (value)
+                bits.set(x, y, z);
+            else
+                bits.clear(x, y, z);
+        }
+        id = value;
+    }
+
+    void swap(const coord_t x1, const coord_t y1, const coord_t z1,
+            const coord_t x2, const coord_t y2, const coord_t z2) {
+        const pmap_id first = ids(x1, y1, z1);
+        set(x1, y1, z1, ids(x2, y2, z2));
+        set(x2, y2, z2, first);
+    }
+
+    void clear() {
+        ids.fill(0);
+        bits.clear_all();
+    }
+
+private:
+    VoxelGrid<pmap_id> ids;
+    OccupancyBitmap bits;
+};
+
+#endif
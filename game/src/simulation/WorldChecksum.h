@@ -0,0 +1,48 @@
+#ifndef WORLD_CHECKSUM_H
+#define WORLD_CHECKSUM_H
+
+#include <stdint.h>
+#include <cstring>
+
+/**
+ * @brief Checksum of the simulation state, one hash per part of it so a
+ *        mismatch says where results diverged. See Simulation::checksum
+ */
+struct WorldChecksum {
+    uint64_t parts = 0;
+    uint64_t pmap = 0;
+    uint64_t photons = 0;
+    uint64_t air = 0;
+
+    bool operator==(const WorldChecksum &other) const = default;
+};
+
+namespace ChecksumHash {
+    /**
+     * @brief splitmix64 finalizer, every input bit affects every output bit
+     */
+    inline uint64_t mix(uint64_t value) {
+        value ^= value >> 30;
+        value *= 0xBF58476D1CE4E5B9ull;
+        value ^= value >> 27;
+        value *= 0x94D049BB133111EBull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    /**
+     * @brief Hash of a sequence, order matters
+     */
+    inline uint64_t combine(const uint64_t hash, const uint64_t value) {
+        return mix(hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2)));
+    }
+
+    // Bit pattern, so -0.0f and 0.0f (or two NaNs) are told apart like any other change
+    inline uint64_t bits(const float value) {
+        uint32_t out;
+        std::memcpy(&out, &value, sizeof(out));
+        return out;
+    }
+}
+
+#endif
@@ -22,7 +22,7 @@ static int update(UPDATE_FUNC_ARGS) {
         for (int dy = -1; dy <= 1; dy++)
         for (int dx = -1; dx <= 1; dx++) {
             if (!dx && !dz && !dy) continue;
-            if (TYP(pmap[z + dz][y + dy][x + dx]) == PT_GOL) {
+            if (TYP(pmap(x + dx, y + dy, z + dz)) == PT_GOL) {
                 neighbors++;
             }
         }
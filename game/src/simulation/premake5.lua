@@ -7,7 +7,14 @@ for id, name in pairs(elements) do
 end
 element_defines = table.concat(element_defines)
 
-defines { "__GLOBAL_ELEMENT_COUNT=" .. (#elements) }
+-- Anything including the simulation headers needs the element count,
+-- call this from every project that uses the simulation library
+local element_count_define = "__GLOBAL_ELEMENT_COUNT=" .. (#elements)
+function simulation_defines()
+    defines { element_count_define }
+end
+
+simulation_defines()
 
 -- Get previous hash of element list
 local f = io.open("ElementNumbers.h")
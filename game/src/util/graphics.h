@@ -37,30 +37,6 @@ namespace util {
         draw_render_texture(tex, Vector2{0.0f, 0.0f}, Vector2{ (float)tex.texture.width, (float)tex.texture.height });
     }
 
-    // Custom load render textures
-    inline RenderTexture2D load_render_texture_only_color(int width, int height, int format) {
-        RenderTexture2D target = { 0 };
-        target.id = rlLoadFramebuffer();
-
-        if (target.id > 0) {
-            rlEnableFramebuffer(target.id);
-
-            target.texture.id = rlLoadTexture(NULL, width, height, format, 1);
-            target.texture.width = width;
-            target.texture.height = height;
-            target.texture.format = format;
-            target.texture.mipmaps = 1;
-
-            rlFramebufferAttach(target.id, target.texture.id, RL_ATTACHMENT_COLOR_CHANNEL0, RL_ATTACHMENT_TEXTURE2D, 0);
-            if (rlFramebufferComplete(target.id))
-                TRACELOG(LOG_INFO, "FBO: [ID %i] Framebuffer object created successfully", target.id);
-
-            rlDisableFramebuffer();
-        }
-        else TRACELOG(LOG_WARNING, "FBO: Framebuffer object can not be created");
-        return target;
-    }
-
     // Draw a triangle, vertices meant to be changed by vertex shader
     inline void draw_dummy_triangle() {
         rlBegin(RL_TRIANGLES);
@@ -0,0 +1,80 @@
+#include "profiler.h"
+
+#include <omp.h>
+#include <cstdio>
+#include <algorithm>
+
+#ifdef TPT_PROFILE
+
+namespace util::profiler {
+    static const auto epoch = std::chrono::steady_clock::now();
+
+    // Buffers are registered lock-free and never freed, so the dump
+    // can read them while threads are still alive
+    static std::atomic<ThreadBuffer *> buffers[MAX_THREADS];
+    static std::atomic<unsigned int> buffer_count{0};
+    static thread_local ThreadBuffer * local_buffer = nullptr;
+
+    // Shared by threads beyond MAX_THREADS, zones from those threads may be lost
+    static ThreadBuffer overflow_buffer;
+
+    uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    ThreadBuffer &thread_buffer() {
+        if (local_buffer) [[likely]]
+            return *local_buffer;
+
+        const unsigned int idx = buffer_count.fetch_add(1, std::memory_order_relaxed);
+        if (idx >= MAX_THREADS) {
+            local_buffer = &overflow_buffer;
+            return *local_buffer;
+        }
+
+        local_buffer = new ThreadBuffer;
+        local_buffer->thread_num = omp_get_thread_num();
+        buffers[idx].store(local_buffer, std::memory_order_release);
+        return *local_buffer;
+    }
+
+    bool dump_chrome_trace(const char * path) {
+        FILE * f = fopen(path, "w");
+        if (!f) return false;
+
+        fprintf(f, "{\"traceEvents\":[\n");
+        bool first = true;
+        const unsigned int count = std::min(buffer_count.load(std::memory_order_acquire), MAX_THREADS);
+
+        for (unsigned int tid = 0; tid < count; tid++) {
+            const ThreadBuffer * buffer = buffers[tid].load(std::memory_order_acquire);
+            if (!buffer) continue; // Registered but not published yet
+
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"omp thread %d\"}}",
+                first ? "" : ",\n", tid, buffer->thread_num);
+            first = false;
+
+            const uint64_t head = buffer->head.load(std::memory_order_acquire);
+            const uint64_t start = head > RING_BUFFER_SIZE ? head - RING_BUFFER_SIZE : 0;
+            for (uint64_t i = start; i < head; i++) {
+                const ZoneEvent &event = buffer->events[i & (RING_BUFFER_SIZE - 1)];
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, tid, event.start_ns / 1000.0, (event.end_ns - event.start_ns) / 1000.0);
+            }
+        }
+
+        fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(f);
+        return true;
+    }
+}
+
+#else
+
+namespace util::profiler {
+    bool dump_chrome_trace([[maybe_unused]] const char * path) {
+        return false;
+    }
+}
+
+#endif
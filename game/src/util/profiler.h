@@ -0,0 +1,88 @@
+#ifndef UTIL_PROFILER_H
+#define UTIL_PROFILER_H
+
+#include "stdint.h"
+#include <atomic>
+#include <chrono>
+
+// Scoped timing zones, exported as a Chrome trace (open in chrome://tracing
+// or ui.perfetto.dev). Only compiled in when TPT_PROFILE is defined
+// (premake5 gmake2 --profile), otherwise PROFILE_ZONE expands to nothing
+//
+// Example:
+// void Simulation::update() {
+//     PROFILE_ZONE("Simulation::update");
+//     ...
+// }
+
+namespace util::profiler {
+    /**
+     * @brief Write all recorded zones of every thread to a Chrome trace JSON file
+     *        Should be called while no zones are being recorded (ie between frames)
+     * @param path Output file path
+     * @return Whether the file was written, always false if profiling is compiled out
+     */
+    bool dump_chrome_trace(const char * path);
+
+    /**
+     * @brief Whether zones are compiled in
+     */
+    constexpr bool enabled() {
+    #ifdef TPT_PROFILE
+        return true;
+    #else
+        return false;
+    #endif
+    }
+
+#ifdef TPT_PROFILE
+    constexpr unsigned int MAX_THREADS = 256;
+    constexpr unsigned int RING_BUFFER_SIZE = 1 << 16; // Zones kept per thread, must be a power of 2
+
+    struct ZoneEvent {
+        const char * name; // Must be a string literal, only the pointer is stored
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+
+    /**
+     * @brief Single producer ring buffer, one per thread. Only the owning thread
+     *        writes, the oldest zones are overwritten once full
+     */
+    struct ThreadBuffer {
+        ZoneEvent events[RING_BUFFER_SIZE];
+        std::atomic<uint64_t> head{0}; // Total number of zones ever written
+        int thread_num;                // OpenMP thread number when the buffer was created
+    };
+
+    uint64_t now_ns();
+    ThreadBuffer &thread_buffer();
+
+    class ScopedZone {
+    public:
+        ScopedZone(const char * name): name(name), start_ns(now_ns()) {}
+        ~ScopedZone() {
+            ThreadBuffer &buffer = thread_buffer();
+            const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+            buffer.events[head & (RING_BUFFER_SIZE - 1)] = ZoneEvent{ name, start_ns, now_ns() };
+            buffer.head.store(head + 1, std::memory_order_release);
+        }
+
+        ScopedZone(const ScopedZone &other) = delete;
+        ScopedZone &operator=(const ScopedZone &other) = delete;
+    private:
+        const char * name;
+        uint64_t start_ns;
+    };
+#endif
+}
+
+#ifdef TPT_PROFILE
+    #define PROFILE_CONCAT_INNER(a, b) a ## b
+    #define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+    #define PROFILE_ZONE(name) util::profiler::ScopedZone PROFILE_CONCAT(_profile_zone_, __LINE__)(name)
+#else
+    #define PROFILE_ZONE(name)
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef UTIL_COUNTER_RAND_H
+#define UTIL_COUNTER_RAND_H
+
+#include "raylib.h"
+#include "raymath.h"
+#include "../vector_op.h"
+
+#include <stdint.h>
+#include <array>
+#include <cmath>
+#include <ctime>
+
+/**
+ * @brief Counter based RNG (Philox4x32-10, Salmon et al. 2011). Every number is
+ *        a pure function of the seed and a counter, here (frame, id, purpose,
+ *        draw), so there is no state shared between threads and a particle
+ *        gets the same numbers no matter which thread updates it, or in
+ *        what order. Draw from stream(frame, id), which is cheap to make and only
+ *        lives for one particle's update
+ *
+ *        Limitation: this makes a part's numbers independent of the thread
+ *        count only as long as its id is. Ids freed or handed out inside the
+ *        parallel passes go through per thread free lists (see
+ *        ParticleAllocator), so once parts are killed or created during a
+ *        frame, the ids later created parts get, and so their numbers,
+ *        depend on the thread count and scheduling. Scenes that only create
+ *        parts before the first frame (the bench / golden scenes) are not
+ *        affected
+ */
+class CounterRNG {
+public:
+    using Block = std::array<uint32_t, 4>;
+    using Key = std::array<uint32_t, 2>;
+
+    /**
+     * @brief One particle's numbers for one frame, same interface as RNG.
+     *        Words are generated 4 at a time, so the common draws (a unit
+     *        vector, two uniforms) cost one Philox block
+     */
+    class Stream {
+    public:
+        Stream(const Key key, const uint32_t frame, const uint32_t id, const uint32_t purpose):
+            key(key), counter{ id, frame, purpose, 0 }, used(4) {}
+
+        uint32_t next() {
+            if (used == 4) {
+                words = philox(counter, key);
+                counter[3]++;
+                used = 0;
+            }
+            return words[used++];
+        }
+
+        /**
+         * @brief Random float in [0, 1)
+         */
+        float uniform01() { return to_float01(next()); }
+
+        /**
+         * @brief Random float between lower and upper
+         */
+        float uniform(const float lower, const float upper) { return uniform01() * (upper - lower) + lower; }
+
+        /**
+         * @brief Generate a random vector with magnitude 1.0f
+         */
+        Vector3 rand_norm_vector() {
+            const uint32_t a = next(), b = next(), c = next();
+            return to_norm_vector(a, b, c);
+        }
+
+        /**
+         * @brief Returns a random vector3 orthogonal to the given one
+         *        with a magnitude between 0 and 1.0. Does not guarantee the result
+         *        is non-zero
+         * @param ray Given vector, must have non-zero magnitude
+         */
+        Vector3 rand_perpendicular_vector(const Vector3 ray) {
+            constexpr float RANGE = 0.57735026919f; // sqrt(1/3), should cap max magnitude at 1.0f
+            Vector3 randv{ uniform(-RANGE, RANGE), uniform(-RANGE, RANGE), uniform(-RANGE, RANGE) };
+            randv -= Vector3DotProduct(randv, ray) / Vector3DotProduct(ray, ray) * ray;
+            return randv;
+        }
+
+    private:
+        Key key;
+        Block counter; // { id, frame, purpose, draw block }
+        Block words;
+        unsigned int used;
+    };
+
+    CounterRNG() { seed(static_cast<unsigned int>(time(NULL))); }
+
+    void seed(const unsigned int sd) { key = { sd, 614 }; }
+
+    /**
+     * @brief The numbers of particle id in a frame. purpose tells apart
+     *        independent uses within the same update (0 for movement)
+     */
+    Stream stream(const uint32_t frame, const uint32_t id, const uint32_t purpose = 0) const {
+        return Stream(key, frame, id, purpose);
+    }
+
+    /**
+     * @brief out[k] = stream(frame, ids[k], purpose).uniform01(), for many
+     *        particles at once. Lanes are independent so the loop vectorizes.
+     *        Bit exact with the streams, tptbox-golden checks it (there is no
+     *        rand_norm_vector version: with -Ofast the vectorized normalize
+     *        rounds differently from the scalar one)
+     */
+    void uniform01_batch(const uint32_t frame, const int32_t * ids, const unsigned int count, float * out,
+            const uint32_t purpose = 0) const {
+        for (unsigned int k = 0; k < count; k++)
+            out[k] = to_float01(philox(Block{ static_cast<uint32_t>(ids[k]), frame, purpose, 0 }, key)[0]);
+    }
+
+    static Block philox(Block counter, Key key) {
+        constexpr uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+        constexpr uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85; // Golden ratio, sqrt(3) - 1
+        for (int round = 0; round < 10; round++) {
+            const uint64_t p0 = static_cast<uint64_t>(M0) * counter[0];
+            const uint64_t p1 = static_cast<uint64_t>(M1) * counter[2];
+            counter = {
+                static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ key[0],
+                static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ key[1],
+                static_cast<uint32_t>(p0)
+            };
+            key[0] += W0;
+            key[1] += W1;
+        }
+        return counter;
+    }
+
+private:
+    Key key;
+
+    // Top 24 bits, so every value is exact and 1 is never reached
+    static float to_float01(const uint32_t word) {
+        return static_cast<float>(word >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static Vector3 to_norm_vector(const uint32_t a, const uint32_t b, const uint32_t c) {
+        const Vector3 v{ to_float01(a) * 2.0f - 1.0f, to_float01(b) * 2.0f - 1.0f, to_float01(c) * 2.0f - 1.0f };
+        const float length = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+        return length > 0.0f ? Vector3{ v.x / length, v.y / length, v.z / length } : Vector3{ 0.0f, 1.0f, 0.0f };
+    }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef UTIL_DIRTY_PAGES_H
+#define UTIL_DIRTY_PAGES_H
+
+#include "stdint.h"
+#include <cstddef>
+#include <cstring>
+
+namespace util {
+    /**
+     * @brief Which pages of a buffer changed since they were last uploaded:
+     *        a byte per page, non zero if dirty. take_spans coalesces the
+     *        dirty pages into as few upload ranges as possible
+     *
+     * @tparam PAGES Number of pages
+     */
+    template <std::size_t PAGES>
+    class DirtyPages {
+    public:
+        DirtyPages() { clear(); }
+
+        /**
+         * @brief Page changed. Marking the same page from several threads
+         *        is fine, they all write the same value
+         */
+        void mark(const std::size_t page) { _pages[page] = 1; }
+        void clear() { std::memset(_pages, 0, PAGES); }
+
+        bool is_dirty(const std::size_t page) const { return _pages[page]; }
+
+        /**
+         * @brief Call upload(first_page, page_count) for every run of dirty
+         *        pages, and mark them clean. Runs separated by at most max_gap
+         *        clean pages are merged into one, uploading a few clean pages
+         *        is cheaper than another call
+         * @return Number of pages passed to upload, including merged clean ones
+         */
+        template <class F>
+        std::size_t take_spans(const std::size_t max_gap, F &&upload) {
+            std::size_t begin = 0, end = 0, total = 0; // Current run is [begin, end), empty if equal
+            for (std::size_t page = _next_dirty(0); page < PAGES; page = _next_dirty(page + 1)) {
+                _pages[page] = 0;
+                if (begin != end && page - end <= max_gap) {
+                    end = page + 1;
+                    continue;
+                }
+                if (begin != end) {
+                    upload(begin, end - begin);
+                    total += end - begin;
+                }
+                begin = page;
+                end = page + 1;
+            }
+            if (begin != end) {
+                upload(begin, end - begin);
+                total += end - begin;
+            }
+            return total;
+        }
+
+    private:
+        uint8_t _pages[PAGES];
+
+        // First dirty page >= from, PAGES if none. Skips 8 clean pages at a time
+        std::size_t _next_dirty(std::size_t from) const {
+            for (; from < PAGES && (from & 7); from++)
+                if (_pages[from]) return from;
+            for (; from + 8 <= PAGES; from += 8) {
+                uint64_t word;
+                std::memcpy(&word, _pages + from, sizeof(word));
+                if (word) break;
+            }
+            for (; from < PAGES; from++)
+                if (_pages[from]) return from;
+            return PAGES;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef UTIL_HALF_H
+#define UTIL_HALF_H
+
+#include "stdint.h"
+#include <bit>
+
+namespace util {
+    /**
+     * @brief Convert a float to IEEE 754 half precision bits, rounding
+     *        to nearest even. Out of range values become +-inf
+     * @see https://gist.github.com/rygorous/2156668
+     */
+    inline uint16_t float_to_half(const float value) {
+        constexpr uint32_t f32_infty = 255u << 23;
+        constexpr uint32_t f16_max = (127u + 16u) << 23;
+        constexpr uint32_t denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+        uint32_t f = std::bit_cast<uint32_t>(value);
+        const uint32_t sign = f & 0x80000000u;
+        f ^= sign;
+
+        uint16_t out;
+        if (f >= f16_max) // Inf or NaN
+            out = f > f32_infty ? 0x7E00 : 0x7C00;
+        else if (f < (113u << 23)) { // Subnormal or zero, let the FPU round it
+            const float tmp = std::bit_cast<float>(f) + std::bit_cast<float>(denorm_magic);
+            out = static_cast<uint16_t>(std::bit_cast<uint32_t>(tmp) - denorm_magic);
+        } else {
+            const uint32_t mant_odd = (f >> 13) & 1;
+            f += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFF;
+            f += mant_odd;
+            out = static_cast<uint16_t>(f >> 13);
+        }
+        return out | static_cast<uint16_t>(sign >> 16);
+    }
+
+    /**
+     * @brief Convert IEEE 754 half precision bits to a float (exact)
+     */
+    inline float half_to_float(const uint16_t half) {
+        constexpr uint32_t shifted_exp = 0x7C00u << 13;
+        constexpr uint32_t magic = 113u << 23;
+
+        uint32_t out = (half & 0x7FFFu) << 13;
+        const uint32_t exp = shifted_exp & out;
+        out += (127u - 15u) << 23;
+
+        if (exp == shifted_exp) // Inf or NaN
+            out += (128u - 16u) << 23;
+        else if (exp == 0) { // Subnormal or zero, renormalize
+            out += 1u << 23;
+            out = std::bit_cast<uint32_t>(std::bit_cast<float>(out) - std::bit_cast<float>(magic));
+        }
+        return std::bit_cast<float>(out | (static_cast<uint32_t>(half & 0x8000u) << 16));
+    }
+}
+
+#endif
@@ -8,6 +8,8 @@
 #include <cstring>
 #include <algorithm>
 
+#include "../../render/types/render_backend.h"
+
 /**
  * @brief Uniform Buffer Object Writer
  * Why? Because UBO offsets can be unpredictable / require manual padding
@@ -19,7 +21,7 @@
  *   float Y;
  * };
  * 
- * auto writer = UBOWriter(myShaderProgramId, "MyBlock");
+ * auto writer = UBOWriter(backend, myShaderProgramId, myUBOId, "MyBlock");
  * writer.write_member("X", 1);
  * writer.write_member("Y", 1.0f);
  * writer.upload(); // Will bind buffer!
@@ -29,11 +31,12 @@ public:
     /**
      * @brief Construct a new UBOWriter object
      * 
+     * @param backend Makes the GL calls, see RenderBackend
      * @param program ID of shader program uniform buffer obj resides
      * @param UBOId ID of the UBO
      * @param uniformBlockName Name in the shader, ie uniform MyUBOName { would be "MyUBOName"
      */
-    UBOWriter(const GLuint program, const GLuint UBOId, const char * uniformBlockName);
+    UBOWriter(RenderBackend &backend, const GLuint program, const GLuint UBOId, const char * uniformBlockName);
     
     ~UBOWriter() { destroy(); }
     UBOWriter(const UBOWriter &other) = delete;
@@ -75,8 +78,8 @@ public:
      * @brief Upload changes to the data array to the GPU, will bind the UBO buffer
      */
     void upload() {
-        glBindBuffer(GL_UNIFORM_BUFFER, UBOId);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, dataSizeBytes, data); 
+        backend->bind_buffer(GL_UNIFORM_BUFFER, UBOId);
+        backend->buffer_sub_data(GL_UNIFORM_BUFFER, 0, dataSizeBytes, data);
     }
 
     /**
@@ -86,17 +89,18 @@ public:
     GLint size() const { return dataSizeBytes; }
 
     void swap(UBOWriter &other) noexcept {
+        std::swap(other.backend, backend);
         std::swap(other.uniformBlockName, uniformBlockName);
         std::swap(other.programId, programId);
         std::swap(other.UBOId, UBOId);
         std::swap(other.dataSizeBytes, dataSizeBytes);
-        std::swap(other.uniformCount, uniformCount);
         std::swap(other.data, data);
     }
 private:
+    RenderBackend * backend;
     const char * uniformBlockName;
     GLint programId, UBOId;
-    GLint dataSizeBytes, uniformCount; // Resolved in constructor with OpenGL call
+    GLint dataSizeBytes; // Resolved in constructor with OpenGL call
     uint8_t * data;
 
     /**
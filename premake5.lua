@@ -13,6 +13,24 @@ newoption
     default = "opengl43"
 }
 
+newoption
+{
+    trigger = "profile",
+    description = "Compile in profiler zones (PROFILE_ZONE), dumped as a Chrome trace"
+}
+
+newoption
+{
+    trigger = "compact-particles",
+    description = "Store particles with fixed point positions, half float velocities and paged cold fields"
+}
+
+newoption
+{
+    trigger = "bricked-maps",
+    description = "Store pmap / photons in 8x8x8 bricks instead of x-major rows"
+}
+
 function string.starts(String,Start)
     return string.sub(String,1,string.len(Start))==Start
 end
@@ -67,11 +85,24 @@ workspace (workspaceName)
     filter "configurations:Release"
         defines { "NDEBUG" }
         optimize "Speed"
+        -- Float math must round like Debug (no reassociation, reciprocal
+        -- approximations or fused multiply-adds) so the golden files match both
         buildoptions {
 			"-fno-exceptions",
-			"-Ofast"
+			"-Ofast",
+			"-fno-unsafe-math-optimizations",
+			"-ffp-contract=off"
 		}
 
+    filter "options:profile"
+        defines { "TPT_PROFILE" }
+
+    filter "options:compact-particles"
+        defines { "TPT_COMPACT_PARTICLES" }
+
+    filter "options:bricked-maps"
+        defines { "TPT_BRICKED_MAPS" }
+
     filter { "platforms:x64" }
         architecture "x86_64"
 		